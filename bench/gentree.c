@@ -0,0 +1,235 @@
+// Synthetic directory trees for `make bench`.
+//
+//   gentree DIR [SCALE]
+//
+// Creates one subdirectory of DIR per workload, each stressing a
+// different part of lsx:
+//
+//   wide     one flat directory, names of mixed length (1-200 bytes)
+//   deep     a long chain of nested directories with a few files each
+//   tree     a balanced tree with mixed names, sizes, times and owners
+//   unicode  multi-byte, wide and combining-character names
+//   owners   files spread over thousands of distinct uids and gids
+//
+// Everything comes from a fixed seed, so the same SCALE always produces
+// the same trees. SCALE multiplies the entry counts (default 1). Files
+// are empty or sparse, so even large trees take little disk space.
+// Owners can only be changed when running as root; otherwise every file
+// keeps the caller's uid and a note is printed.
+//
+// A DIR/.done stamp records the scale; when it matches, nothing is done.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned long long g_rng = 0x9E3779B97F4A7C15ULL;
+static int g_chown_ok = 1;
+static unsigned long g_files, g_dirs;
+
+static unsigned long long rnd(void) {
+    // xorshift64*
+    g_rng ^= g_rng >> 12;
+    g_rng ^= g_rng << 25;
+    g_rng ^= g_rng >> 27;
+    return g_rng * 2685821657736338717ULL;
+}
+
+static unsigned rnd_below(unsigned n) {
+    return (unsigned)(rnd() % n);
+}
+
+static void die(const char *what, const char *path) {
+    fprintf(stderr, "gentree: %s %s: %s\n", what, path, strerror(errno));
+    exit(1);
+}
+
+static void make_dir(const char *path) {
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) die("mkdir", path);
+    g_dirs++;
+}
+
+// Random mtime within the last two years, a random (sparse) size and,
+// with uids > 0, a random owner among that many.
+static void make_file(const char *path, unsigned uids) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, rnd_below(4) ? 0644 : 0755);
+    if (fd < 0) die("create", path);
+
+    off_t size = rnd_below(8) ? (off_t)rnd_below(64 * 1024) : (off_t)rnd_below(1u << 30);
+    if (ftruncate(fd, size) != 0) die("truncate", path);
+
+    struct timespec ts[2];
+    ts[0].tv_sec = time(NULL) - (time_t)rnd_below(2 * 365 * 86400);
+    ts[0].tv_nsec = (long)rnd_below(1000000000);
+    ts[1] = ts[0];
+    if (futimens(fd, ts) != 0) die("utime", path);
+
+    if (uids && g_chown_ok) {
+        uid_t uid = (uid_t)(1000 + rnd_below(uids));
+        gid_t gid = (gid_t)(1000 + rnd_below(uids / 2 + 1));
+        if (fchown(fd, uid, gid) != 0) {
+            if (errno != EPERM) die("chown", path);
+            g_chown_ok = 0;
+        }
+    }
+
+    close(fd);
+    g_files++;
+}
+
+// ASCII name of roughly random length in [lo, hi], made unique by the
+// index in front of the first '-'.
+static void ascii_name(char *out, size_t outsz, unsigned idx, unsigned lo, unsigned hi) {
+    static const char alpha[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-.";
+    int n = snprintf(out, outsz, "%x-", idx);
+    unsigned len = lo + rnd_below(hi - lo + 1);
+    while ((unsigned)n < len && (size_t)n + 1 < outsz) out[n++] = alpha[rnd_below(sizeof(alpha) - 2)];
+    out[n] = '\0';
+    // A few names with numbers and extensions, for -v and -X.
+    if (rnd_below(3) == 0 && (size_t)n + 8 < outsz) {
+        static const char *const ext[] = { ".c", ".h", ".txt", ".tar.gz", ".md", ".o", ".json" };
+        snprintf(out + n, outsz - (size_t)n, "%s", ext[rnd_below(7)]);
+    }
+}
+
+static void gen_wide(const char *root, unsigned count) {
+    char dir[4096], path[4096 + 256];
+    snprintf(dir, sizeof(dir), "%s/wide", root);
+    make_dir(dir);
+    for (unsigned i = 0; i < count; i++) {
+        char name[256];
+        ascii_name(name, sizeof(name), i, 1, 200);
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        make_file(path, 0);
+    }
+}
+
+static void gen_deep(const char *root, unsigned depth) {
+    char path[4096 * 2];
+    int len = snprintf(path, sizeof(path), "%s/deep", root);
+    make_dir(path);
+    for (unsigned d = 0; d < depth; d++) {
+        for (int k = 0; k < 3; k++) {
+            char file[sizeof(path) + 16];
+            snprintf(file, sizeof(file), "%s/f%d", path, k);
+            make_file(file, 0);
+        }
+        // Keep the path well below PATH_MAX however deep the chain.
+        int n = snprintf(path + len, sizeof(path) - (size_t)len, "/%c", 'a' + d % 26);
+        if (n < 0 || len + n >= 4000) break;
+        len += n;
+        make_dir(path);
+    }
+}
+
+static void gen_tree_level(char *path, size_t len, int level, int depth, unsigned fanout, unsigned files,
+                           unsigned *seq) {
+    char name[256];
+    for (unsigned i = 0; i < files; i++) {
+        ascii_name(name, sizeof(name), (*seq)++, 3, 40);
+        snprintf(path + len, 4096 - len, "/%s", name);
+        make_file(path, 64);
+    }
+    if (level == depth) return;
+    for (unsigned i = 0; i < fanout; i++) {
+        ascii_name(name, sizeof(name), (*seq)++, 2, 16);
+        int n = snprintf(path + len, 4096 - len, "/%s", name);
+        make_dir(path);
+        gen_tree_level(path, len + (size_t)n, level + 1, depth, fanout, files, seq);
+    }
+    path[len] = '\0';
+}
+
+static void gen_unicode(const char *root, unsigned count) {
+    static const char *const parts[] = {
+        "\xC3\xA9",                  // é
+        "\xC3\xB1",                  // ñ
+        "\xCE\xA9",                  // Ω
+        "\xD0\x96",                  // Ж
+        "\xE6\x97\xA5\xE6\x9C\xAC",  // 日本 (wide)
+        "\xED\x95\x9C",              // 한 (wide)
+        "\xF0\x9F\x98\x80",          // 😀 (wide, 4 bytes)
+        "e\xCC\x81",                 // e + combining acute
+        "abc", "_", "-",
+    };
+    char dir[4096], path[4096 + 512];
+    snprintf(dir, sizeof(dir), "%s/unicode", root);
+    make_dir(dir);
+    for (unsigned i = 0; i < count; i++) {
+        char name[256];
+        int n = snprintf(name, sizeof(name), "%u", i);
+        unsigned pieces = 1 + rnd_below(12);
+        for (unsigned k = 0; k < pieces; k++) {
+            const char *p = parts[rnd_below(sizeof(parts) / sizeof(parts[0]))];
+            size_t pl = strlen(p);
+            if ((size_t)n + pl >= sizeof(name)) break;
+            memcpy(name + n, p, pl + 1);
+            n += (int)pl;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        make_file(path, 0);
+    }
+}
+
+static void gen_owners(const char *root, unsigned count, unsigned uids) {
+    char dir[4096], path[4096 + 32];
+    snprintf(dir, sizeof(dir), "%s/owners", root);
+    make_dir(dir);
+    for (unsigned i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%s/file%06u", dir, i);
+        make_file(path, uids);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s DIR [SCALE]\n", argv[0]);
+        return 2;
+    }
+    const char *root = argv[1];
+    double scale = argc > 2 ? atof(argv[2]) : 1.0;
+    if (scale <= 0) {
+        fprintf(stderr, "gentree: invalid scale: %s\n", argv[2]);
+        return 2;
+    }
+
+    char stamp[4096], want[64], have[64] = "";
+    snprintf(stamp, sizeof(stamp), "%s/.done", root);
+    snprintf(want, sizeof(want), "scale %g\n", scale);
+    FILE *f = fopen(stamp, "r");
+    if (f) {
+        if (!fgets(have, sizeof(have), f)) have[0] = '\0';
+        fclose(f);
+        if (strcmp(have, want) == 0) return 0;
+        fprintf(stderr, "gentree: %s was generated with a different scale; remove it first\n", root);
+        return 1;
+    }
+
+    make_dir(root);
+    printf("gentree: generating trees in %s (scale %g)\n", root, scale);
+
+    gen_wide(root, (unsigned)(100000 * scale));
+    gen_deep(root, (unsigned)(400 * scale));
+
+    char path[4096];
+    int len = snprintf(path, sizeof(path), "%s/tree", root);
+    make_dir(path);
+    unsigned seq = 0;
+    gen_tree_level(path, (size_t)len, 0, 4, 6, (unsigned)(12 * scale), &seq);
+
+    gen_unicode(root, (unsigned)(20000 * scale));
+    gen_owners(root, (unsigned)(20000 * scale), 5000);
+
+    if (!g_chown_ok) printf("gentree: not root, all files keep the current owner\n");
+    printf("gentree: %lu files, %lu directories\n", g_files, g_dirs);
+
+    f = fopen(stamp, "w");
+    if (!f || fputs(want, f) < 0 || fclose(f) != 0) die("write", stamp);
+    return 0;
+}
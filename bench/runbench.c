@@ -0,0 +1,325 @@
+// Benchmark runner for `make bench`.
+//
+//   runbench run LSX TREES OUT.tsv [RUNS]
+//   runbench compare OLD.tsv NEW.tsv
+//
+// `run` lists every tree made by gentree with each mode below and writes
+// one TSV line per (tree, mode):
+//
+//   wall_ms    median wall time of RUNS runs (default 5), after a warm-up
+//              run so every run sees a hot page cache
+//   syscalls   system calls of one extra run, counted with ptrace
+//              (Linux only; -1 elsewhere or when ptrace is not allowed)
+//   maxrss_kb  smallest peak RSS seen over the timed runs
+//   bytes      bytes lsx wrote to stdout
+//
+// Output goes to a pipe that is drained and counted, like a pager
+// reading it. The environment is pinned (COLUMNS, no LSX_* variables)
+// so runs are comparable across machines and shells.
+//
+// `compare` prints both files side by side and flags regressions: wall
+// time more than 10% (and 2 ms) slower, any rise in syscalls or a
+// change in output size.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ptrace.h>
+#endif
+
+#define MAX_RUNS 50
+
+static const char *const TREES[] = { "wide", "deep", "tree", "unicode", "owners" };
+
+static const char *const MODES[] = { "-l", "-lR", "-t", "-X", "-m" };
+
+#define NTREES (sizeof(TREES) / sizeof(TREES[0]))
+#define NMODES (sizeof(MODES) / sizeof(MODES[0]))
+
+typedef struct {
+    double wall_ms;
+    long long syscalls;
+    long maxrss_kb;
+    unsigned long long bytes;
+} Result;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+// Runs in the child: pinned environment, stdout to out_fd, stderr
+// discarded, then exec lsx.
+static void exec_lsx(const char *lsx, const char *mode, const char *path, int out_fd) {
+    unsetenv("LSX_ASCII");
+    unsetenv("LSX_CACHE");
+    unsetenv("LSX_DIRBUF");
+    unsetenv("LSX_STATS");
+    setenv("COLUMNS", "160", 1);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) dup2(null_fd, STDERR_FILENO);
+    dup2(out_fd, STDOUT_FILENO);
+
+    execl(lsx, lsx, mode, path, (char *)NULL);
+    _exit(127);
+}
+
+// One timed run. Returns 0 and fills wall, rss and bytes, or -1.
+static int timed_run(const char *lsx, const char *mode, const char *path, Result *r) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        close(fds[0]);
+        exec_lsx(lsx, mode, path, fds[1]);
+    }
+    close(fds[1]);
+
+    static char buf[1 << 16];
+    unsigned long long bytes = 0;
+    for (;;) {
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if (n > 0) bytes += (unsigned long long)n;
+        else if (n == 0 || errno != EINTR) break;
+    }
+    close(fds[0]);
+
+    int status;
+    struct rusage ru;
+    while (wait4(pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    r->wall_ms = now_ms() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+
+    r->bytes = bytes;
+#ifdef __APPLE__
+    r->maxrss_kb = ru.ru_maxrss / 1024;   // bytes there, KiB on Linux
+#else
+    r->maxrss_kb = ru.ru_maxrss;
+#endif
+    return 0;
+}
+
+// Count every system call of one run, threads included, by stopping the
+// child at each syscall entry and exit. Output goes to /dev/null so the
+// child never blocks on a pipe while we are waiting on it.
+static long long count_syscalls(const char *lsx, const char *mode, const char *path) {
+#ifdef __linux__
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0) return -1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(null_fd);
+        return -1;
+    }
+    if (pid == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) _exit(126);
+        exec_lsx(lsx, mode, path, null_fd);
+    }
+    close(null_fd);
+
+    // The child stops at exec; if TRACEME was refused it exits instead.
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) return -1;
+    long opts = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL;
+    if (ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)opts) != 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+
+    // Every syscall stops twice (entry and exit) except exit and
+    // exit_group, which never return; counting stops and halving is
+    // exact up to those.
+    long long stops = 0;
+    int failed = 0;
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+    for (;;) {
+        pid_t t = waitpid(-1, &status, __WALL);
+        if (t < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            if (t == pid && (WIFSIGNALED(status) || WEXITSTATUS(status) != 0)) failed = 1;
+            continue;
+        }
+        if (!WIFSTOPPED(status)) continue;
+
+        // Pass real signals on; swallow syscall stops, clone events and
+        // the SIGSTOP new threads start with.
+        int sig = WSTOPSIG(status);
+        int inject = 0;
+        if (sig == (SIGTRAP | 0x80)) stops++;
+        else if (!(status >> 16) && sig != SIGSTOP && sig != SIGTRAP) inject = sig;
+        ptrace(PTRACE_SYSCALL, t, NULL, (void *)(long)inject);
+    }
+    return failed ? -1 : (stops + 1) / 2;
+#else
+    (void)lsx;
+    (void)mode;
+    (void)path;
+    return -1;
+#endif
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int bench_one(const char *lsx, const char *mode, const char *path, int runs, Result *out) {
+    Result r;
+    if (timed_run(lsx, mode, path, &r) != 0) return -1;   // warm-up
+
+    double walls[MAX_RUNS];
+    out->maxrss_kb = 0;
+    for (int i = 0; i < runs; i++) {
+        if (timed_run(lsx, mode, path, &r) != 0) return -1;
+        walls[i] = r.wall_ms;
+        if (i == 0 || r.maxrss_kb < out->maxrss_kb) out->maxrss_kb = r.maxrss_kb;
+    }
+    qsort(walls, (size_t)runs, sizeof(walls[0]), cmp_double);
+    out->wall_ms = runs % 2 ? walls[runs / 2] : (walls[runs / 2 - 1] + walls[runs / 2]) / 2;
+    out->bytes = r.bytes;
+    out->syscalls = count_syscalls(lsx, mode, path);
+    return 0;
+}
+
+static int cmd_run(const char *lsx, const char *trees, const char *out_path, int runs) {
+    if (access(lsx, X_OK) != 0) {
+        fprintf(stderr, "runbench: %s: %s\n", lsx, strerror(errno));
+        return 1;
+    }
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        fprintf(stderr, "runbench: %s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    time_t t = time(NULL);
+    char when[64];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    fprintf(out, "# lsx bench, %s on %s, %d runs\n", when, host, runs);
+    fprintf(out, "tree\tmode\twall_ms\tsyscalls\tmaxrss_kb\tbytes\n");
+
+    printf("%-8s %-4s %10s %10s %10s %12s\n", "TREE", "MODE", "WALL ms", "SYSCALLS", "RSS KB", "BYTES");
+    int failures = 0;
+    for (size_t i = 0; i < NTREES; i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", trees, TREES[i]);
+        for (size_t m = 0; m < NMODES; m++) {
+            Result r;
+            if (bench_one(lsx, MODES[m], path, runs, &r) != 0) {
+                fprintf(stderr, "runbench: %s %s %s failed\n", lsx, MODES[m], path);
+                failures++;
+                continue;
+            }
+            printf("%-8s %-4s %10.2f %10lld %10ld %12llu\n", TREES[i], MODES[m], r.wall_ms, r.syscalls,
+                   r.maxrss_kb, r.bytes);
+            fprintf(out, "%s\t%s\t%.3f\t%lld\t%ld\t%llu\n", TREES[i], MODES[m], r.wall_ms, r.syscalls,
+                    r.maxrss_kb, r.bytes);
+        }
+    }
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "runbench: %s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+    printf("runbench: results saved to %s\n", out_path);
+    return failures ? 1 : 0;
+}
+
+typedef struct {
+    char tree[32];
+    char mode[16];
+    Result r;
+} Row;
+
+// Read a results file; returns the row count or -1.
+static int load_results(const char *path, Row *rows, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "runbench: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char line[512];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), f)) {
+        Row *row = &rows[n];
+        if (line[0] == '#' || strncmp(line, "tree\tmode\t", 10) == 0) continue;
+        if (sscanf(line, "%31[^\t]\t%15[^\t]\t%lf\t%lld\t%ld\t%llu", row->tree, row->mode, &row->r.wall_ms,
+                   &row->r.syscalls, &row->r.maxrss_kb, &row->r.bytes) == 6) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+static int cmd_compare(const char *old_path, const char *new_path) {
+    Row old[NTREES * NMODES], cur[NTREES * NMODES];
+    int nold = load_results(old_path, old, (int)(NTREES * NMODES));
+    int ncur = load_results(new_path, cur, (int)(NTREES * NMODES));
+    if (nold < 0 || ncur < 0) return 1;
+
+    printf("\ncompared with %s\n", old_path);
+    printf("%-8s %-4s %21s %8s %23s %10s\n", "TREE", "MODE", "WALL ms", "", "SYSCALLS", "RSS KB");
+    int regressions = 0;
+    for (int i = 0; i < ncur; i++) {
+        const Row *c = &cur[i];
+        const Row *o = NULL;
+        for (int k = 0; k < nold && !o; k++) {
+            if (strcmp(old[k].tree, c->tree) == 0 && strcmp(old[k].mode, c->mode) == 0) o = &old[k];
+        }
+        if (!o) continue;
+
+        double pct = o->r.wall_ms > 0 ? (c->r.wall_ms - o->r.wall_ms) * 100.0 / o->r.wall_ms : 0;
+        const char *flag = "";
+        if (pct > 10 && c->r.wall_ms - o->r.wall_ms > 2) flag = "  SLOWER";
+        else if (o->r.syscalls >= 0 && c->r.syscalls > o->r.syscalls) flag = "  MORE SYSCALLS";
+        else if (c->r.bytes != o->r.bytes) flag = "  OUTPUT CHANGED";
+        if (*flag) regressions++;
+
+        printf("%-8s %-4s %10.2f %10.2f %+7.1f%% %11lld %11lld %10ld%s\n", c->tree, c->mode, o->r.wall_ms,
+               c->r.wall_ms, pct, o->r.syscalls, c->r.syscalls, c->r.maxrss_kb, flag);
+    }
+    printf("%d of %d results flagged\n", regressions, ncur);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 5 && argc <= 6 && strcmp(argv[1], "run") == 0) {
+        int runs = argc == 6 ? atoi(argv[5]) : 5;
+        if (runs < 1 || runs > MAX_RUNS) {
+            fprintf(stderr, "runbench: runs must be 1..%d\n", MAX_RUNS);
+            return 2;
+        }
+        return cmd_run(argv[2], argv[3], argv[4], runs);
+    }
+    if (argc == 4 && strcmp(argv[1], "compare") == 0) return cmd_compare(argv[2], argv[3]);
+
+    fprintf(stderr, "usage: %s run LSX TREES OUT.tsv [RUNS]\n", argv[0]);
+    fprintf(stderr, "       %s compare OLD.tsv NEW.tsv\n", argv[0]);
+    return 2;
+}
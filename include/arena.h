@@ -0,0 +1,34 @@
+#ifndef LSX_ARENA_H
+#define LSX_ARENA_H
+
+#include <stddef.h>
+
+// Stack-style bump allocator. Callers take a mark before allocating and
+// release back to it when done, so memory is reused LIFO (one level of a
+// directory walk pushes, its siblings reuse the same bytes). Chunks are
+// kept after a release and only returned to the system by arena_destroy.
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    ArenaChunk *first;
+    ArenaChunk *cur;
+    size_t chunk_size;
+    size_t used;        // live bytes, including alignment padding
+    size_t high_water;  // max of used over the arena's lifetime
+    size_t reserved;    // bytes obtained from malloc
+} Arena;
+
+typedef struct {
+    ArenaChunk *chunk;
+    size_t off;
+    size_t used;
+} ArenaMark;
+
+void  arena_init(Arena *a, size_t chunk_size);
+void  arena_destroy(Arena *a);
+void *arena_alloc(Arena *a, size_t size);
+
+ArenaMark arena_mark(const Arena *a);
+void      arena_release(Arena *a, ArenaMark m);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef LSX_BROWSE_H
+#define LSX_BROWSE_H
+
+#include "filelist.h"
+#include "walk.h"
+
+// Interactive tree browser (-I) on ncurses. Directories are expanded in
+// place and loaded by the walker's threads, so the UI never waits on a
+// slow filesystem. Only the rows inside the window are formatted on each
+// redraw; a directory of any size costs the same to scroll through.
+//
+// Rows are produced by the listing's own formatting code through the
+// callbacks below, writing with out_* as usual; the browser captures
+// that output and translates its colors for curses.
+typedef struct {
+    // Walker whose load sorts the list and whose descend refuses
+    // everything: the browser decides what gets loaded.
+    Walker *walker;
+
+    // Box top with title, plus the column header in long format.
+    void (*header)(const char *title, int width, void *ctx);
+    // Entry i of list, nested level deep (0 for the root's entries).
+    void (*row)(const FileList *list, int i, int level, int is_last, int width, void *ctx);
+    // Placeholder row, e.g. while a directory is still loading.
+    void (*note)(const char *text, int level, int width, void *ctx);
+    // Box bottom.
+    void (*footer)(int width, void *ctx);
+    void *ctx;
+} BrowseConfig;
+
+// Run until the user quits. Returns 0, or -1 if the terminal could not
+// be set up.
+int browse_run(const char *root, const BrowseConfig *cfg);
+
+#endif
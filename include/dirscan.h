@@ -0,0 +1,44 @@
+#ifndef LSX_DIRSCAN_H
+#define LSX_DIRSCAN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define DIRSCAN_DEFAULT_BUF (256 * 1024)
+
+// One directory entry as returned by dirscan_next. name points into the
+// scanner's buffer and is only valid until the next call.
+typedef struct {
+    const char *name;
+    ino_t ino;
+    unsigned char type;  // DT_* value, DT_UNKNOWN (0) if not provided
+} DirEntry;
+
+typedef struct DirScan DirScan;
+
+typedef struct {
+    unsigned long opens;
+    unsigned long reads;    // getdents64 (or readdir) calls
+    unsigned long entries;
+    unsigned long long bytes;
+} DirScanStats;
+
+// On Linux entries are pulled with getdents64 into a large buffer and
+// parsed in place; elsewhere this wraps opendir/readdir.
+DirScan *dirscan_open(const char *path);
+DirScan *dirscan_open_sized(const char *path, size_t bufsize);
+int      dirscan_next(DirScan *ds, DirEntry *out);  // 1 = entry, 0 = end, -1 = error
+int      dirscan_fd(const DirScan *ds);
+void     dirscan_close(DirScan *ds);
+
+// Buffer size for subsequent dirscan_open calls (clamped to a sane range).
+void     dirscan_set_bufsize(size_t bytes);
+size_t   dirscan_bufsize(void);
+
+// Free the calling thread's cached read buffer.
+void     dirscan_thread_cleanup(void);
+
+const char *dirscan_backend(void);
+void        dirscan_get_stats(DirScanStats *out);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef LSX_FILELIST_H
+#define LSX_FILELIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "arena.h"
+
+#define MAX_PATH 4096
+
+#define FI_DIR    0x01
+#define FI_HIDDEN 0x02
+// Loaded only to be counted (--du): -a or a pattern keeps it off the rows.
+#define FI_FILTERED 0x04
+
+// Read-only view of one entry, assembled from the FileList columns.
+// name points into the list's string arena and stays valid until the
+// list is reset or freed.
+typedef struct {
+    const char *name;
+    size_t name_len;
+    int name_width;   // terminal columns, measured once when the entry is added
+    mode_t mode;
+    off_t size;
+    time_t mtime;
+    uid_t uid;
+    gid_t gid;
+    ino_t inode;
+    dev_t dev;
+    nlink_t nlink;
+    int is_dir;
+    int is_hidden;
+} FileItem;
+
+// Struct-of-arrays directory listing. Names are interned back to back
+// (NUL-terminated) in one growable arena and referenced by offset; the
+// stat fields live in dense columns. Full paths are never stored: they
+// are rebuilt on demand from dir + "/" + name.
+typedef struct {
+    char     *names;
+    size_t    names_len;
+    size_t    names_cap;
+
+    uint32_t *name_off;
+    uint16_t *name_len;
+    uint16_t *name_width;
+    mode_t   *mode;
+    off_t    *size;
+    time_t   *mtime;
+    uid_t    *uid;
+    gid_t    *gid;
+    ino_t    *inode;
+    dev_t    *dev;
+    nlink_t  *nlink;
+    uint8_t  *flags;
+
+    int count;
+    int cap;
+
+    char *cwd;  // title shown in the box header
+    char *dir;  // directory the entries live in (for filelist_path)
+} FileList;
+
+void filelist_init(FileList *list);
+void filelist_free(FileList *list);
+
+// Drop all entries (keeping capacity) and set the header title and the
+// directory that entry paths are built from.
+int  filelist_reset(FileList *list, const char *cwd, const char *dir);
+
+// Append an entry with zeroed stat columns and its display width
+// measured; returns its index or -1.
+int  filelist_add(FileList *list, const char *name, size_t len);
+
+static inline const char *filelist_name(const FileList *list, int i) {
+    return list->names + list->name_off[i];
+}
+
+void filelist_get(const FileList *list, int i, FileItem *out);
+
+// Store the metadata fields of item (everything but the name) at entry i.
+// FI_FILTERED is left as it was.
+void filelist_set(FileList *list, int i, const FileItem *item);
+
+// Build "dir/name" for entry i. Returns the length, or -1 if it does
+// not fit in outsz.
+int  filelist_path(const FileList *list, int i, char *out, size_t outsz);
+
+// Copy src into dst with every column sized exactly to src->count and
+// carved from the arena. dst must not be passed to filelist_free or
+// filelist_add; its memory goes away when the arena is released.
+int  filelist_freeze(const FileList *src, Arena *arena, FileList *dst);
+
+// Reorder all columns so that new position k holds old entry order[k].
+int  filelist_permute(FileList *list, const uint32_t *order);
+
+// Replace dst's contents with a copy of src, names packed afresh.
+int  filelist_copy(FileList *dst, const FileList *src);
+
+// Drop entry i by moving the last entry into its place. The name's bytes
+// stay in the string arena until the list is copied or reset.
+void filelist_remove(FileList *list, int i);
+
+// Drop every entry with any of the given flags, keeping the order of the
+// rest. Names stay in the arena as with filelist_remove.
+void filelist_drop_flagged(FileList *list, uint8_t flags);
+
+#endif
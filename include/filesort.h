@@ -0,0 +1,30 @@
+#ifndef LSX_FILESORT_H
+#define LSX_FILESORT_H
+
+#include "filelist.h"
+
+typedef enum {
+    SORT_NAME,     // byte order of the name
+    SORT_EXT,      // extension (from the last '.'), then name
+    SORT_TIME,     // newest first
+    SORT_SIZE,     // largest first, then name
+    SORT_VERSION,  // natural order: digit runs compare as numbers
+    SORT_COLLATE,  // LC_COLLATE order of the name
+} SortMode;
+
+// Sort the list in place. Keys (an 8-byte big-endian prefix of the
+// compared string, or the mtime) are built once into a compact record
+// array; records with distinct keys are ordered without touching the
+// names. The version and locale modes first derive a per-entry string
+// that compares with strcmp (a natural-order encoding, or strxfrm
+// output) and sort on that instead of the name. Large lists are radix-sorted on the key first, and only runs
+// of equal keys are finished with a comparator specialized for the mode
+// and direction. The sort is stable, so ties keep directory order.
+// Returns 0, or -1 if memory ran out (the list is left unsorted).
+int filelist_sort(FileList *list, SortMode mode, int reverse);
+
+// Same ordering, written to order (list->count indices: position k
+// holds the entry that sorts k-th) without touching the list.
+int filelist_sort_order(const FileList *list, SortMode mode, int reverse, uint32_t *order);
+
+#endif
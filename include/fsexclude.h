@@ -0,0 +1,30 @@
+#ifndef LSX_FSEXCLUDE_H
+#define LSX_FSEXCLUDE_H
+
+#include <sys/types.h>
+
+// Filesystem types the walk never descends into (--exclude-fs). The
+// mount table is read once, so a mount is recognized by the st_dev of
+// its root without anything on it being touched: on Linux from
+// /proc/self/mountinfo, on macOS from getmntinfo without refreshing
+// (MNT_NOWAIT), so a hung server cannot stall the lookup.
+//
+// A type name matches itself and its variants: "nfs" also covers
+// "nfs4", "fuse" covers "fuse.sshfs".
+typedef struct FsExclude FsExclude;
+
+FsExclude *fsexclude_new(void);
+void       fsexclude_free(FsExclude *x);
+
+// Add a comma-separated list of type names. Returns -1 when out of memory.
+int fsexclude_add_types(FsExclude *x, const char *list);
+
+// Find the mounts of the listed types. Call once, after the last
+// fsexclude_add_types. Returns -1 with errno set when the mount table
+// cannot be read (ENOTSUP where lsx does not know how).
+int fsexclude_read_mounts(FsExclude *x);
+
+// Whether dev is the device of a mount of an excluded type.
+int fsexclude_has(const FsExclude *x, dev_t dev);
+
+#endif
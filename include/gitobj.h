@@ -0,0 +1,40 @@
+#ifndef LSX_GITOBJ_H
+#define LSX_GITOBJ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only access to a repository's object database for --git: loose
+// objects and version 2 packs, deltas included. SHA-1 repositories
+// only; alternates are not followed.
+typedef struct GitObjects GitObjects;
+
+typedef enum {
+    GIT_OBJ_NONE   = 0,
+    GIT_OBJ_COMMIT = 1,
+    GIT_OBJ_TREE   = 2,
+    GIT_OBJ_BLOB   = 3,
+    GIT_OBJ_TAG    = 4,
+} GitObjType;
+
+#define GIT_SHA_LEN 20
+
+// objects_dir is the repository's "objects" directory. Packs are mapped
+// here; returns NULL only when out of memory.
+GitObjects *gitobj_open(const char *objects_dir);
+void        gitobj_close(GitObjects *db);
+
+// Inflate object sha into a malloc'd buffer (*data, *len; the caller
+// frees it). Returns GIT_OBJ_NONE if the object is missing or corrupt.
+GitObjType gitobj_read(GitObjects *db, const uint8_t *sha, unsigned char **data, size_t *len);
+
+// Object id git gives a blob with these contents, as `git hash-object`
+// does without filters. The _fd variant reads len bytes from fd and
+// returns -1 if they cannot be read.
+void gitobj_hash_blob(const void *data, size_t len, uint8_t out[GIT_SHA_LEN]);
+int  gitobj_hash_blob_fd(int fd, uint64_t len, uint8_t out[GIT_SHA_LEN]);
+
+// 40 hex digits to a binary id; -1 if s does not start with them.
+int gitobj_parse_hex(const char *s, uint8_t out[GIT_SHA_LEN]);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef LSX_GITSTATUS_H
+#define LSX_GITSTATUS_H
+
+#include "filelist.h"
+
+// Git status of listed entries (--git), without running git. The index
+// is mapped and read in place; an entry whose size, mtime, inode, owner
+// and exec bit still match what the index recorded is clean, and only
+// when they disagree on everything but the size (or the entry is racily
+// clean) is the file hashed and compared by content. Staged changes come
+// from comparing index entries with HEAD's trees, skipping every
+// directory whose cached tree in the index still matches HEAD.
+// Untracked entries are checked against .gitignore, info/exclude and the
+// global ignore file. A submodule shows only its staged state, and what
+// is inside it stays blank.
+//
+// Not supported: sha256 repositories, split indexes, alternates,
+// core.excludesFile (only the default global file is read), and clean
+// filters or autocrlf (such files may show as modified).
+typedef struct GitRepo GitRepo;
+
+// Open the work tree containing path. Returns NULL with errno ENOENT
+// when path is not inside one, ENOTSUP when the repository uses a
+// format listed above, EINVAL for a damaged index, or the error that
+// kept it from being read.
+GitRepo *gitrepo_open(const char *path);
+void     gitrepo_close(GitRepo *g);
+
+// Status of item in the directory rel, given relative to the path the
+// repository was opened with ("" for that path itself); rel is NULL
+// when item is that path. out gets two characters as in
+// `git status --short`: index then work tree ('M', 'A', 'T' or ' '),
+// "UU" for a conflict, "??" untracked, "!!" ignored, "  " clean.
+// With rollup, a directory sums up the tracked files beneath it: 'M'
+// in either column when anything below changed there.
+void gitrepo_status(GitRepo *g, const char *rel, const FileItem *item, int rollup, char out[2]);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef LSX_IDCACHE_H
+#define LSX_IDCACHE_H
+
+#include <sys/types.h>
+
+// uid/gid -> name caches for the long format. Each distinct id is
+// resolved through NSS at most once per run; ids without an entry are
+// cached as misses too. Returned names stay valid until idcache_free.
+const char *idcache_user(uid_t uid);
+const char *idcache_group(gid_t gid);
+
+// Fill both caches from one getpwent/getgrent enumeration up front. Only
+// worth it when NSS serves enumeration cheaply compared to many
+// individual lookups.
+void idcache_preload_all(void);
+
+typedef struct {
+    unsigned long user_lookups;
+    unsigned long group_lookups;
+    unsigned long user_nss;   // getpwuid calls
+    unsigned long group_nss;  // getgrgid calls
+} IdCacheStats;
+
+void idcache_get_stats(IdCacheStats *out);
+void idcache_free(void);
+
+#endif
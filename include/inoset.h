@@ -0,0 +1,18 @@
+#ifndef LSX_INOSET_H
+#define LSX_INOSET_H
+
+#include <sys/types.h>
+
+// Set of (st_dev, st_ino) pairs that loader threads can share, for
+// counting hardlinked files once and entering each directory once. Lock
+// striping keeps threads that insert different inodes from contending.
+typedef struct InoSet InoSet;
+
+InoSet *inoset_new(void);
+void    inoset_free(InoSet *s);
+
+// Returns 1 if the pair was added, 0 if it was already present, -1 if
+// memory ran out.
+int     inoset_insert(InoSet *s, dev_t dev, ino_t ino);
+
+#endif
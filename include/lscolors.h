@@ -0,0 +1,33 @@
+#ifndef LSX_LSCOLORS_H
+#define LSX_LSCOLORS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Name colors from LS_COLORS, compiled once at startup. The built-in
+// palette comes first, then LS_COLORS and then LSX_COLORS are applied on
+// top of it, each in dircolors syntax ("di=01;34:*.tar=01;31:..."); a
+// later rule replaces an earlier one and an empty value clears it.
+//
+// Type keys: no fi di ln pi so bd cd su sg tw ow st ex mh, plus lsx's own
+// hi for hidden files (below the file type keys, above extensions).
+// Suffix rules ("*.tar.gz", "*~") match case-insensitively. Extensions
+// are looked up in a perfect hash keyed by the text after the last dot,
+// so picking a color costs the same with five rules or five hundred.
+// Not supported: lc/rc/ec/rs (sequences are always ESC [ ... m), or/mi
+// and ln=target (links are not followed), ca and do.
+typedef struct LsColors LsColors;
+
+// Either spec may be NULL. Unknown keys and values with anything but
+// digits and ';' are skipped. Returns NULL only when out of memory.
+LsColors *lscolors_new(const char *ls_colors, const char *lsx_colors);
+void      lscolors_free(LsColors *c);
+
+// Escape sequence to print before a name; never NULL.
+const char *lscolors_pick(const LsColors *c, const char *name, size_t len, mode_t mode, nlink_t nlink);
+
+// Whether a directory's color depends on its permission bits (tw, ow or
+// st rules), so directories need a stat even in the short listing.
+int lscolors_dir_mode_matters(const LsColors *c);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef LSX_MATCH_H
+#define LSX_MATCH_H
+
+#include <stddef.h>
+
+// Name filters, compiled once up front and tested on every directory
+// entry before it is stat'ed.
+//
+// Globs support '*', '?', '[...]' (with '!' or '^' to negate and a-z
+// ranges), backslash escapes and '**' as a whole path component
+// matching zero or more components. A glob without '/' is tested against
+// the entry name at any depth; one with '/' is tested against the path
+// relative to the listing root, which lets whole subtrees be skipped.
+// Regexes are POSIX extended and tested against the entry name.
+//
+// An entry passes when it matches no exclude glob and, if any include
+// globs or regexes were given, at least one of them.
+typedef struct Matcher Matcher;
+
+Matcher *matcher_new(void);
+void     matcher_free(Matcher *m);
+
+int matcher_add_glob(Matcher *m, const char *pattern, int exclude);
+
+// Returns 0, or -1 with a message in err if the expression is invalid.
+int matcher_add_regex(Matcher *m, const char *re, char *err, size_t errsz);
+
+// How many directory levels below the root the include globs reach: 0
+// when every include is a plain name pattern, -1 when one contains '**'.
+int matcher_include_depth(const Matcher *m);
+
+// dir is the entry's directory relative to the listing root ("" for the
+// root itself), name its final component.
+int matcher_excluded(const Matcher *m, const char *dir, const char *name);
+int matcher_included(const Matcher *m, const char *dir, const char *name);
+
+// Whether anything below directory dir/name could still be included.
+// False only when every include is a path glob that cannot match under
+// it, so the walk can skip the subtree.
+int matcher_may_contain(const Matcher *m, const char *dir, const char *name);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef LSX_MDCACHE_H
+#define LSX_MDCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Persistent directory metadata cache (--cache FILE).
+//
+// The file holds one record per directory, keyed by the directory's
+// (st_dev, st_ino) and validated by its mtime and ctime: a record is used
+// only while both still match, so a directory whose entries were added,
+// removed or renamed is read again. Records hold every entry (hidden ones
+// too), so one record serves any combination of options, but only what
+// reading the directory tells: name, inode and d_type. A file's size,
+// times, mode and owner change without touching its directory, so they
+// are never cached.
+//
+// The file is mapped read-only at open and lookups point straight into
+// the mapping. Directories read this run are collected in memory and
+// merged with the still-used old records into a new file, which replaces
+// the old one by rename at close. Lookups and commits may come from any
+// thread.
+typedef struct MdCache MdCache;
+
+// One entry of a cached directory; name_off indexes the record's names.
+typedef struct {
+    uint64_t ino;
+    uint32_t name_off;
+    uint32_t name_len;
+    uint32_t type;        // DT_* value, DT_UNKNOWN (0) if not provided
+    uint32_t pad;
+} MdCacheEntry;
+
+typedef struct {
+    const MdCacheEntry *ents;
+    const char *names;    // NUL-terminated names, back to back
+    uint32_t count;
+} MdCacheDir;
+
+// A directory being read on a miss, to be committed once complete.
+typedef struct {
+    struct stat dir;
+    MdCacheEntry *ents;
+    uint32_t count;
+    uint32_t cap;
+    char *names;
+    uint32_t names_len;
+    uint32_t names_cap;
+    int failed;           // incomplete (read or allocation failed): not stored
+} MdCacheRecord;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long stored;
+    unsigned long long entries;  // entries served from hits
+    unsigned long records;       // directories in the file at open
+} MdCacheStats;
+
+// A missing, unreadable or foreign file opens as an empty cache. Returns
+// NULL only when out of memory.
+MdCache *mdcache_open(const char *path);
+
+// Write the merged cache back if anything changed, then free it. Returns
+// -1 if the new file could not be written (the old one is kept).
+int      mdcache_close(MdCache *c);
+
+// Returns 1 and fills out when an up-to-date record exists for the
+// directory described by dir, 0 otherwise. out stays valid until close.
+int      mdcache_lookup(MdCache *c, const struct stat *dir, MdCacheDir *out);
+
+void     mdcache_record_init(MdCacheRecord *r, const struct stat *dir);
+
+// Append one entry; returns -1 (and marks r failed) when out of memory.
+int      mdcache_record_add(MdCacheRecord *r, const char *name, size_t len, uint64_t ino,
+                            unsigned char type);
+
+// Hand a complete record to the cache (unless it failed or the directory
+// changed too recently to be trusted) and release r's memory.
+void     mdcache_commit(MdCache *c, MdCacheRecord *r);
+
+void     mdcache_get_stats(const MdCache *c, MdCacheStats *out);
+
+#endif
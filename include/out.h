@@ -0,0 +1,56 @@
+#ifndef LSX_OUT_H
+#define LSX_OUT_H
+
+#include <stddef.h>
+
+// Buffered writer for everything lsx prints to stdout. Bytes collect in
+// one large buffer and go out with write()/writev() only when it fills
+// or at an explicit out_flush(). Large chunks that do not fit are sent
+// together with the pending buffer in a single writev() instead of being
+// copied.
+
+#define OUT_BUF_SIZE (64 * 1024)
+
+void out_init(int fd);
+void out_flush(void);
+
+// Flush only when the output is a terminal, for places where a human is
+// watching rows appear (streaming mode).
+void out_flush_tty(void);
+
+// Whether the output goes to a terminal (as of out_init).
+int  out_is_tty(void);
+
+void out_write(const char *s, size_t n);
+void out_puts(const char *s);
+void out_putc(char c);
+void out_spaces(int n);
+void out_repeat(const char *s, int count);
+
+// Decimal integers, formatted without going through printf.
+void out_uint(unsigned long long v);
+void out_int(long long v);
+
+// The body of a JSON string (no surrounding quotes) holding n bytes of s.
+// Quotes, backslashes and control characters are escaped. Bytes that are
+// not valid UTF-8 become lone surrogates \udc80-\udcff, as in Python's
+// surrogateescape, so arbitrary file names survive a round trip.
+void out_json_chars(const char *s, size_t n);
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((format(printf, 1, 2)))
+#endif
+void out_printf(const char *fmt, ...);
+
+unsigned long long out_bytes_written(void);
+
+// Hand flushed bytes to fn instead of writing them to the descriptor,
+// e.g. to capture a whole frame before drawing it; NULL switches back.
+// Pending output is flushed to the old target first.
+typedef void (*OutSinkFn)(const char *s, size_t n, void *ctx);
+void out_set_sink(OutSinkFn fn, void *ctx);
+
+// String literal with its length known at compile time.
+#define out_lit(s) out_write((s), sizeof(s) - 1)
+
+#endif
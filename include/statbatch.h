@@ -0,0 +1,40 @@
+#ifndef LSX_STATBATCH_H
+#define LSX_STATBATCH_H
+
+#include <sys/stat.h>
+
+// Metadata for many names of one directory at once. On Linux the statx
+// calls of a batch on a network filesystem go through io_uring, up to
+// the queue depth in flight, so their round trips overlap instead of
+// being paid one after another. On local filesystems a warm stat is
+// cheaper than the ring's hand-off to its worker threads, and where
+// io_uring is missing, refused or too old to know statx, and for small
+// batches, this is a plain fstatat loop. Symlinks are not followed
+// unless statbatch_set_follow says so.
+
+#define STATBATCH_DEFAULT_DEPTH 64
+#define STATBATCH_MAX_DEPTH 4096
+
+// Called once per name, in completion order; st is NULL when the stat
+// failed (e.g. the entry vanished).
+typedef void (*StatBatchFn)(int k, const struct stat *st, void *ctx);
+
+void statbatch_run(int dfd, const char *const *names, int count, StatBatchFn done, void *ctx);
+
+// Queue depth for rings created after the call (clamped to
+// STATBATCH_MAX_DEPTH). An explicit depth also uses the ring on local
+// filesystems; 0 turns io_uring off.
+void statbatch_set_depth(unsigned depth);
+
+// Report what symlinks point to instead of the links themselves; a link
+// whose target is missing is still reported as the link. Call before
+// the first batch.
+void statbatch_set_follow(int follow);
+
+// "io_uring" once a ring has been set up, "fstatat" otherwise.
+const char *statbatch_backend(void);
+
+// Free the calling thread's ring.
+void statbatch_thread_cleanup(void);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef LSX_STATS_H
+#define LSX_STATS_H
+
+#include <stdint.h>
+
+// --stats: where a run spends its time. The calls that can block
+// (directory reads, stat, NSS lookups, output writes) and sorting are
+// timed with the monotonic clock; with loader threads the times are
+// summed over all threads. Until stats_enable() every hook is a single
+// branch and nothing is measured.
+typedef enum {
+    STATS_READDIR,   // open + getdents64 / readdir
+    STATS_STAT,      // fstatat / lstat of entries
+    STATS_IDS,       // getpwuid / getgrgid on id cache misses
+    STATS_SORT,
+    STATS_WRITE,     // write / writev of the listing
+    STATS_GIT,       // --git: reading the index and working out each status
+    STATS_PHASES
+} StatsPhase;
+
+typedef enum {
+    STATS_FILTERED,  // entries read but not listed (hidden, --glob, ...)
+    STATS_COUNTERS
+} StatsCounter;
+
+void     stats_enable(void);
+int      stats_enabled(void);
+
+// Bracket one timed call: start returns 0 while disabled, and stop
+// ignores a 0 start.
+uint64_t stats_start(void);
+void     stats_stop(StatsPhase phase, uint64_t start);
+// Same, for a batch of calls timed together.
+void     stats_stop_n(StatsPhase phase, uint64_t start, unsigned long calls);
+
+void     stats_add(StatsCounter counter, unsigned long n);
+
+typedef struct {
+    uint64_t elapsed_ns;                // since stats_enable
+    uint64_t phase_ns[STATS_PHASES];
+    unsigned long phase_calls[STATS_PHASES];
+    unsigned long counters[STATS_COUNTERS];
+} StatsSnapshot;
+
+void        stats_get(StatsSnapshot *out);
+const char *stats_phase_name(StatsPhase phase);
+
+#endif
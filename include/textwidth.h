@@ -0,0 +1,18 @@
+#ifndef LSX_TEXTWIDTH_H
+#define LSX_TEXTWIDTH_H
+
+#include <stddef.h>
+
+// Number of terminal columns the first len bytes of s occupy (stopping
+// early at a NUL). ANSI CSI escapes ("\x1b[...m") are zero-width, and
+// multibyte characters are measured with mbrtowc + wcwidth in the
+// current LC_CTYPE. Runs of plain ASCII are found in bulk and counted
+// at one column per byte without going through the wide-char path.
+int text_width(const char *s, size_t len);
+
+// Bytes of the longest prefix of s (of len bytes) that fits in cols
+// columns, never splitting a character or an escape; its width goes to
+// *width.
+size_t text_fit(const char *s, size_t len, int cols, int *width);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef LSX_TIMEFMT_H
+#define LSX_TIMEFMT_H
+
+#include <stddef.h>
+#include <time.h>
+
+// Formats timestamps as strftime("%b %d %H:%M", localtime(t)) would,
+// without calling localtime for every row: the UTC offset is cached per
+// UTC day, the date is derived arithmetically and month names are
+// rendered once for the current LC_TIME. Days containing a UTC offset
+// change fall back to localtime_r/strftime.
+
+// Sample "now" and build the month-name table. Call after setlocale.
+void   timefmt_init(void);
+time_t timefmt_now(void);
+
+// Sample "now" again, for output that is redrawn over time (--watch).
+void   timefmt_refresh(void);
+
+void   timefmt_format(time_t t, char *out, size_t outsz);
+
+#endif
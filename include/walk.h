@@ -0,0 +1,78 @@
+#ifndef LSX_WALK_H
+#define LSX_WALK_H
+
+#include "filelist.h"
+
+// Parallel prefetching tree walker. Worker threads load (and sort)
+// directories ahead of the consumer using per-thread work-stealing
+// deques; the consumer visits nodes in whatever order it likes and
+// blocks in walker_wait until a node is ready. If the node has not been
+// picked up by a worker yet, the consumer loads it itself, so progress
+// never depends on the workers.
+
+// Load and sort one directory into list. Return 0 on success.
+typedef int (*WalkLoadFn)(FileList *list, const char *path, void *ctx);
+
+// Whether entry i of a list at the given level gets a child node.
+typedef int (*WalkDescendFn)(const FileList *list, int i, int level, void *ctx);
+
+typedef struct Walker Walker;
+typedef struct WalkNode WalkNode;
+
+// Recursive totals of a directory subtree.
+typedef struct {
+    unsigned long long bytes;
+    unsigned long long files;
+} WalkTotals;
+
+// Add up the entries of one loaded directory (not its subdirectories).
+// Called on whichever thread loaded it.
+typedef void (*WalkSumFn)(const FileList *list, WalkTotals *own, void *ctx);
+
+// With nthreads 0 no worker is started and nothing is queued: the
+// consumer loads every node itself when it waits for it, depth first in
+// listing order, the same on every run, and a node is freed as soon as
+// the consumer releases it.
+Walker   *walker_create(int nthreads, WalkLoadFn load, WalkDescendFn descend, void *ctx);
+void      walker_destroy(Walker *w);
+
+// Aggregate subtree totals bottom-up as directories finish loading.
+// Call before the first submit. Nodes deeper than keep_level are
+// loaded only to be counted: their lists are dropped at once and their
+// children never reach the consumer. The first such level is still
+// handed out by walk_node_child (walk_node_shown says 0) so the consumer
+// can read its totals; it must walker_release those nodes too. Entries
+// the load function flags FI_FILTERED are summed, and their subtrees
+// counted the same way, but they leave the list before the consumer
+// sees it.
+void      walker_set_totals(Walker *w, WalkSumFn sum, int keep_level);
+
+// Queue a root directory. Roots are picked up in submission order.
+WalkNode *walker_submit(Walker *w, const char *path, int level);
+
+// Block until the node is loaded. Returns 0 on success, -1 if the
+// directory could not be loaded (the node has no entries then).
+int       walker_wait(Walker *w, WalkNode *node);
+
+// Block until every directory below node has been counted. The caller
+// helps with queued work meanwhile.
+void      walker_wait_totals(Walker *w, WalkNode *node, WalkTotals *out);
+
+int             walk_node_shown(const WalkNode *node);
+const FileList *walk_node_list(const WalkNode *node);
+WalkNode       *walk_node_child(const WalkNode *node, int i);
+
+// Drop the consumer's reference once the node's rows are emitted. The
+// node's children are not released.
+void      walker_release(Walker *w, WalkNode *node);
+
+// Non-blocking form of walker_wait, for consumers that must not stall
+// (the interactive browser): whether a worker has finished the node.
+int       walk_node_ready(const WalkNode *node);
+
+// Move a ready node's list into out (which must be empty or freed) and
+// release the node, so a large listing changes hands without a copy.
+// Returns 0, or -1 if the directory could not be loaded.
+int       walker_take(Walker *w, WalkNode *node, FileList *out);
+
+#endif
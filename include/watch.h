@@ -0,0 +1,40 @@
+#ifndef LSX_WATCH_H
+#define LSX_WATCH_H
+
+#include "filelist.h"
+
+// Live directory listings for --watch. Each directory is read from disk
+// once, kept in memory and watched with inotify; change events update
+// the kept list entry by entry instead of reading the directory again.
+// Only available on Linux; elsewhere watch_new fails with ENOSYS.
+
+// Decide whether name in dir belongs in the listing and fill its
+// metadata. Returns 1 to list it, 0 when it is gone or filtered out.
+typedef int (*WatchFillFn)(const char *dir, const char *name, FileItem *item, void *ctx);
+
+typedef struct Watch Watch;
+
+Watch *watch_new(WatchFillFn fill, void *ctx);
+void   watch_free(Watch *w);
+
+// The kept listing of path, or NULL if path is not being watched.
+const FileList *watch_find(const Watch *w, const char *path);
+
+// Subscribe to changes in path before reading it, so nothing that
+// happens while it is read is missed. Returns a descriptor for
+// watch_keep, or -1.
+int    watch_start(Watch *w, const char *path);
+
+// Keep list (path as just read from disk) and follow it from now on.
+// Returns 0, or -1 when out of memory.
+int    watch_keep(Watch *w, int wd, const char *path, const FileList *list);
+
+// Descriptor that becomes readable when events are pending.
+int    watch_fd(const Watch *w);
+
+// Apply every pending event. Returns the number of entries that changed
+// (0 when events only touched things that are not listed), or -1 when
+// the watched root itself went away.
+int    watch_process(Watch *w, const char *root);
+
+#endif
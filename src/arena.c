@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <stdalign.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t cap;
+    size_t off;
+    alignas(max_align_t) unsigned char data[];
+};
+
+#define ARENA_ALIGN (alignof(max_align_t))
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+void arena_init(Arena *a, size_t chunk_size) {
+    a->first = NULL;
+    a->cur = NULL;
+    a->chunk_size = chunk_size ? chunk_size : (size_t)1 << 20;
+    a->used = 0;
+    a->high_water = 0;
+    a->reserved = 0;
+}
+
+void arena_destroy(Arena *a) {
+    ArenaChunk *c = a->first;
+    while (c) {
+        ArenaChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    arena_init(a, a->chunk_size);
+}
+
+static ArenaChunk *new_chunk(Arena *a, size_t min_cap) {
+    size_t cap = a->chunk_size > min_cap ? a->chunk_size : min_cap;
+    ArenaChunk *c = malloc(sizeof(*c) + cap);
+    if (!c) return NULL;
+    c->next = NULL;
+    c->cap = cap;
+    c->off = 0;
+    a->reserved += cap;
+    return c;
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+    size = align_up(size ? size : 1);
+
+    ArenaChunk *c = a->cur;
+    if (c && c->cap - c->off >= size) {
+        void *p = c->data + c->off;
+        c->off += size;
+        a->used += size;
+        if (a->used > a->high_water) a->high_water = a->used;
+        return p;
+    }
+
+    // Move to the next retained chunk, or splice in a fresh one when the
+    // next chunk is missing or too small for this request.
+    ArenaChunk *next = c ? c->next : a->first;
+    if (!next || next->cap < size) {
+        ArenaChunk *fresh = new_chunk(a, size);
+        if (!fresh) return NULL;
+        fresh->next = next;
+        if (c) c->next = fresh;
+        else a->first = fresh;
+        next = fresh;
+    }
+
+    // The tail of the chunk we leave is accounted as used until release.
+    if (c) {
+        a->used += c->cap - c->off;
+        c->off = c->cap;
+    }
+
+    next->off = size;
+    a->cur = next;
+    a->used += size;
+    if (a->used > a->high_water) a->high_water = a->used;
+    return next->data;
+}
+
+ArenaMark arena_mark(const Arena *a) {
+    ArenaMark m;
+    m.chunk = a->cur;
+    m.off = a->cur ? a->cur->off : 0;
+    m.used = a->used;
+    return m;
+}
+
+void arena_release(Arena *a, ArenaMark m) {
+    a->cur = m.chunk;
+    if (m.chunk) m.chunk->off = m.off;
+    a->used = m.used;
+}
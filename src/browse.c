@@ -0,0 +1,479 @@
+#include <stdlib.h>
+#include <string.h>
+#include <curses.h>
+
+#include "browse.h"
+#include "out.h"
+
+// Poll interval for finished loads while any are in flight; with nothing
+// loading the browser sleeps in getch() until a key arrives.
+#define LOAD_POLL_MS 50
+
+enum { DIR_LOADING, DIR_READY, DIR_FAILED };
+
+// One expanded directory. Its rows are its entries, each followed by the
+// rows of the subdirectory expanded under it, or a single note row while
+// it is loading, empty or unreadable.
+typedef struct BrowseDir {
+    struct BrowseDir *parent;
+    int index;                 // entry in the parent's list
+    int level;                 // nesting level of this directory's entries
+    int state;
+    WalkNode *load;            // while loading
+    FileList list;
+    struct BrowseDir **kids;   // expanded subdirectories, ordered by index
+    int nkids;
+    int kids_cap;
+    long rows;                 // rows of the whole expanded subtree
+} BrowseDir;
+
+typedef struct {
+    BrowseDir *dir;
+    int i;                     // entry, or -1 for the note row
+} RowRef;
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} Capture;
+
+typedef struct {
+    const BrowseConfig *cfg;
+    const char *title;
+    BrowseDir *root;
+    long sel;
+    long top;
+    int page;                  // body rows at the last draw
+
+    BrowseDir **loading;       // directories waiting on the walker
+    int nloading;
+    int loading_cap;
+    WalkNode **orphans;        // collapsed before their load finished
+    int norphans;
+    int orphans_cap;
+
+    Capture cap;
+} Browser;
+
+// Make room for one more element in a growable array, if memory allows;
+// callers check n < cap afterwards.
+#define RESERVE(arr, n, cap) do {                                        \
+        if ((n) == (cap)) {                                              \
+            int ncap_ = (cap) ? (cap) * 2 : 16;                          \
+            void *p_ = realloc((arr), (size_t)ncap_ * sizeof(*(arr)));   \
+            if (p_) { (arr) = p_; (cap) = ncap_; }                       \
+        }                                                                \
+    } while (0)
+
+// Park a load nobody wants any more; it is released once it lands.
+static void orphan(Browser *b, WalkNode *load) {
+    RESERVE(b->orphans, b->norphans, b->orphans_cap);
+    if (b->norphans < b->orphans_cap) b->orphans[b->norphans++] = load;
+}
+
+static void adjust_rows(BrowseDir *d, long delta) {
+    for (; d; d = d->parent) d->rows += delta;
+}
+
+static long own_rows(const BrowseDir *d) {
+    return (d->state == DIR_READY && d->list.count > 0) ? d->list.count : 1;
+}
+
+static BrowseDir *dir_new(Browser *b, BrowseDir *parent, int index, int level, const char *path) {
+    BrowseDir *d = calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    d->parent = parent;
+    d->index = index;
+    d->level = level;
+    d->rows = 1;
+    filelist_init(&d->list);
+
+    d->load = walker_submit(b->cfg->walker, path, level);
+    RESERVE(b->loading, b->nloading, b->loading_cap);
+    if (d->load && b->nloading < b->loading_cap) {
+        b->loading[b->nloading++] = d;
+        d->state = DIR_LOADING;
+    } else {
+        if (d->load) orphan(b, d->load);
+        d->load = NULL;
+        d->state = DIR_FAILED;
+    }
+    return d;
+}
+
+static void dir_free(Browser *b, BrowseDir *d) {
+    for (int k = 0; k < d->nkids; k++) dir_free(b, d->kids[k]);
+    free(d->kids);
+    if (d->state == DIR_LOADING) {
+        for (int k = 0; k < b->nloading; k++) {
+            if (b->loading[k] == d) {
+                b->loading[k] = b->loading[--b->nloading];
+                break;
+            }
+        }
+        orphan(b, d->load);
+    }
+    filelist_free(&d->list);
+    free(d);
+}
+
+// Position of the expanded child for entry i in d->kids, or where it
+// would be inserted (negated, minus one) when i is not expanded.
+static int find_kid(const BrowseDir *d, int i) {
+    int lo = 0, hi = d->nkids - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (d->kids[mid]->index == i) return mid;
+        if (d->kids[mid]->index < i) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -lo - 1;
+}
+
+// Which row is number k of d's subtree. Costs one step per expanded
+// directory passed, independent of how many entries they hold.
+static RowRef locate(BrowseDir *d, long k) {
+    for (;;) {
+        if (d->state != DIR_READY || d->list.count == 0) return (RowRef){ d, -1 };
+
+        int cursor = 0;
+        BrowseDir *next = NULL;
+        for (int j = 0; j < d->nkids && !next; j++) {
+            BrowseDir *c = d->kids[j];
+            long span = c->index - cursor + 1;
+            if (k < span) return (RowRef){ d, cursor + (int)k };
+            k -= span;
+            cursor = c->index + 1;
+            if (k < c->rows) next = c;
+            else k -= c->rows;
+        }
+        if (!next) return (RowRef){ d, cursor + (int)k };
+        d = next;
+    }
+}
+
+// Row number of entry i of d, counted from the top of the tree.
+static long row_of(const BrowseDir *d, int i) {
+    long pos = 0;
+    for (;;) {
+        pos += i;
+        for (int j = 0; j < d->nkids && d->kids[j]->index < i; j++) pos += d->kids[j]->rows;
+        if (!d->parent) return pos;
+        pos += 1;   // the directory's own line in its parent
+        i = d->index;
+        d = d->parent;
+    }
+}
+
+static void expand(Browser *b, BrowseDir *d, int i) {
+    int at = find_kid(d, i);
+    if (at >= 0) return;
+    at = -at - 1;
+
+    char path[MAX_PATH];
+    if (filelist_path(&d->list, i, path, sizeof(path)) < 0) return;
+    BrowseDir *c = dir_new(b, d, i, d->level + 1, path);
+    if (!c) return;
+    RESERVE(d->kids, d->nkids, d->kids_cap);
+    if (d->nkids == d->kids_cap) {
+        dir_free(b, c);
+        return;
+    }
+    d->nkids++;
+    memmove(d->kids + at + 1, d->kids + at, (size_t)(d->nkids - 1 - at) * sizeof(*d->kids));
+    d->kids[at] = c;
+    adjust_rows(d, c->rows);
+}
+
+static void collapse(Browser *b, BrowseDir *d, int at) {
+    BrowseDir *c = d->kids[at];
+    long rows = c->rows;
+    memmove(d->kids + at, d->kids + at + 1, (size_t)(d->nkids - 1 - at) * sizeof(*d->kids));
+    d->nkids--;
+    dir_free(b, c);
+    adjust_rows(d, -rows);
+}
+
+// Pick up loads the workers have finished. Returns 1 if any landed.
+static int poll_loads(Browser *b) {
+    int changed = 0;
+    for (int k = 0; k < b->nloading;) {
+        BrowseDir *d = b->loading[k];
+        if (!walk_node_ready(d->load)) {
+            k++;
+            continue;
+        }
+        d->state = walker_take(b->cfg->walker, d->load, &d->list) == 0 ? DIR_READY : DIR_FAILED;
+        d->load = NULL;
+        adjust_rows(d, own_rows(d) - 1);
+        b->loading[k] = b->loading[--b->nloading];
+        changed = 1;
+    }
+    for (int k = 0; k < b->norphans;) {
+        if (walk_node_ready(b->orphans[k])) {
+            walker_release(b->cfg->walker, b->orphans[k]);
+            b->orphans[k] = b->orphans[--b->norphans];
+        } else {
+            k++;
+        }
+    }
+    return changed;
+}
+
+static void capture_sink(const char *s, size_t n, void *ctx) {
+    Capture *c = ctx;
+    if (c->len + n > c->cap) {
+        size_t ncap = c->cap ? c->cap : 16 * 1024;
+        while (ncap < c->len + n) ncap *= 2;
+        char *p = realloc(c->buf, ncap);
+        if (!p) return;
+        c->buf = p;
+        c->cap = ncap;
+    }
+    memcpy(c->buf + c->len, s, n);
+    c->len += n;
+}
+
+// Color pairs: 1 + (fg + 1) + 9 * bg_cyan, fg -1 meaning the default.
+static short color_pair(int fg, int bg_cyan) {
+    if (!has_colors() || (fg < 0 && !bg_cyan)) return 0;
+    return (short)(1 + (fg + 1) + 9 * bg_cyan);
+}
+
+static void init_colors(void) {
+    if (!has_colors()) return;
+    start_color();
+    use_default_colors();
+    for (int bg = 0; bg < 2; bg++) {
+        for (int fg = -1; fg < 8; fg++) {
+            short pair = color_pair(fg, bg);
+            if (pair) init_pair(pair, (short)fg, bg ? COLOR_CYAN : -1);
+        }
+    }
+}
+
+// Draw captured text (one line, with the listing's ANSI colors) at row y.
+static void draw_ansi_line(int y, const char *s, size_t n, attr_t extra) {
+    attr_t attr = A_NORMAL;
+    int fg = -1, bg_cyan = 0;
+
+    move(y, 0);
+    size_t i = 0;
+    while (i < n) {
+        if (s[i] == '\033' && i + 1 < n && s[i + 1] == '[') {
+            i += 2;
+            // ext: after 38/48 (LS_COLORS may use 256 and RGB colors);
+            // skip: numbers left of such a color.
+            int v = 0, ext = 0, ext_fg = 0, indexed = 0, skip = 0;
+            for (; i < n; i++) {
+                char ch = s[i];
+                if (ch >= '0' && ch <= '9') {
+                    v = v * 10 + (ch - '0');
+                    continue;
+                }
+                if (ext) {
+                    ext = 0;
+                    indexed = (v == 5);
+                    skip = v == 5 ? 1 : v == 2 ? 3 : 0;
+                } else if (skip) {
+                    // The 16 basic colors fold onto the 8 we have pairs for.
+                    if (indexed && ext_fg && v < 16) fg = v % 8;
+                    skip--;
+                } else {
+                    switch (v) {
+                        case 0:  attr = A_NORMAL; fg = -1; bg_cyan = 0; break;
+                        case 1:  attr |= A_BOLD; break;
+                        case 2:  attr |= A_DIM; break;
+                        case 22: attr &= ~(attr_t)(A_BOLD | A_DIM); break;
+                        case 38:
+                        case 48: ext = 1; ext_fg = (v == 38); break;
+                        case 39: fg = -1; break;
+                        case 46: bg_cyan = 1; break;
+                        case 97: fg = COLOR_WHITE; attr |= A_BOLD; break;
+                        default:
+                            if (v >= 30 && v <= 37) fg = v - 30;
+                            else if (v >= 90 && v <= 96) fg = v - 90;
+                            break;
+                    }
+                }
+                v = 0;
+                if (ch != ';') break;
+            }
+            i++;
+            continue;
+        }
+
+        size_t j = i;
+        while (j < n && s[j] != '\033') j++;
+        attrset(attr | extra | COLOR_PAIR(color_pair(fg, bg_cyan)));
+        addnstr(s + i, (int)(j - i));
+        i = j;
+    }
+    attrset(extra);
+    clrtoeol();
+    attrset(A_NORMAL);
+}
+
+// Draw the captured lines starting at screen row y; returns the next row.
+static int draw_capture(Browser *b, int y, attr_t extra) {
+    size_t start = 0;
+    while (start < b->cap.len) {
+        const char *nl = memchr(b->cap.buf + start, '\n', b->cap.len - start);
+        size_t end = nl ? (size_t)(nl - b->cap.buf) : b->cap.len;
+        draw_ansi_line(y++, b->cap.buf + start, end - start, extra);
+        start = end + 1;
+    }
+    b->cap.len = 0;
+    return y;
+}
+
+static void draw(Browser *b) {
+    const BrowseConfig *cfg = b->cfg;
+    int width = COLS;
+
+    cfg->header(b->title, width, cfg->ctx);
+    out_flush();
+    int head = 0;
+    for (size_t k = 0; k < b->cap.len; k++) head += (b->cap.buf[k] == '\n');
+    int body = LINES - head - 2;   // box bottom and status line
+    if (body < 1) body = 1;
+    b->page = body;
+
+    long total = b->root->rows;
+    if (b->sel >= total) b->sel = total - 1;
+    if (b->sel < 0) b->sel = 0;
+    if (b->sel < b->top) b->top = b->sel;
+    if (b->sel >= b->top + body) b->top = b->sel - body + 1;
+    if (b->top > total - body) b->top = total - body;
+    if (b->top < 0) b->top = 0;
+
+    erase();
+    int y = draw_capture(b, 0, A_NORMAL);
+
+    for (int k = 0; k < body; k++, y++) {
+        long r = b->top + k;
+        if (r >= total) break;
+        RowRef ref = locate(b->root, r);
+        if (ref.i >= 0) {
+            cfg->row(&ref.dir->list, ref.i, ref.dir->level, ref.i == ref.dir->list.count - 1, width, cfg->ctx);
+        } else {
+            const char *text = ref.dir->state == DIR_LOADING ? "loading..."
+                             : ref.dir->state == DIR_FAILED ? "(cannot read)"
+                             : "(empty)";
+            cfg->note(text, ref.dir->level, width, cfg->ctx);
+        }
+        out_flush();
+        draw_capture(b, y, r == b->sel ? A_REVERSE : A_NORMAL);
+    }
+
+    cfg->footer(width, cfg->ctx);
+    out_flush();
+    y = draw_capture(b, y, A_NORMAL);
+
+    move(y, 0);
+    attrset(A_DIM);
+    printw("  %ld/%ld", b->sel + 1, total);
+    if (b->nloading) printw("  loading %d", b->nloading);
+    printw("   j/k move  l/enter open  h close  g/G ends  q quit");
+    attrset(A_NORMAL);
+    clrtoeol();
+    refresh();
+}
+
+static int is_dot_name(const char *name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+static int openable(const RowRef *ref) {
+    return ref->i >= 0 && (ref->dir->list.flags[ref->i] & FI_DIR) &&
+           !is_dot_name(filelist_name(&ref->dir->list, ref->i));
+}
+
+// Returns 0 to keep going, 1 to quit.
+static int handle_key(Browser *b, int ch) {
+    int page = b->page;
+    RowRef ref = locate(b->root, b->sel);
+
+    switch (ch) {
+        case 'q': case 'Q': case 27:
+            return 1;
+        case KEY_DOWN: case 'j': b->sel++; break;
+        case KEY_UP:   case 'k': b->sel--; break;
+        case KEY_NPAGE: case ' ': b->sel += page; break;
+        case KEY_PPAGE: case 'b': b->sel -= page; break;
+        case KEY_HOME: case 'g': b->sel = 0; break;
+        case KEY_END:  case 'G': b->sel = b->root->rows - 1; break;
+
+        case KEY_RIGHT: case 'l': case '\n': case '\r': case KEY_ENTER:
+            if (!openable(&ref)) break;
+            if (find_kid(ref.dir, ref.i) < 0) expand(b, ref.dir, ref.i);
+            else if (ch == KEY_RIGHT || ch == 'l') b->sel++;
+            else collapse(b, ref.dir, find_kid(ref.dir, ref.i));
+            break;
+
+        case KEY_LEFT: case 'h': {
+            int at = ref.i >= 0 ? find_kid(ref.dir, ref.i) : -1;
+            if (at >= 0) {
+                collapse(b, ref.dir, at);
+            } else if (ref.dir->parent) {
+                // Jump to the directory's own line and fold it.
+                BrowseDir *d = ref.dir;
+                BrowseDir *p = d->parent;
+                b->sel = row_of(p, d->index);
+                collapse(b, p, find_kid(p, d->index));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return 0;
+}
+
+int browse_run(const char *root, const BrowseConfig *cfg) {
+    Browser b;
+    memset(&b, 0, sizeof(b));
+    b.cfg = cfg;
+    b.title = root;
+
+    if (!initscr()) return -1;
+    cbreak();
+    noecho();
+    keypad(stdscr, TRUE);
+    curs_set(0);
+#ifdef NCURSES_VERSION
+    set_escdelay(25);
+#endif
+    init_colors();
+
+    out_set_sink(capture_sink, &b.cap);
+    b.root = dir_new(&b, NULL, 0, 0, root);
+
+    int dirty = 1;
+    while (b.root) {
+        if (poll_loads(&b)) dirty = 1;
+        if (dirty) draw(&b);
+        dirty = 0;
+
+        timeout(b.nloading ? LOAD_POLL_MS : -1);
+        int ch = getch();
+        if (ch == ERR) continue;
+        dirty = 1;
+        if (ch != KEY_RESIZE && handle_key(&b, ch)) break;
+    }
+
+    endwin();
+    out_set_sink(NULL, NULL);
+
+    if (b.root) dir_free(&b, b.root);
+    // Wait out loads still in flight so their nodes are not leaked.
+    while (b.norphans) {
+        poll_loads(&b);
+        if (b.norphans) napms(5);
+    }
+    free(b.loading);
+    free(b.orphans);
+    free(b.cap.buf);
+    return 0;
+}
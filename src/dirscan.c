@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdatomic.h>
+
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/syscall.h>
+#endif
+
+#include "dirscan.h"
+#include "stats.h"
+
+#define DIRSCAN_MIN_BUF (32 * 1024)
+#define DIRSCAN_MAX_BUF (64 * 1024 * 1024)
+
+static size_t g_bufsize = DIRSCAN_DEFAULT_BUF;
+
+// Scanners may run on several threads; each one counts locally and
+// folds its numbers in here when it is closed.
+static atomic_ulong g_opens;
+static atomic_ulong g_reads;
+static atomic_ulong g_entries;
+static atomic_ullong g_bytes;
+
+void dirscan_set_bufsize(size_t bytes) {
+    if (bytes < DIRSCAN_MIN_BUF) bytes = DIRSCAN_MIN_BUF;
+    if (bytes > DIRSCAN_MAX_BUF) bytes = DIRSCAN_MAX_BUF;
+    g_bufsize = bytes;
+}
+
+size_t dirscan_bufsize(void) {
+    return g_bufsize;
+}
+
+void dirscan_get_stats(DirScanStats *out) {
+    out->opens = atomic_load(&g_opens);
+    out->reads = atomic_load(&g_reads);
+    out->entries = atomic_load(&g_entries);
+    out->bytes = atomic_load(&g_bytes);
+}
+
+static void flush_stats(const DirScanStats *st) {
+    atomic_fetch_add(&g_opens, 1);
+    atomic_fetch_add(&g_reads, st->reads);
+    atomic_fetch_add(&g_entries, st->entries);
+    atomic_fetch_add(&g_bytes, st->bytes);
+}
+
+#ifdef __linux__
+
+// Layout the kernel writes for getdents64.
+struct linux_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+struct DirScan {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t len;
+    size_t pos;
+    int eof;
+    DirScanStats st;
+};
+
+// Directories are usually scanned one after another, so keep the last
+// buffer around instead of mapping and unmapping it for every directory.
+static _Thread_local char *g_spare_buf;
+static _Thread_local size_t g_spare_cap;
+
+const char *dirscan_backend(void) {
+    return "getdents64";
+}
+
+DirScan *dirscan_open(const char *path) {
+    return dirscan_open_sized(path, g_bufsize);
+}
+
+DirScan *dirscan_open_sized(const char *path, size_t bufsize) {
+    if (bufsize < DIRSCAN_MIN_BUF) bufsize = DIRSCAN_MIN_BUF;
+
+    uint64_t t0 = stats_start();
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    stats_stop(STATS_READDIR, t0);
+    if (fd < 0) return NULL;
+
+    DirScan *ds = malloc(sizeof(*ds));
+    if (!ds) { close(fd); errno = ENOMEM; return NULL; }
+
+    if (g_spare_buf && g_spare_cap == bufsize) {
+        ds->buf = g_spare_buf;
+        g_spare_buf = NULL;
+    } else {
+        ds->buf = malloc(bufsize);
+    }
+    if (!ds->buf) { close(fd); free(ds); errno = ENOMEM; return NULL; }
+
+    ds->fd = fd;
+    ds->cap = bufsize;
+    ds->len = 0;
+    ds->pos = 0;
+    ds->eof = 0;
+    memset(&ds->st, 0, sizeof(ds->st));
+    return ds;
+}
+
+int dirscan_next(DirScan *ds, DirEntry *out) {
+    if (ds->pos >= ds->len) {
+        if (ds->eof) return 0;
+
+        uint64_t t0 = stats_start();
+        long n = syscall(SYS_getdents64, ds->fd, ds->buf, ds->cap);
+        stats_stop(STATS_READDIR, t0);
+        ds->st.reads++;
+        if (n < 0) return -1;
+        if (n == 0) { ds->eof = 1; return 0; }
+
+        ds->st.bytes += (unsigned long long)n;
+        ds->len = (size_t)n;
+        ds->pos = 0;
+    }
+
+    const struct linux_dirent64 *d = (const struct linux_dirent64 *)(ds->buf + ds->pos);
+    ds->pos += d->d_reclen;
+
+    out->name = d->d_name;
+    out->ino = (ino_t)d->d_ino;
+    out->type = d->d_type;
+    ds->st.entries++;
+    return 1;
+}
+
+int dirscan_fd(const DirScan *ds) {
+    return ds->fd;
+}
+
+void dirscan_thread_cleanup(void) {
+    free(g_spare_buf);
+    g_spare_buf = NULL;
+    g_spare_cap = 0;
+}
+
+void dirscan_close(DirScan *ds) {
+    if (!ds) return;
+    flush_stats(&ds->st);
+    close(ds->fd);
+    if (!g_spare_buf) {
+        g_spare_buf = ds->buf;
+        g_spare_cap = ds->cap;
+    } else {
+        free(ds->buf);
+    }
+    free(ds);
+}
+
+#else
+
+struct DirScan {
+    DIR *dir;
+    DirScanStats st;
+};
+
+const char *dirscan_backend(void) {
+    return "readdir";
+}
+
+DirScan *dirscan_open(const char *path) {
+    return dirscan_open_sized(path, g_bufsize);
+}
+
+DirScan *dirscan_open_sized(const char *path, size_t bufsize) {
+    (void)bufsize;
+    uint64_t t0 = stats_start();
+    DIR *dir = opendir(path);
+    stats_stop(STATS_READDIR, t0);
+    if (!dir) return NULL;
+
+    DirScan *ds = malloc(sizeof(*ds));
+    if (!ds) { closedir(dir); errno = ENOMEM; return NULL; }
+    ds->dir = dir;
+    memset(&ds->st, 0, sizeof(ds->st));
+    return ds;
+}
+
+int dirscan_next(DirScan *ds, DirEntry *out) {
+    errno = 0;
+    uint64_t t0 = stats_start();
+    struct dirent *e = readdir(ds->dir);
+    stats_stop(STATS_READDIR, t0);
+    ds->st.reads++;
+    if (!e) return errno ? -1 : 0;
+
+    out->name = e->d_name;
+    out->ino = e->d_ino;
+#ifdef DT_UNKNOWN
+    out->type = e->d_type;
+#else
+    out->type = 0;
+#endif
+    ds->st.entries++;
+    return 1;
+}
+
+int dirscan_fd(const DirScan *ds) {
+    return dirfd(ds->dir);
+}
+
+void dirscan_thread_cleanup(void) {
+}
+
+void dirscan_close(DirScan *ds) {
+    if (!ds) return;
+    flush_stats(&ds->st);
+    closedir(ds->dir);
+    free(ds);
+}
+
+#endif
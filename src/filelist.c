@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "filelist.h"
+#include "textwidth.h"
+
+static char *dup_str(const char *s) {
+    size_t n = strlen(s) + 1;
+    char *p = malloc(n);
+    if (p) memcpy(p, s, n);
+    return p;
+}
+
+void filelist_init(FileList *list) {
+    memset(list, 0, sizeof(*list));
+}
+
+void filelist_free(FileList *list) {
+    free(list->names);
+    free(list->name_off);
+    free(list->name_len);
+    free(list->name_width);
+    free(list->mode);
+    free(list->size);
+    free(list->mtime);
+    free(list->uid);
+    free(list->gid);
+    free(list->inode);
+    free(list->dev);
+    free(list->nlink);
+    free(list->flags);
+    free(list->cwd);
+    free(list->dir);
+    memset(list, 0, sizeof(*list));
+}
+
+int filelist_reset(FileList *list, const char *cwd, const char *dir) {
+    list->count = 0;
+    list->names_len = 0;
+
+    free(list->cwd);
+    free(list->dir);
+    list->cwd = dup_str(cwd);
+    list->dir = dup_str(dir);
+    return (list->cwd && list->dir) ? 0 : -1;
+}
+
+#define GROW_COLUMN(col, n) do {                              \
+        void *p_ = realloc((col), (size_t)(n) * sizeof(*(col))); \
+        if (!p_) return -1;                                   \
+        (col) = p_;                                           \
+    } while (0)
+
+static int grow_columns(FileList *list) {
+    int ncap = list->cap ? list->cap * 2 : 64;
+
+    GROW_COLUMN(list->name_off, ncap);
+    GROW_COLUMN(list->name_len, ncap);
+    GROW_COLUMN(list->name_width, ncap);
+    GROW_COLUMN(list->mode, ncap);
+    GROW_COLUMN(list->size, ncap);
+    GROW_COLUMN(list->mtime, ncap);
+    GROW_COLUMN(list->uid, ncap);
+    GROW_COLUMN(list->gid, ncap);
+    GROW_COLUMN(list->inode, ncap);
+    GROW_COLUMN(list->dev, ncap);
+    GROW_COLUMN(list->nlink, ncap);
+    GROW_COLUMN(list->flags, ncap);
+
+    list->cap = ncap;
+    return 0;
+}
+
+static int grow_names(FileList *list, size_t need) {
+    size_t ncap = list->names_cap ? list->names_cap : 4096;
+    while (ncap < list->names_len + need) ncap *= 2;
+    if (ncap > UINT32_MAX) return -1;
+
+    char *p = realloc(list->names, ncap);
+    if (!p) return -1;
+    list->names = p;
+    list->names_cap = ncap;
+    return 0;
+}
+
+int filelist_add(FileList *list, const char *name, size_t len) {
+    if (len > UINT16_MAX) return -1;
+    if (list->count == list->cap && grow_columns(list) != 0) return -1;
+    if (list->names_len + len + 1 > list->names_cap && grow_names(list, len + 1) != 0) return -1;
+
+    int i = list->count;
+    list->name_off[i] = (uint32_t)list->names_len;
+    list->name_len[i] = (uint16_t)len;
+    list->name_width[i] = (uint16_t)text_width(name, len);
+    memcpy(list->names + list->names_len, name, len);
+    list->names[list->names_len + len] = '\0';
+    list->names_len += len + 1;
+
+    list->mode[i]  = 0;
+    list->size[i]  = 0;
+    list->mtime[i] = 0;
+    list->uid[i]   = 0;
+    list->gid[i]   = 0;
+    list->inode[i] = 0;
+    list->dev[i]   = 0;
+    list->nlink[i] = 0;
+    list->flags[i] = 0;
+
+    list->count++;
+    return i;
+}
+
+void filelist_get(const FileList *list, int i, FileItem *out) {
+    out->name      = filelist_name(list, i);
+    out->name_len  = list->name_len[i];
+    out->name_width = list->name_width[i];
+    out->mode      = list->mode[i];
+    out->size      = list->size[i];
+    out->mtime     = list->mtime[i];
+    out->uid       = list->uid[i];
+    out->gid       = list->gid[i];
+    out->inode     = list->inode[i];
+    out->dev       = list->dev[i];
+    out->nlink     = list->nlink[i];
+    out->is_dir    = (list->flags[i] & FI_DIR) != 0;
+    out->is_hidden = (list->flags[i] & FI_HIDDEN) != 0;
+}
+
+void filelist_set(FileList *list, int i, const FileItem *item) {
+    list->mode[i]  = item->mode;
+    list->size[i]  = item->size;
+    list->mtime[i] = item->mtime;
+    list->uid[i]   = item->uid;
+    list->gid[i]   = item->gid;
+    list->inode[i] = item->inode;
+    list->dev[i]   = item->dev;
+    list->nlink[i] = item->nlink;
+    list->flags[i] = (uint8_t)((list->flags[i] & FI_FILTERED) | (item->is_dir ? FI_DIR : 0) |
+                               (item->is_hidden ? FI_HIDDEN : 0));
+}
+
+int filelist_path(const FileList *list, int i, char *out, size_t outsz) {
+    int n = snprintf(out, outsz, "%s/%s", list->dir, filelist_name(list, i));
+    if (n < 0 || (size_t)n >= outsz) return -1;
+    return n;
+}
+
+static void *arena_copy(Arena *arena, const void *src, size_t n) {
+    void *p = arena_alloc(arena, n);
+    if (p && n) memcpy(p, src, n);
+    return p;
+}
+
+#define FREEZE_COLUMN(col) do {                                             \
+        dst->col = arena_copy(arena, src->col, (size_t)n * sizeof(*src->col)); \
+        if (!dst->col) return -1;                                           \
+    } while (0)
+
+int filelist_freeze(const FileList *src, Arena *arena, FileList *dst) {
+    int n = src->count;
+
+    memset(dst, 0, sizeof(*dst));
+    dst->names = arena_copy(arena, src->names, src->names_len);
+    dst->cwd = arena_copy(arena, src->cwd, strlen(src->cwd) + 1);
+    dst->dir = arena_copy(arena, src->dir, strlen(src->dir) + 1);
+    if (!dst->names || !dst->cwd || !dst->dir) return -1;
+
+    FREEZE_COLUMN(name_off);
+    FREEZE_COLUMN(name_len);
+    FREEZE_COLUMN(name_width);
+    FREEZE_COLUMN(mode);
+    FREEZE_COLUMN(size);
+    FREEZE_COLUMN(mtime);
+    FREEZE_COLUMN(uid);
+    FREEZE_COLUMN(gid);
+    FREEZE_COLUMN(inode);
+    FREEZE_COLUMN(dev);
+    FREEZE_COLUMN(nlink);
+    FREEZE_COLUMN(flags);
+
+    dst->names_len = dst->names_cap = src->names_len;
+    dst->count = dst->cap = n;
+    return 0;
+}
+
+// Gather one column through the permutation using a scratch buffer that
+// is large enough for the widest column.
+static void permute_column(void *col, size_t elem, const uint32_t *order, int n, void *tmp) {
+    const char *src = col;
+    char *dst = tmp;
+    for (int k = 0; k < n; k++) {
+        memcpy(dst + (size_t)k * elem, src + (size_t)order[k] * elem, elem);
+    }
+    memcpy(col, tmp, (size_t)n * elem);
+}
+
+int filelist_permute(FileList *list, const uint32_t *order) {
+    if (list->count < 2) return 0;
+
+    size_t widest = sizeof(off_t);
+    if (sizeof(time_t) > widest) widest = sizeof(time_t);
+    if (sizeof(ino_t) > widest) widest = sizeof(ino_t);
+    if (sizeof(dev_t) > widest) widest = sizeof(dev_t);
+    if (sizeof(nlink_t) > widest) widest = sizeof(nlink_t);
+
+    void *tmp = malloc((size_t)list->count * widest);
+    if (!tmp) return -1;
+
+    int n = list->count;
+    permute_column(list->name_off, sizeof(*list->name_off), order, n, tmp);
+    permute_column(list->name_len, sizeof(*list->name_len), order, n, tmp);
+    permute_column(list->name_width, sizeof(*list->name_width), order, n, tmp);
+    permute_column(list->mode,     sizeof(*list->mode),     order, n, tmp);
+    permute_column(list->size,     sizeof(*list->size),     order, n, tmp);
+    permute_column(list->mtime,    sizeof(*list->mtime),    order, n, tmp);
+    permute_column(list->uid,      sizeof(*list->uid),      order, n, tmp);
+    permute_column(list->gid,      sizeof(*list->gid),      order, n, tmp);
+    permute_column(list->inode,    sizeof(*list->inode),    order, n, tmp);
+    permute_column(list->dev,      sizeof(*list->dev),      order, n, tmp);
+    permute_column(list->nlink,    sizeof(*list->nlink),    order, n, tmp);
+    permute_column(list->flags,    sizeof(*list->flags),    order, n, tmp);
+
+    free(tmp);
+    return 0;
+}
+
+#define COPY_COLUMN(col) memcpy(dst->col, src->col, (size_t)n * sizeof(*src->col))
+
+int filelist_copy(FileList *dst, const FileList *src) {
+    if (filelist_reset(dst, src->cwd, src->dir) != 0) return -1;
+    while (dst->cap < src->count) {
+        if (grow_columns(dst) != 0) return -1;
+    }
+
+    size_t live = 0;
+    for (int i = 0; i < src->count; i++) live += (size_t)src->name_len[i] + 1;
+    if (live > dst->names_cap && grow_names(dst, live) != 0) return -1;
+
+    int n = src->count;
+    for (int i = 0; i < n; i++) {
+        size_t len = (size_t)src->name_len[i] + 1;
+        dst->name_off[i] = (uint32_t)dst->names_len;
+        memcpy(dst->names + dst->names_len, filelist_name(src, i), len);
+        dst->names_len += len;
+    }
+    COPY_COLUMN(name_len);
+    COPY_COLUMN(name_width);
+    COPY_COLUMN(mode);
+    COPY_COLUMN(size);
+    COPY_COLUMN(mtime);
+    COPY_COLUMN(uid);
+    COPY_COLUMN(gid);
+    COPY_COLUMN(inode);
+    COPY_COLUMN(dev);
+    COPY_COLUMN(nlink);
+    COPY_COLUMN(flags);
+
+    dst->count = n;
+    return 0;
+}
+
+static void move_entry(FileList *list, int to, int from) {
+    list->name_off[to]   = list->name_off[from];
+    list->name_len[to]   = list->name_len[from];
+    list->name_width[to] = list->name_width[from];
+    list->mode[to]       = list->mode[from];
+    list->size[to]       = list->size[from];
+    list->mtime[to]      = list->mtime[from];
+    list->uid[to]        = list->uid[from];
+    list->gid[to]        = list->gid[from];
+    list->inode[to]      = list->inode[from];
+    list->dev[to]        = list->dev[from];
+    list->nlink[to]      = list->nlink[from];
+    list->flags[to]      = list->flags[from];
+}
+
+void filelist_remove(FileList *list, int i) {
+    int last = --list->count;
+    if (i != last) move_entry(list, i, last);
+}
+
+void filelist_drop_flagged(FileList *list, uint8_t flags) {
+    int n = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (list->flags[i] & flags) continue;
+        if (n != i) move_entry(list, n, i);
+        n++;
+    }
+    list->count = n;
+}
@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "filesort.h"
+
+// Lists at least this long are radix-sorted on the key before the
+// comparator pass; below it a merge sort over the records is faster.
+#define RADIX_MIN 2048
+
+// Runs this short are finished with insertion sort.
+#define INSERTION_MAX 16
+
+typedef struct {
+    uint64_t key;  // order-preserving prefix or mtime, already in sort direction
+    uint32_t idx;  // entry index in the list
+    uint32_t str;  // offset of the compared string in ctx->base
+} SortRec;
+
+typedef struct {
+    const FileList *list;
+    const char *base;  // names arena, or the derived key buffer
+} SortCtx;
+
+// First 8 bytes of a NUL-terminated string, big-endian and zero-padded,
+// so integer order equals strcmp order on the prefix.
+static uint64_t prefix_key(const char *s) {
+    uint64_t k = 0;
+    for (int i = 0; i < 8 && s[i]; i++) k |= (uint64_t)(unsigned char)s[i] << (56 - 8 * i);
+    return k;
+}
+
+// Offset of the extension within the name, or name_len if there is
+// none (pointing at the terminating NUL, i.e. an empty extension).
+static size_t ext_offset(const char *name, size_t len) {
+    for (size_t i = len; i > 0; i--) {
+        if (name[i - 1] == '.') return i - 1;
+    }
+    return len;
+}
+
+// Compare the parts of two strings beyond their equal 8-byte prefixes.
+// A zero low byte in the (uncomplemented) key means the string ended
+// inside the prefix, and with equal keys both did, so they are equal.
+static inline int tail_cmp(const SortRec *a, const SortRec *b, const SortCtx *c, uint64_t flip) {
+    if (((a->key ^ flip) & 0xff) == 0) return 0;
+    return strcmp(c->base + a->str + 8, c->base + b->str + 8);
+}
+
+static inline int full_name_cmp(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    return strcmp(filelist_name(c->list, (int)a->idx), filelist_name(c->list, (int)b->idx));
+}
+
+static inline int key_cmp(const SortRec *a, const SortRec *b) {
+    return (a->key > b->key) - (a->key < b->key);
+}
+
+// Each comparator is only consulted after key_cmp returned 0. For the
+// reversed modes the key was complemented, so only the tail comparison
+// needs flipping. Extension and derived-key modes fall back to the
+// plain name when their strings compare equal.
+static inline int tie_time(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    (void)a; (void)b; (void)c;
+    return 0;
+}
+
+static inline int tie_size(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    return full_name_cmp(a, b, c);
+}
+
+static inline int tie_size_rev(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    return -full_name_cmp(a, b, c);
+}
+
+static inline int tie_name(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    return tail_cmp(a, b, c, 0);
+}
+
+static inline int tie_name_rev(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    return -tail_cmp(a, b, c, ~(uint64_t)0);
+}
+
+static inline int tie_then_name(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    int r = tail_cmp(a, b, c, 0);
+    return r ? r : full_name_cmp(a, b, c);
+}
+
+static inline int tie_then_name_rev(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    int r = tail_cmp(a, b, c, ~(uint64_t)0);
+    return -(r ? r : full_name_cmp(a, b, c));
+}
+
+// Stable insertion + merge sort, instantiated once per comparator so
+// the compare is inlined instead of called through a pointer.
+#define DEFINE_MERGE_SORT(NAME, TIE)                                               \
+    static inline int NAME##_cmp(const SortRec *a, const SortRec *b, const SortCtx *c) { \
+        int r = key_cmp(a, b);                                                     \
+        return r ? r : TIE(a, b, c);                                               \
+    }                                                                              \
+                                                                                   \
+    static void NAME##_insertion(SortRec *a, size_t n, const SortCtx *c) {         \
+        for (size_t i = 1; i < n; i++) {                                           \
+            SortRec r = a[i];                                                      \
+            size_t j = i;                                                          \
+            while (j > 0 && NAME##_cmp(&a[j - 1], &r, c) > 0) {                    \
+                a[j] = a[j - 1];                                                   \
+                j--;                                                               \
+            }                                                                      \
+            a[j] = r;                                                              \
+        }                                                                          \
+    }                                                                              \
+                                                                                   \
+    static void NAME##_merge(SortRec *a, SortRec *tmp, size_t n, const SortCtx *c) { \
+        if (n <= INSERTION_MAX) {                                                  \
+            NAME##_insertion(a, n, c);                                             \
+            return;                                                                \
+        }                                                                          \
+        size_t mid = n / 2;                                                        \
+        NAME##_merge(a, tmp, mid, c);                                              \
+        NAME##_merge(a + mid, tmp, n - mid, c);                                    \
+        if (NAME##_cmp(&a[mid - 1], &a[mid], c) <= 0) return;                     \
+                                                                                   \
+        memcpy(tmp, a, mid * sizeof(*a));                                          \
+        size_t i = 0, j = mid, k = 0;                                              \
+        while (i < mid && j < n) {                                                 \
+            if (NAME##_cmp(&a[j], &tmp[i], c) < 0) a[k++] = a[j++];                \
+            else a[k++] = tmp[i++];                                                \
+        }                                                                          \
+        while (i < mid) a[k++] = tmp[i++];                                         \
+    }
+
+DEFINE_MERGE_SORT(time, tie_time)
+DEFINE_MERGE_SORT(size, tie_size)
+DEFINE_MERGE_SORT(size_rev, tie_size_rev)
+DEFINE_MERGE_SORT(name, tie_name)
+DEFINE_MERGE_SORT(name_rev, tie_name_rev)
+DEFINE_MERGE_SORT(keyed, tie_then_name)
+DEFINE_MERGE_SORT(keyed_rev, tie_then_name_rev)
+
+typedef void (*MergeFn)(SortRec *a, SortRec *tmp, size_t n, const SortCtx *c);
+
+// LSD radix sort on the 64-bit key, one byte per pass. All eight
+// histograms are built in a single read, and passes where every record
+// shares the same byte are skipped. Stable. The result ends up in a.
+static void radix_sort(SortRec *a, SortRec *tmp, size_t n) {
+    size_t counts[8][256];
+    memset(counts, 0, sizeof(counts));
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t k = a[i].key;
+        for (int b = 0; b < 8; b++) counts[b][(k >> (8 * b)) & 0xff]++;
+    }
+
+    SortRec *src = a, *dst = tmp;
+    for (int b = 0; b < 8; b++) {
+        size_t *c = counts[b];
+        if (c[(src[0].key >> (8 * b)) & 0xff] == n) continue;
+
+        size_t sum = 0;
+        for (int v = 0; v < 256; v++) {
+            size_t t = c[v];
+            c[v] = sum;
+            sum += t;
+        }
+        for (size_t i = 0; i < n; i++) {
+            SortRec r = src[i];
+            dst[c[(r.key >> (8 * b)) & 0xff]++] = r;
+        }
+
+        SortRec *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != a) memcpy(a, src, n * sizeof(*a));
+}
+
+// Derived sort strings for the version and locale modes, built once per
+// entry and stored back to back (NUL-terminated) so records can point at
+// them by offset just like at names.
+typedef struct {
+    char *p;
+    size_t len;
+    size_t cap;
+} KeyBuf;
+
+static int keybuf_reserve(KeyBuf *kb, size_t need) {
+    if (kb->len + need <= kb->cap) return 0;
+    size_t ncap = kb->cap ? kb->cap : 4096;
+    while (ncap < kb->len + need) ncap *= 2;
+    if (ncap > UINT32_MAX) return -1;
+
+    char *p = realloc(kb->p, ncap);
+    if (!p) return -1;
+    kb->p = p;
+    kb->cap = ncap;
+    return 0;
+}
+
+// Natural-order key: byte strings compare like the names with every run
+// of digits compared by numeric value. A run becomes a length byte
+// followed by its significant digits, so longer numbers sort later. The
+// length byte stays inside '0'..'9' (with an extra count byte for runs
+// of nine digits or more), which keeps digits ordered against the
+// surrounding punctuation exactly as in plain byte order. Equal keys
+// ("a01" / "a1") are split by the name afterwards.
+static int version_key(KeyBuf *kb, const char *name, size_t len) {
+    if (keybuf_reserve(kb, 3 * len + 1) != 0) return -1;
+
+    char *out = kb->p + kb->len;
+    size_t i = 0;
+    while (i < len) {
+        unsigned char ch = (unsigned char)name[i];
+        if (!isdigit(ch)) {
+            *out++ = (char)ch;
+            i++;
+            continue;
+        }
+
+        while (i < len && name[i] == '0') i++;
+        size_t start = i;
+        while (i < len && isdigit((unsigned char)name[i])) i++;
+        size_t digits = i - start;
+
+        if (digits < 9) {
+            *out++ = (char)('0' + digits);
+        } else {
+            *out++ = '9';
+            *out++ = (char)(digits - 8 > 255 ? 255 : digits - 8);
+        }
+        memcpy(out, name + start, digits);
+        out += digits;
+    }
+    *out++ = '\0';
+
+    kb->len = (size_t)(out - kb->p);
+    return 0;
+}
+
+// Locale key: strxfrm output compares with strcmp like strcoll would
+// compare the names, so the collation work happens once per entry.
+static int collate_key(KeyBuf *kb, const char *name, size_t len) {
+    size_t want = 2 * len + 16;
+    for (;;) {
+        if (keybuf_reserve(kb, want) != 0) return -1;
+        size_t n = strxfrm(kb->p + kb->len, name, kb->cap - kb->len);
+        if (n < kb->cap - kb->len) {
+            kb->len += n + 1;
+            return 0;
+        }
+        want = n + 1;
+    }
+}
+
+int filelist_sort_order(const FileList *list, SortMode mode, int reverse, uint32_t *order) {
+    size_t n = (size_t)list->count;
+    if (n < 2) {
+        if (n == 1) order[0] = 0;
+        return 0;
+    }
+
+    SortRec *recs = malloc(n * sizeof(*recs));
+    SortRec *tmp = malloc(n * sizeof(*tmp));
+    if (!recs || !tmp) {
+        free(recs);
+        free(tmp);
+        return -1;
+    }
+
+    SortCtx ctx = { list, list->names };
+    KeyBuf kb = { NULL, 0, 0 };
+    MergeFn merge;
+
+    switch (mode) {
+    case SORT_TIME:
+        for (size_t i = 0; i < n; i++) {
+            // Bias the signed time so unsigned order matches; newest
+            // first unless reversed.
+            uint64_t k = (uint64_t)(int64_t)list->mtime[i] ^ (1ull << 63);
+            recs[i].key = reverse ? k : ~k;
+            recs[i].idx = (uint32_t)i;
+            recs[i].str = list->name_off[i];
+        }
+        merge = time_merge;
+        break;
+    case SORT_SIZE:
+        for (size_t i = 0; i < n; i++) {
+            // Largest first unless reversed; equal sizes go by name.
+            uint64_t k = (uint64_t)(int64_t)list->size[i] ^ (1ull << 63);
+            recs[i].key = reverse ? k : ~k;
+            recs[i].idx = (uint32_t)i;
+            recs[i].str = list->name_off[i];
+        }
+        merge = reverse ? size_rev_merge : size_merge;
+        break;
+    case SORT_EXT:
+        for (size_t i = 0; i < n; i++) {
+            const char *name = filelist_name(list, (int)i);
+            size_t off = ext_offset(name, list->name_len[i]);
+            uint64_t k = prefix_key(name + off);
+            recs[i].key = reverse ? ~k : k;
+            recs[i].idx = (uint32_t)i;
+            recs[i].str = list->name_off[i] + (uint32_t)off;
+        }
+        merge = reverse ? keyed_rev_merge : keyed_merge;
+        break;
+    case SORT_VERSION:
+    case SORT_COLLATE:
+        for (size_t i = 0; i < n; i++) {
+            const char *name = filelist_name(list, (int)i);
+            recs[i].str = (uint32_t)kb.len;
+            int rc = (mode == SORT_VERSION) ? version_key(&kb, name, list->name_len[i])
+                                            : collate_key(&kb, name, list->name_len[i]);
+            if (rc != 0) {
+                free(kb.p);
+                free(recs);
+                free(tmp);
+                return -1;
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            uint64_t k = prefix_key(kb.p + recs[i].str);
+            recs[i].key = reverse ? ~k : k;
+            recs[i].idx = (uint32_t)i;
+        }
+        ctx.base = kb.p;
+        merge = reverse ? keyed_rev_merge : keyed_merge;
+        break;
+    case SORT_NAME:
+    default:
+        for (size_t i = 0; i < n; i++) {
+            uint64_t k = prefix_key(filelist_name(list, (int)i));
+            recs[i].key = reverse ? ~k : k;
+            recs[i].idx = (uint32_t)i;
+            recs[i].str = list->name_off[i];
+        }
+        merge = reverse ? name_rev_merge : name_merge;
+        break;
+    }
+
+    if (n < RADIX_MIN) {
+        merge(recs, tmp, n, &ctx);
+    } else {
+        radix_sort(recs, tmp, n);
+        if (mode != SORT_TIME) {
+            // Only runs sharing a key still need the full comparator.
+            size_t i = 0;
+            while (i < n) {
+                size_t j = i + 1;
+                while (j < n && recs[j].key == recs[i].key) j++;
+                if (j - i > 1) merge(recs + i, tmp, j - i, &ctx);
+                i = j;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) order[i] = recs[i].idx;
+
+    free(kb.p);
+    free(recs);
+    free(tmp);
+    return 0;
+}
+
+int filelist_sort(FileList *list, SortMode mode, int reverse) {
+    if (list->count < 2) return 0;
+
+    uint32_t *order = malloc((size_t)list->count * sizeof(*order));
+    if (!order) return -1;
+
+    int rc = filelist_sort_order(list, mode, reverse, order);
+    if (rc == 0) rc = filelist_permute(list, order);
+    free(order);
+    return rc;
+}
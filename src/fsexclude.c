@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#elif defined(__APPLE__)
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
+
+#include "fsexclude.h"
+
+struct FsExclude {
+    char **types;
+    int ntypes;
+    dev_t *devs;
+    int ndevs;
+    int devs_cap;
+};
+
+FsExclude *fsexclude_new(void) {
+    return calloc(1, sizeof(FsExclude));
+}
+
+void fsexclude_free(FsExclude *x) {
+    if (!x) return;
+    for (int i = 0; i < x->ntypes; i++) free(x->types[i]);
+    free(x->types);
+    free(x->devs);
+    free(x);
+}
+
+int fsexclude_add_types(FsExclude *x, const char *list) {
+    const char *p = list;
+    while (*p) {
+        size_t n = strcspn(p, ",");
+        if (n > 0) {
+            char **types = realloc(x->types, (size_t)(x->ntypes + 1) * sizeof(*types));
+            if (!types) return -1;
+            x->types = types;
+            char *name = malloc(n + 1);
+            if (!name) return -1;
+            memcpy(name, p, n);
+            name[n] = '\0';
+            x->types[x->ntypes++] = name;
+        }
+        p += n;
+        if (*p == ',') p++;
+    }
+    return 0;
+}
+
+// "nfs" matches "nfs" and "nfs4", "fuse" matches "fuse.sshfs", but
+// "fuse" does not match "fuseblk".
+static int type_excluded(const FsExclude *x, const char *type, size_t len) {
+    for (int i = 0; i < x->ntypes; i++) {
+        size_t n = strlen(x->types[i]);
+        if (n > len || memcmp(type, x->types[i], n) != 0) continue;
+        if (n == len || type[n] == '.' || (type[n] >= '0' && type[n] <= '9')) return 1;
+    }
+    return 0;
+}
+
+static int add_dev(FsExclude *x, dev_t dev) {
+    if (x->ndevs == x->devs_cap) {
+        int cap = x->devs_cap ? x->devs_cap * 2 : 8;
+        dev_t *devs = realloc(x->devs, (size_t)cap * sizeof(*devs));
+        if (!devs) return -1;
+        x->devs = devs;
+        x->devs_cap = cap;
+    }
+    x->devs[x->ndevs++] = dev;
+    return 0;
+}
+
+#ifdef __linux__
+
+// One line per mount: "36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1
+// - ext3 /dev/root rw", where 98:0 is what stat reports as st_dev for
+// the files on it and the type follows the " - " separator.
+int fsexclude_read_mounts(FsExclude *x) {
+    FILE *f = fopen("/proc/self/mountinfo", "r");
+    if (!f) return -1;
+
+    char *line = NULL;
+    size_t cap = 0;
+    int rc = 0;
+    while (getline(&line, &cap, f) > 0) {
+        unsigned maj, min;
+        if (sscanf(line, "%*s %*s %u:%u", &maj, &min) != 2) continue;
+        const char *sep = strstr(line, " - ");
+        if (!sep) continue;
+        const char *type = sep + 3;
+        size_t len = strcspn(type, " \n");
+        if (type_excluded(x, type, len) && add_dev(x, makedev(maj, min)) != 0) {
+            errno = ENOMEM;
+            rc = -1;
+            break;
+        }
+    }
+    free(line);
+    fclose(f);
+    return rc;
+}
+
+#elif defined(__APPLE__)
+
+// f_fsid.val[0] is the device number stat reports for the mount's files.
+int fsexclude_read_mounts(FsExclude *x) {
+    struct statfs *mnts;
+    int n = getmntinfo(&mnts, MNT_NOWAIT);
+    if (n <= 0) return -1;
+    for (int i = 0; i < n; i++) {
+        const char *type = mnts[i].f_fstypename;
+        if (type_excluded(x, type, strlen(type)) && add_dev(x, (dev_t)mnts[i].f_fsid.val[0]) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#else
+
+int fsexclude_read_mounts(FsExclude *x) {
+    (void)x;
+    (void)add_dev;
+    (void)type_excluded;
+    errno = ENOTSUP;
+    return -1;
+}
+
+#endif
+
+int fsexclude_has(const FsExclude *x, dev_t dev) {
+    for (int i = 0; i < x->ndevs; i++) {
+        if (x->devs[i] == dev) return 1;
+    }
+    return 0;
+}
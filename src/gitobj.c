@@ -0,0 +1,494 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "gitobj.h"
+
+// Deepest delta chain followed; git itself packs with --depth 50.
+#define MAX_DELTA_DEPTH 64
+
+typedef struct {
+    const unsigned char *idx;
+    size_t idx_len;
+    const unsigned char *pack;
+    size_t pack_len;
+    uint32_t count;
+} Pack;
+
+struct GitObjects {
+    char *dir;
+    Pack *packs;
+    int npacks;
+    int rescanned;
+};
+
+// ---- SHA-1 ----
+
+typedef struct {
+    uint32_t h[5];
+    uint64_t len;
+    unsigned char buf[64];
+    size_t used;
+} Sha1;
+
+static uint32_t rol(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static void sha1_block(Sha1 *s, const unsigned char *p) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3], e = s->h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+        else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+        else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+        uint32_t t = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+    s->h[0] += a;
+    s->h[1] += b;
+    s->h[2] += c;
+    s->h[3] += d;
+    s->h[4] += e;
+}
+
+static void sha1_init(Sha1 *s) {
+    static const uint32_t iv[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    memcpy(s->h, iv, sizeof(iv));
+    s->len = 0;
+    s->used = 0;
+}
+
+static void sha1_update(Sha1 *s, const void *data, size_t n) {
+    const unsigned char *p = data;
+    s->len += n;
+    if (s->used) {
+        size_t take = 64 - s->used < n ? 64 - s->used : n;
+        memcpy(s->buf + s->used, p, take);
+        s->used += take;
+        p += take;
+        n -= take;
+        if (s->used < 64) return;
+        sha1_block(s, s->buf);
+        s->used = 0;
+    }
+    for (; n >= 64; p += 64, n -= 64) sha1_block(s, p);
+    memcpy(s->buf, p, n);
+    s->used = n;
+}
+
+static void sha1_final(Sha1 *s, uint8_t out[GIT_SHA_LEN]) {
+    uint64_t bits = s->len * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t padlen = (s->used < 56 ? 56 : 120) - s->used;
+    for (int i = 0; i < 8; i++) pad[padlen + i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha1_update(s, pad, padlen + 8);
+    for (int i = 0; i < 5; i++) {
+        out[4 * i]     = (uint8_t)(s->h[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(s->h[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(s->h[i] >> 8);
+        out[4 * i + 3] = (uint8_t)s->h[i];
+    }
+}
+
+static void blob_header(Sha1 *s, uint64_t len) {
+    char hdr[32];
+    int n = snprintf(hdr, sizeof(hdr), "blob %llu", (unsigned long long)len);
+    sha1_init(s);
+    sha1_update(s, hdr, (size_t)n + 1);   // with the NUL
+}
+
+void gitobj_hash_blob(const void *data, size_t len, uint8_t out[GIT_SHA_LEN]) {
+    Sha1 s;
+    blob_header(&s, len);
+    sha1_update(&s, data, len);
+    sha1_final(&s, out);
+}
+
+int gitobj_hash_blob_fd(int fd, uint64_t len, uint8_t out[GIT_SHA_LEN]) {
+    Sha1 s;
+    blob_header(&s, len);
+    unsigned char buf[64 * 1024];
+    uint64_t left = len;
+    while (left) {
+        ssize_t n = read(fd, buf, left < sizeof(buf) ? (size_t)left : sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        sha1_update(&s, buf, (size_t)n);
+        left -= (uint64_t)n;
+    }
+    sha1_final(&s, out);
+    return 0;
+}
+
+int gitobj_parse_hex(const char *s, uint8_t out[GIT_SHA_LEN]) {
+    for (int i = 0; i < 2 * GIT_SHA_LEN; i++) {
+        char c = s[i];
+        int v = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (v < 0) return -1;
+        if (i & 1) out[i / 2] = (uint8_t)(out[i / 2] | v);
+        else out[i / 2] = (uint8_t)(v << 4);
+    }
+    return 0;
+}
+
+// ---- inflate ----
+
+// Inflate exactly want bytes from src; NULL if the stream is short or bad.
+static unsigned char *inflate_exact(const unsigned char *src, size_t srclen, size_t want) {
+    unsigned char *out = malloc(want ? want : 1);
+    if (!out) return NULL;
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit(&z) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    z.next_in = (unsigned char *)src;
+    z.avail_in = srclen > UINT32_MAX ? UINT32_MAX : (uInt)srclen;
+    z.next_out = out;
+    z.avail_out = (uInt)want;
+    int rc = inflate(&z, Z_FINISH);
+    inflateEnd(&z);
+    if (rc != Z_STREAM_END || z.total_out != want) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+// Whole zlib stream of unknown length (loose objects).
+static unsigned char *inflate_all(const unsigned char *src, size_t srclen, size_t *outlen) {
+    size_t cap = srclen * 4 + 64, len = 0;
+    unsigned char *out = malloc(cap);
+    if (!out) return NULL;
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit(&z) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    z.next_in = (unsigned char *)src;
+    z.avail_in = (uInt)srclen;
+    int rc;
+    do {
+        if (len == cap) {
+            unsigned char *p = realloc(out, cap * 2);
+            if (!p) break;
+            out = p;
+            cap *= 2;
+        }
+        z.next_out = out + len;
+        z.avail_out = (uInt)(cap - len);
+        rc = inflate(&z, Z_NO_FLUSH);
+        len = cap - z.avail_out;
+    } while (rc == Z_OK);
+    inflateEnd(&z);
+    if (rc != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    *outlen = len;
+    return out;
+}
+
+// ---- packs ----
+
+static uint32_t be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static const void *map_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        *len = (size_t)st.st_size;
+    }
+    close(fd);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void add_pack(GitObjects *db, const char *packdir, const char *idxname) {
+    char path[4096];
+    Pack pk;
+    memset(&pk, 0, sizeof(pk));
+
+    // Room to turn ".idx" into ".pack" below.
+    int n = snprintf(path, sizeof(path), "%s/%s", packdir, idxname);
+    if (n < 0 || (size_t)n + 2 >= sizeof(path)) return;
+    pk.idx = map_file(path, &pk.idx_len);
+    // Version 2 only: magic, version, 256 fanout counts.
+    if (!pk.idx || pk.idx_len < 8 + 256 * 4 || memcmp(pk.idx, "\377tOc\0\0\0\2", 8) != 0) goto fail;
+    pk.count = be32(pk.idx + 8 + 255 * 4);
+    if (pk.idx_len < 8 + 256 * 4 + (size_t)pk.count * (GIT_SHA_LEN + 8)) goto fail;
+
+    memcpy(path + n - 4, ".pack", 6);
+    pk.pack = map_file(path, &pk.pack_len);
+    if (!pk.pack || pk.pack_len < 12 + GIT_SHA_LEN || memcmp(pk.pack, "PACK", 4) != 0) goto fail;
+
+    Pack *p = realloc(db->packs, (size_t)(db->npacks + 1) * sizeof(*p));
+    if (!p) goto fail;
+    db->packs = p;
+    db->packs[db->npacks++] = pk;
+    return;
+
+fail:
+    if (pk.idx) munmap((void *)pk.idx, pk.idx_len);
+    if (pk.pack) munmap((void *)pk.pack, pk.pack_len);
+}
+
+// Offset of sha in pk, or 0 (never a valid object offset) if absent.
+static uint64_t pack_find(const Pack *pk, const uint8_t *sha) {
+    const unsigned char *fanout = pk->idx + 8;
+    uint32_t lo = sha[0] ? be32(fanout + (sha[0] - 1) * 4) : 0;
+    uint32_t hi = be32(fanout + sha[0] * 4);
+    const unsigned char *shas = fanout + 256 * 4;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int c = memcmp(shas + (size_t)mid * GIT_SHA_LEN, sha, GIT_SHA_LEN);
+        if (c == 0) {
+            const unsigned char *offs = shas + (size_t)pk->count * (GIT_SHA_LEN + 4);
+            uint32_t off = be32(offs + (size_t)mid * 4);
+            if (!(off & 0x80000000u)) return off;
+            const unsigned char *big = offs + (size_t)pk->count * 4 + (size_t)(off & 0x7fffffffu) * 8;
+            if (big + 8 > pk->idx + pk->idx_len) return 0;
+            return (uint64_t)be32(big) << 32 | be32(big + 4);
+        }
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return 0;
+}
+
+static size_t delta_varint(const unsigned char **p, const unsigned char *end) {
+    size_t v = 0;
+    int shift = 0;
+    while (*p < end) {
+        unsigned char c = *(*p)++;
+        v |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+        if (!(c & 0x80) || shift > 56) break;
+    }
+    return v;
+}
+
+static unsigned char *apply_delta(const unsigned char *base, size_t base_len, const unsigned char *d, size_t dlen,
+                                  size_t *outlen) {
+    const unsigned char *end = d + dlen;
+    if (delta_varint(&d, end) != base_len) return NULL;
+    size_t size = delta_varint(&d, end);
+    unsigned char *out = malloc(size ? size : 1);
+    if (!out) return NULL;
+
+    size_t pos = 0;
+    while (d < end) {
+        unsigned char op = *d++;
+        if (op & 0x80) {
+            size_t off = 0, n = 0;
+            for (int i = 0; i < 4; i++)
+                if (op & (1 << i)) off |= (size_t)(d < end ? *d++ : 0) << (8 * i);
+            for (int i = 0; i < 3; i++)
+                if (op & (0x10 << i)) n |= (size_t)(d < end ? *d++ : 0) << (8 * i);
+            if (!n) n = 0x10000;
+            if (off + n > base_len || pos + n > size) goto bad;
+            memcpy(out + pos, base + off, n);
+            pos += n;
+        } else if (op) {
+            if ((size_t)(end - d) < op || pos + op > size) goto bad;
+            memcpy(out + pos, d, op);
+            d += op;
+            pos += op;
+        } else {
+            goto bad;
+        }
+    }
+    if (pos != size) goto bad;
+    *outlen = size;
+    return out;
+
+bad:
+    free(out);
+    return NULL;
+}
+
+static GitObjType read_any(GitObjects *db, const uint8_t *sha, unsigned char **data, size_t *len, int depth);
+
+static GitObjType read_packed(GitObjects *db, const Pack *pk, uint64_t off, unsigned char **data, size_t *len,
+                              int depth) {
+    const unsigned char *end = pk->pack + pk->pack_len - GIT_SHA_LEN;
+    if (depth > MAX_DELTA_DEPTH || off < 12 || off >= (uint64_t)(end - pk->pack)) return GIT_OBJ_NONE;
+
+    const unsigned char *p = pk->pack + off;
+    unsigned char c = *p++;
+    int type = (c >> 4) & 7;
+    size_t size = c & 15;
+    int shift = 4;
+    while ((c & 0x80) && p < end && shift < 60) {
+        c = *p++;
+        size |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    }
+
+    unsigned char *base = NULL;
+    size_t base_len = 0;
+    int base_type = GIT_OBJ_NONE;
+    if (type == 6) {
+        // OFS_DELTA: the base sits a (specially encoded) distance back.
+        uint64_t back = 0;
+        if (p >= end) return GIT_OBJ_NONE;
+        c = *p++;
+        back = c & 0x7f;
+        while ((c & 0x80) && p < end) {
+            c = *p++;
+            back = ((back + 1) << 7) | (c & 0x7f);
+        }
+        if (back == 0 || back > off) return GIT_OBJ_NONE;
+        base_type = read_packed(db, pk, off - back, &base, &base_len, depth + 1);
+    } else if (type == 7) {
+        // REF_DELTA: the base is named by id and may live anywhere.
+        if (end - p < GIT_SHA_LEN) return GIT_OBJ_NONE;
+        base_type = read_any(db, p, &base, &base_len, depth + 1);
+        p += GIT_SHA_LEN;
+    } else if (type < GIT_OBJ_COMMIT || type > GIT_OBJ_TAG) {
+        return GIT_OBJ_NONE;
+    }
+
+    unsigned char *raw = inflate_exact(p, (size_t)(end - p), size);
+    if (type != 6 && type != 7) {
+        if (!raw) return GIT_OBJ_NONE;
+        *data = raw;
+        *len = size;
+        return (GitObjType)type;
+    }
+
+    GitObjType rc = GIT_OBJ_NONE;
+    if (raw && base_type != GIT_OBJ_NONE) {
+        *data = apply_delta(base, base_len, raw, size, len);
+        if (*data) rc = (GitObjType)base_type;
+    }
+    free(raw);
+    free(base);
+    return rc;
+}
+
+static GitObjType read_loose(GitObjects *db, const uint8_t *sha, unsigned char **data, size_t *len) {
+    static const char hex[] = "0123456789abcdef";
+    char path[4096];
+    int n = snprintf(path, sizeof(path), "%s/", db->dir);
+    for (int i = 0; i < GIT_SHA_LEN && n + 4 < (int)sizeof(path); i++) {
+        path[n++] = hex[sha[i] >> 4];
+        path[n++] = hex[sha[i] & 15];
+        if (i == 0) path[n++] = '/';
+    }
+    path[n] = '\0';
+
+    size_t flen = 0;
+    const unsigned char *file = map_file(path, &flen);
+    if (!file) return GIT_OBJ_NONE;
+    size_t rawlen = 0;
+    unsigned char *raw = inflate_all(file, flen, &rawlen);
+    munmap((void *)file, flen);
+    if (!raw) return GIT_OBJ_NONE;
+
+    // "<type> <size>\0<content>"
+    unsigned char *nul = memchr(raw, '\0', rawlen);
+    GitObjType type = GIT_OBJ_NONE;
+    if (nul) {
+        if (strncmp((char *)raw, "commit ", 7) == 0) type = GIT_OBJ_COMMIT;
+        else if (strncmp((char *)raw, "tree ", 5) == 0) type = GIT_OBJ_TREE;
+        else if (strncmp((char *)raw, "blob ", 5) == 0) type = GIT_OBJ_BLOB;
+        else if (strncmp((char *)raw, "tag ", 4) == 0) type = GIT_OBJ_TAG;
+    }
+    if (type == GIT_OBJ_NONE) {
+        free(raw);
+        return GIT_OBJ_NONE;
+    }
+    size_t hdr = (size_t)(nul + 1 - raw);
+    memmove(raw, nul + 1, rawlen - hdr);
+    *data = raw;
+    *len = rawlen - hdr;
+    return type;
+}
+
+static GitObjType read_any(GitObjects *db, const uint8_t *sha, unsigned char **data, size_t *len, int depth) {
+    for (int i = 0; i < db->npacks; i++) {
+        uint64_t off = pack_find(&db->packs[i], sha);
+        if (off) return read_packed(db, &db->packs[i], off, data, len, depth);
+    }
+    return read_loose(db, sha, data, len);
+}
+
+static void unmap_packs(GitObjects *db) {
+    for (int i = 0; i < db->npacks; i++) {
+        munmap((void *)db->packs[i].idx, db->packs[i].idx_len);
+        munmap((void *)db->packs[i].pack, db->packs[i].pack_len);
+    }
+    free(db->packs);
+    db->packs = NULL;
+    db->npacks = 0;
+}
+
+static void load_packs(GitObjects *db) {
+    unmap_packs(db);
+    char packdir[4096];
+    int n = snprintf(packdir, sizeof(packdir), "%s/pack", db->dir);
+    DIR *d = n > 0 && (size_t)n < sizeof(packdir) ? opendir(packdir) : NULL;
+    if (!d) return;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        size_t len = strlen(e->d_name);
+        if (len > 4 && strcmp(e->d_name + len - 4, ".idx") == 0) add_pack(db, packdir, e->d_name);
+    }
+    closedir(d);
+}
+
+GitObjType gitobj_read(GitObjects *db, const uint8_t *sha, unsigned char **data, size_t *len) {
+    GitObjType t = read_any(db, sha, data, len, 0);
+    if (t == GIT_OBJ_NONE && !db->rescanned) {
+        // A gc running alongside may have packed the loose object since
+        // the packs were listed; look once more, as git does.
+        db->rescanned = 1;
+        load_packs(db);
+        t = read_any(db, sha, data, len, 0);
+    }
+    return t;
+}
+
+GitObjects *gitobj_open(const char *objects_dir) {
+    GitObjects *db = calloc(1, sizeof(*db));
+    if (!db) return NULL;
+    db->dir = strdup(objects_dir);
+    if (!db->dir) {
+        free(db);
+        return NULL;
+    }
+    load_packs(db);
+    return db;
+}
+
+void gitobj_close(GitObjects *db) {
+    if (!db) return;
+    unmap_packs(db);
+    free(db->dir);
+    free(db);
+}
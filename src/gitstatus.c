@@ -0,0 +1,1195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "gitstatus.h"
+#include "gitobj.h"
+
+#define INDEX_ASSUME_VALID   0x8000
+#define INDEX_EXTENDED       0x4000
+#define INDEX_STAGE_MASK     0x3000
+#define INDEX_NAME_MASK      0x0fff
+#define INDEX_SKIP_WORKTREE  0x4000   // extended flags
+#define INDEX_INTENT_TO_ADD  0x2000
+
+#define GIT_MODE_GITLINK 0160000
+
+// ---- string map ----
+
+// Open-addressing map from a path to a pointer; keys are copied.
+typedef struct {
+    char **keys;
+    void **vals;
+    size_t cap;    // power of two
+    size_t count;
+} StrMap;
+
+static size_t str_hash(const char *s, size_t n) {
+    size_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+    return h;
+}
+
+static void **strmap_find(StrMap *m, const char *key, size_t n) {
+    if (!m->cap) return NULL;
+    for (size_t i = str_hash(key, n) & (m->cap - 1);; i = (i + 1) & (m->cap - 1)) {
+        if (!m->keys[i]) return NULL;
+        if (strncmp(m->keys[i], key, n) == 0 && m->keys[i][n] == '\0') return &m->vals[i];
+    }
+}
+
+static int strmap_put(StrMap *m, const char *key, size_t n, void *val) {
+    if ((m->count + 1) * 2 > m->cap) {
+        size_t ncap = m->cap ? m->cap * 2 : 64;
+        char **keys = calloc(ncap, sizeof(*keys));
+        void **vals = calloc(ncap, sizeof(*vals));
+        if (!keys || !vals) {
+            free(keys);
+            free(vals);
+            return -1;
+        }
+        for (size_t i = 0; i < m->cap; i++) {
+            if (!m->keys[i]) continue;
+            size_t j = str_hash(m->keys[i], strlen(m->keys[i])) & (ncap - 1);
+            while (keys[j]) j = (j + 1) & (ncap - 1);
+            keys[j] = m->keys[i];
+            vals[j] = m->vals[i];
+        }
+        free(m->keys);
+        free(m->vals);
+        m->keys = keys;
+        m->vals = vals;
+        m->cap = ncap;
+    }
+    size_t i = str_hash(key, n) & (m->cap - 1);
+    while (m->keys[i]) i = (i + 1) & (m->cap - 1);
+    m->keys[i] = strndup(key, n);
+    if (!m->keys[i]) return -1;
+    m->vals[i] = val;
+    m->count++;
+    return 0;
+}
+
+static void strmap_free(StrMap *m, void (*free_val)(void *)) {
+    for (size_t i = 0; i < m->cap; i++) {
+        if (!m->keys[i]) continue;
+        if (free_val) free_val(m->vals[i]);
+        free(m->keys[i]);
+    }
+    free(m->keys);
+    free(m->vals);
+    memset(m, 0, sizeof(*m));
+}
+
+// ---- repository state ----
+
+typedef struct {
+    const char *path;
+    uint32_t len;
+    uint32_t mtime;
+    uint32_t ino;
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t size;
+    const uint8_t *sha;
+    uint16_t flags;
+    uint16_t xflags;
+} IndexEntry;
+
+// A tree of HEAD, entries sorted by name for lookup.
+typedef struct {
+    const char *name;
+    size_t len;
+    uint32_t mode;
+    const uint8_t *sha;
+} TreeEnt;
+
+typedef struct {
+    unsigned char *data;
+    TreeEnt *ents;
+    int n;
+} Tree;
+
+// Cached tree of the index for one directory; valid when its entry count
+// was not invalidated since the last write-tree.
+typedef struct {
+    int valid;
+    uint8_t sha[GIT_SHA_LEN];
+} CacheTree;
+
+typedef struct {
+    char *pat;
+    int negate;
+    int dir_only;
+    int has_slash;   // matched against the whole relative path
+} IgnoreRule;
+
+typedef struct {
+    IgnoreRule *v;
+    int n;
+    char *text;
+} IgnoreList;
+
+struct GitRepo {
+    int root_fd;
+    char *prefix;        // opened path relative to the work tree ("" at the top)
+    char *target;        // the opened path itself, relative to the work tree
+
+    const unsigned char *map;
+    size_t map_len;
+    long index_mtime;
+    IndexEntry *ents;
+    uint32_t nents;
+    int conflicts;       // any entry at a stage above 0
+    char *names;         // version 4 paths, expanded
+    char *wt;            // per entry: work tree status, 0 until known
+
+    GitObjects *odb;
+    int has_head;
+    uint8_t head[GIT_SHA_LEN];
+
+    StrMap cache_trees;  // dir -> CacheTree
+    StrMap clean_dirs;   // dir -> DIR_CLEAN / DIR_MARKED (proven equal to HEAD)
+    StrMap trees;        // dir -> Tree, or &g_no_tree
+    StrMap staged_dirs;  // dir -> DIR_CLEAN / DIR_MARKED (staged changes below)
+    StrMap modified_dirs; // dir -> DIR_CLEAN / DIR_MARKED (work tree changes below)
+    StrMap ignores;      // dir -> IgnoreList (its .gitignore)
+    StrMap ignored_dirs; // dir -> DIR_CLEAN / DIR_MARKED (excluded)
+    StrMap untracked;    // untracked dir -> DIR_CLEAN / DIR_IGNORED / DIR_MARKED
+    IgnoreList info_exclude;
+    IgnoreList global_exclude;
+
+    // Whether the directory last asked about lies in a submodule.
+    char last_dir[PATH_MAX];
+    size_t last_dir_len;
+    int last_in_submodule;
+};
+
+static Tree g_no_tree;
+static char g_dir_clean, g_dir_ignored, g_dir_marked;
+#define DIR_CLEAN   ((void *)&g_dir_clean)
+#define DIR_IGNORED ((void *)&g_dir_ignored)
+#define DIR_MARKED  ((void *)&g_dir_marked)
+
+static size_t parent_len(const char *path, size_t len) {
+    while (len > 0 && path[len - 1] != '/') len--;
+    return len ? len - 1 : 0;
+}
+
+static char *read_file_at(int dfd, const char *path, size_t *len) {
+    int fd = openat(dfd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    char *buf = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (buf = malloc((size_t)st.st_size + 1)) != NULL) {
+        ssize_t n = read(fd, buf, (size_t)st.st_size);
+        if (n < 0) n = 0;
+        buf[n] = '\0';
+        if (len) *len = (size_t)n;
+    }
+    close(fd);
+    return buf;
+}
+
+// dir + "/" + name into a PATH_MAX buffer; -1 if it does not fit.
+static int join_path(char *out, const char *dir, const char *name) {
+    int n = snprintf(out, PATH_MAX, "%s/%s", dir, name);
+    return n < 0 || n >= PATH_MAX ? -1 : 0;
+}
+
+static char *read_git_file(const char *dir, const char *name) {
+    char path[PATH_MAX];
+    return join_path(path, dir, name) == 0 ? read_file_at(AT_FDCWD, path, NULL) : NULL;
+}
+
+// ---- index ----
+
+static uint32_t be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint16_t be16(const unsigned char *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// The TREE extension: pre-order, each node "path\0count subtrees\n"
+// followed by its id unless count is -1 (invalidated).
+static const unsigned char *parse_cache_tree(GitRepo *g, const unsigned char *p, const unsigned char *end,
+                                             char *path, size_t plen, int depth) {
+    const unsigned char *nul = memchr(p, '\0', (size_t)(end - p));
+    if (!nul || depth > 256) return NULL;
+    size_t nlen = (size_t)(nul - p);
+    if (plen + nlen + 2 > PATH_MAX) return NULL;
+    if (nlen) {
+        if (plen) path[plen++] = '/';
+        memcpy(path + plen, p, nlen);
+        plen += nlen;
+    }
+    path[plen] = '\0';
+
+    char *q;
+    long count = strtol((const char *)nul + 1, &q, 10);
+    long subtrees = strtol(q, &q, 10);
+    if (*q != '\n' || subtrees < 0) return NULL;
+    p = (const unsigned char *)q + 1;
+
+    CacheTree *ct = calloc(1, sizeof(*ct));
+    if (!ct || strmap_put(&g->cache_trees, path, plen, ct) != 0) {
+        free(ct);
+        return NULL;
+    }
+    if (count >= 0) {
+        if (end - p < GIT_SHA_LEN) return NULL;
+        ct->valid = 1;
+        memcpy(ct->sha, p, GIT_SHA_LEN);
+        p += GIT_SHA_LEN;
+    }
+    for (long i = 0; i < subtrees && p; i++) p = parse_cache_tree(g, p, end, path, plen, depth + 1);
+    return p;
+}
+
+static int load_index(GitRepo *g, const char *gitdir) {
+    char path[PATH_MAX];
+    if (join_path(path, gitdir, "index") != 0) return -1;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;   // nothing added yet
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12 + GIT_SHA_LEN) {
+        close(fd);
+        return -1;
+    }
+    g->index_mtime = (long)st.st_mtime;
+    g->map_len = (size_t)st.st_size;
+    void *m = mmap(NULL, g->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return -1;
+    g->map = m;
+
+    const unsigned char *p = g->map, *end = g->map + g->map_len - GIT_SHA_LEN;
+    uint32_t version = be32(p + 4);
+    if (memcmp(p, "DIRC", 4) != 0 || version < 2 || version > 4) return -1;
+    g->nents = be32(p + 8);
+    p += 12;
+
+    g->ents = calloc(g->nents ? g->nents : 1, sizeof(*g->ents));
+    g->wt = calloc(g->nents ? g->nents : 1, 1);
+    if (!g->ents || !g->wt) return -1;
+
+    // Version 4 paths are stored as "drop N bytes of the previous path,
+    // then append this"; expand them into one buffer.
+    size_t names_cap = 0, names_len = 0;
+    const char *prev = "";
+    size_t prev_len = 0;
+    for (uint32_t i = 0; i < g->nents; i++) {
+        const unsigned char *e = p;
+        if (end - e < 62) return -1;
+        IndexEntry *ie = &g->ents[i];
+        // ctime, mtime (seconds, nanoseconds), dev, ino, mode, uid, gid,
+        // size, id, flags.
+        ie->mtime = be32(e + 8);
+        ie->ino   = be32(e + 20);
+        ie->mode  = be32(e + 24);
+        ie->uid   = be32(e + 28);
+        ie->gid   = be32(e + 32);
+        ie->size  = be32(e + 36);
+        ie->sha   = e + 40;
+        ie->flags = be16(e + 60);
+        if (ie->flags & INDEX_STAGE_MASK) g->conflicts = 1;
+        p = e + 62;
+        if (ie->flags & INDEX_EXTENDED) {
+            if (version < 3 || end - p < 2) return -1;
+            ie->xflags = be16(p);
+            p += 2;
+        }
+
+        if (version < 4) {
+            const unsigned char *nul = memchr(p, '\0', (size_t)(end - p));
+            if (!nul) return -1;
+            ie->path = (const char *)p;
+            ie->len = (uint32_t)(nul - p);
+            // Padded with 1-8 NULs to a multiple of 8 from the entry start.
+            p = e + ((size_t)(nul - e) + 8) / 8 * 8;
+        } else {
+            size_t drop = 0;
+            int shift = 0;
+            unsigned char c;
+            do {
+                if (p >= end) return -1;
+                c = *p++;
+                drop = (drop << 7) | (c & 0x7f);
+                if (c & 0x80) drop++;   // git's offset varint
+            } while ((c & 0x80) && ++shift < 10);
+            const unsigned char *nul = memchr(p, '\0', (size_t)(end - p));
+            if (!nul || drop > prev_len) return -1;
+            size_t keep = prev_len - drop, add = (size_t)(nul - p);
+            if (names_len + keep + add + 1 > names_cap) {
+                size_t ncap = names_cap ? names_cap * 2 : 64 * 1024;
+                while (ncap < names_len + keep + add + 1) ncap *= 2;
+                char *nb = realloc(g->names, ncap);
+                if (!nb) return -1;
+                // Re-point the entries already expanded into the old buffer.
+                for (uint32_t k = 0; k < i; k++) g->ents[k].path = nb + (g->ents[k].path - g->names);
+                prev = nb + (prev - g->names);
+                g->names = nb;
+                names_cap = ncap;
+            }
+            char *dst = g->names + names_len;
+            memmove(dst, prev, keep);
+            memcpy(dst + keep, p, add);
+            dst[keep + add] = '\0';
+            ie->path = dst;
+            ie->len = (uint32_t)(keep + add);
+            names_len += keep + add + 1;
+            prev = dst;
+            prev_len = ie->len;
+            p = nul + 1;
+        }
+    }
+
+    // Extensions: 4-byte signature, 4-byte length.
+    while (end - p >= 8) {
+        uint32_t len = be32(p + 4);
+        const unsigned char *body = p + 8;
+        if ((size_t)(end - body) < len) break;
+        if (memcmp(p, "link", 4) == 0) {
+            errno = ENOTSUP;   // split index: most entries live elsewhere
+            return -1;
+        }
+        if (memcmp(p, "TREE", 4) == 0 && len) {
+            char buf[PATH_MAX];
+            parse_cache_tree(g, body, body + len, buf, 0, 0);
+        }
+        p = body + len;
+    }
+    return 0;
+}
+
+static int path_cmp(const char *a, size_t alen, const char *b, size_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c) return c;
+    return (alen > blen) - (alen < blen);
+}
+
+// First entry whose path is not below path (all stages of a path are
+// adjacent, so this also finds the first of them).
+static uint32_t lower_bound(const GitRepo *g, const char *path, size_t len) {
+    uint32_t lo = 0, hi = g->nents;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (path_cmp(g->ents[mid].path, g->ents[mid].len, path, len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int find_entry(const GitRepo *g, const char *path, size_t len, uint32_t *out) {
+    uint32_t i = lower_bound(g, path, len);
+    if (i >= g->nents || g->ents[i].len != len || memcmp(g->ents[i].path, path, len) != 0) return 0;
+    *out = i;
+    return 1;
+}
+
+// Entries below directory dir ("" for the whole index): [*lo, *hi).
+static void dir_range(const GitRepo *g, const char *dir, size_t len, uint32_t *lo, uint32_t *hi) {
+    if (!len) {
+        *lo = 0;
+        *hi = g->nents;
+        return;
+    }
+    char key[PATH_MAX];
+    if (len + 1 >= sizeof(key)) {
+        *lo = *hi = 0;
+        return;
+    }
+    memcpy(key, dir, len);
+    key[len] = '/';
+    *lo = lower_bound(g, key, len + 1);
+    key[len] = '/' + 1;
+    *hi = lower_bound(g, key, len + 1);
+}
+
+// ---- HEAD ----
+
+static int resolve_ref(const char *commondir, const char *gitdir, const char *ref, uint8_t out[GIT_SHA_LEN]) {
+    for (int pass = 0; pass < 2; pass++) {
+        char *s = read_git_file(pass ? commondir : gitdir, ref);
+        if (s) {
+            int rc = gitobj_parse_hex(s, out);
+            free(s);
+            if (rc == 0) return 0;
+        }
+    }
+
+    char *packed = read_git_file(commondir, "packed-refs");
+    if (!packed) return -1;
+    int rc = -1;
+    size_t rlen = strlen(ref);
+    for (char *line = packed; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+        if (strlen(line) > 41 && line[40] == ' ' && strncmp(line + 41, ref, rlen) == 0 &&
+            (line[41 + rlen] == '\n' || line[41 + rlen] == '\0' || line[41 + rlen] == '\r')) {
+            rc = gitobj_parse_hex(line, out);
+            break;
+        }
+    }
+    free(packed);
+    return rc;
+}
+
+static void load_head(GitRepo *g, const char *gitdir, const char *commondir) {
+    char *head = read_git_file(gitdir, "HEAD");
+    if (!head) return;
+
+    uint8_t commit[GIT_SHA_LEN];
+    int rc;
+    if (strncmp(head, "ref: ", 5) == 0) {
+        char *ref = head + 5;
+        ref[strcspn(ref, "\r\n")] = '\0';
+        rc = resolve_ref(commondir, gitdir, ref, commit);
+    } else {
+        rc = gitobj_parse_hex(head, commit);
+    }
+    free(head);
+    if (rc != 0) return;   // unborn branch: everything in the index is added
+
+    unsigned char *data;
+    size_t len;
+    if (gitobj_read(g->odb, commit, &data, &len) != GIT_OBJ_COMMIT) return;
+    if (len > 45 && memcmp(data, "tree ", 5) == 0 && gitobj_parse_hex((char *)data + 5, g->head) == 0) g->has_head = 1;
+    free(data);
+}
+
+static int tree_ent_cmp(const void *a, const void *b) {
+    const TreeEnt *x = a, *y = b;
+    return path_cmp(x->name, x->len, y->name, y->len);
+}
+
+static Tree *parse_tree(unsigned char *data, size_t len) {
+    Tree *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->data = data;
+    int cap = 0;
+    // "<octal mode> <name>\0<20-byte id>" back to back.
+    for (const unsigned char *p = data, *end = data + len; p < end;) {
+        const unsigned char *sp = memchr(p, ' ', (size_t)(end - p));
+        const unsigned char *nul = sp ? memchr(sp, '\0', (size_t)(end - sp)) : NULL;
+        if (!nul || end - nul < 1 + GIT_SHA_LEN) break;
+        if (t->n == cap) {
+            cap = cap ? cap * 2 : 16;
+            TreeEnt *v = realloc(t->ents, (size_t)cap * sizeof(*v));
+            if (!v) break;
+            t->ents = v;
+        }
+        TreeEnt *e = &t->ents[t->n++];
+        e->mode = (uint32_t)strtoul((const char *)p, NULL, 8);
+        e->name = (const char *)sp + 1;
+        e->len = (size_t)(nul - sp - 1);
+        e->sha = nul + 1;
+        p = nul + 1 + GIT_SHA_LEN;
+    }
+    qsort(t->ents, (size_t)t->n, sizeof(*t->ents), tree_ent_cmp);
+    return t;
+}
+
+static void tree_free(void *p) {
+    Tree *t = p;
+    if (t == &g_no_tree) return;
+    free(t->data);
+    free(t->ents);
+    free(t);
+}
+
+static const TreeEnt *tree_find(const Tree *t, const char *name, size_t len) {
+    int lo = 0, hi = t->n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = path_cmp(t->ents[mid].name, t->ents[mid].len, name, len);
+        if (c == 0) return &t->ents[mid];
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+// Id of directory dir in HEAD, or NULL when HEAD has no such tree.
+static const uint8_t *head_dir_sha(GitRepo *g, const char *dir, size_t len);
+
+// HEAD's tree for directory dir, loaded once; NULL if it has none.
+static const Tree *head_tree(GitRepo *g, const char *dir, size_t len) {
+    void **slot = strmap_find(&g->trees, dir, len);
+    if (slot) return *slot == &g_no_tree ? NULL : *slot;
+
+    Tree *t = &g_no_tree;
+    const uint8_t *sha = head_dir_sha(g, dir, len);
+    unsigned char *data;
+    size_t dlen;
+    if (sha && gitobj_read(g->odb, sha, &data, &dlen) == GIT_OBJ_TREE) {
+        t = parse_tree(data, dlen);
+        if (!t) {
+            free(data);
+            t = &g_no_tree;
+        }
+    }
+    if (strmap_put(&g->trees, dir, len, t) != 0) {
+        tree_free(t);
+        return NULL;
+    }
+    return t == &g_no_tree ? NULL : t;
+}
+
+static const uint8_t *head_dir_sha(GitRepo *g, const char *dir, size_t len) {
+    if (!g->has_head) return NULL;
+    if (!len) return g->head;
+    size_t plen = parent_len(dir, len);
+    const Tree *parent = head_tree(g, dir, plen);
+    size_t off = plen ? plen + 1 : 0;
+    const TreeEnt *e = parent ? tree_find(parent, dir + off, len - off) : NULL;
+    return e && (e->mode & 0170000) == 040000 ? e->sha : NULL;
+}
+
+// Whether the index's cached tree for dir, or for a directory above it,
+// proves it equal to HEAD's. Checked from the top down, so HEAD's trees
+// are only read below directories that do have staged changes.
+static int dir_matches_head(GitRepo *g, const char *dir, size_t len) {
+    void **slot = strmap_find(&g->clean_dirs, dir, len);
+    if (slot) return *slot == DIR_MARKED;
+
+    int clean = len && dir_matches_head(g, dir, parent_len(dir, len));
+    if (!clean) {
+        slot = strmap_find(&g->cache_trees, dir, len);
+        const CacheTree *ct = slot ? *slot : NULL;
+        const uint8_t *sha = ct && ct->valid ? head_dir_sha(g, dir, len) : NULL;
+        clean = sha && memcmp(sha, ct->sha, GIT_SHA_LEN) == 0;
+    }
+    strmap_put(&g->clean_dirs, dir, len, clean ? DIR_MARKED : DIR_CLEAN);
+    return clean;
+}
+
+static int same_type(uint32_t a, uint32_t b) {
+    return (a & 0170000) == (b & 0170000);
+}
+
+// Index column for entry k.
+static char staged_entry(GitRepo *g, uint32_t k) {
+    const IndexEntry *e = &g->ents[k];
+    if (e->xflags & INDEX_INTENT_TO_ADD) return ' ';
+    if (!g->has_head) return 'A';
+
+    size_t dlen = parent_len(e->path, e->len);
+    if (dir_matches_head(g, e->path, dlen)) return ' ';
+    const Tree *t = head_tree(g, e->path, dlen);
+    size_t off = dlen ? dlen + 1 : 0;
+    const TreeEnt *te = t ? tree_find(t, e->path + off, e->len - off) : NULL;
+    if (!te) return 'A';
+    if (!same_type(te->mode, e->mode)) return 'T';
+    if (te->mode != e->mode || memcmp(te->sha, e->sha, GIT_SHA_LEN) != 0) return 'M';
+    return ' ';
+}
+
+// Whether anything under dir differs between the index and HEAD: an
+// entry added, changed or removed. Subtrees whose cached tree matches
+// HEAD are skipped without reading them.
+static int staged_below(GitRepo *g, const char *dir, size_t len) {
+    void **slot = strmap_find(&g->staged_dirs, dir, len);
+    if (slot) return *slot == DIR_MARKED;
+
+    int staged = 0;
+    uint32_t lo, hi;
+    dir_range(g, dir, len, &lo, &hi);
+    if (!dir_matches_head(g, dir, len)) {
+        const Tree *t = head_tree(g, dir, len);
+        if (!t) {
+            for (uint32_t k = lo; k < hi && !staged; k++) staged = !(g->ents[k].xflags & INDEX_INTENT_TO_ADD);
+        } else {
+            size_t off = len ? len + 1 : 0;
+            int matched = 0;
+            for (uint32_t k = lo; k < hi && !staged;) {
+                const IndexEntry *e = &g->ents[k];
+                if (e->xflags & INDEX_INTENT_TO_ADD) {   // not staged yet
+                    k++;
+                    continue;
+                }
+                const char *rest = e->path + off;
+                const char *slash = memchr(rest, '/', e->len - off);
+                if (slash) {
+                    size_t sub = (size_t)(slash - e->path);
+                    const TreeEnt *te = tree_find(t, rest, (size_t)(slash - rest));
+                    if (!te || (te->mode & 0170000) != 040000 || staged_below(g, e->path, sub)) staged = 1;
+                    matched++;
+                    uint32_t shi;
+                    dir_range(g, e->path, sub, &k, &shi);
+                    k = shi;
+                } else {
+                    const TreeEnt *te = tree_find(t, rest, e->len - off);
+                    if (!te || te->mode != e->mode || memcmp(te->sha, e->sha, GIT_SHA_LEN) != 0 ||
+                        (e->flags & INDEX_STAGE_MASK)) {
+                        staged = 1;
+                    }
+                    matched++;
+                    k++;
+                }
+            }
+            if (matched != t->n) staged = 1;   // removed from the index
+        }
+    }
+    strmap_put(&g->staged_dirs, dir, len, staged ? DIR_MARKED : DIR_CLEAN);
+    return staged;
+}
+
+// ---- work tree ----
+
+typedef struct {
+    mode_t mode;
+    uint64_t size;
+    long mtime;
+    uint64_t ino;
+    uid_t uid;
+    gid_t gid;
+} WtStat;
+
+static int same_content(GitRepo *g, const IndexEntry *e, const WtStat *s) {
+    uint8_t sha[GIT_SHA_LEN];
+    char path[PATH_MAX];
+    if (e->len >= sizeof(path)) return 0;
+    memcpy(path, e->path, e->len);
+    path[e->len] = '\0';
+
+    if (S_ISLNK(s->mode)) {
+        char target[PATH_MAX];
+        ssize_t n = readlinkat(g->root_fd, path, target, sizeof(target));
+        if (n < 0) return 0;
+        gitobj_hash_blob(target, (size_t)n, sha);
+    } else {
+        int fd = openat(g->root_fd, path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) return 0;
+        int rc = gitobj_hash_blob_fd(fd, s->size, sha);
+        close(fd);
+        if (rc != 0) return 0;
+    }
+    return memcmp(sha, e->sha, GIT_SHA_LEN) == 0;
+}
+
+// Work tree column for entry k, given the file's stat data; remembered.
+static char worktree_entry(GitRepo *g, uint32_t k, const WtStat *s) {
+    if (g->wt[k]) return g->wt[k];
+    const IndexEntry *e = &g->ents[k];
+    char c = ' ';
+    if ((e->flags & INDEX_ASSUME_VALID) || (e->xflags & INDEX_SKIP_WORKTREE) || e->mode == GIT_MODE_GITLINK) {
+        c = ' ';
+    } else if (!s) {
+        c = 'M';   // deleted
+    } else if (e->xflags & INDEX_INTENT_TO_ADD) {
+        c = 'A';
+    } else if (!same_type(e->mode, s->mode)) {
+        c = 'T';
+    } else if ((S_ISREG(s->mode) && (e->mode & 0100) != (s->mode & 0100)) || e->size != (uint32_t)s->size) {
+        c = 'M';
+    } else if (e->mtime != (uint32_t)s->mtime || e->ino != (uint32_t)s->ino || e->uid != (uint32_t)s->uid ||
+               e->gid != (uint32_t)s->gid || (long)e->mtime >= g->index_mtime) {
+        // Touched, replaced, or written in the same second the index
+        // was (racily clean): only the content can tell.
+        c = same_content(g, e, s) ? ' ' : 'M';
+    }
+    g->wt[k] = c;
+    return c;
+}
+
+// Whether any tracked file under dir changed in the work tree. Each
+// directory is opened once and its files are looked up by name in it;
+// the search stops at the first change.
+static int worktree_below(GitRepo *g, const char *dir, size_t len) {
+    void **slot = strmap_find(&g->modified_dirs, dir, len);
+    if (slot) return *slot == DIR_MARKED;
+
+    char path[PATH_MAX];
+    if (len >= sizeof(path)) return 0;
+    memcpy(path, dir, len);
+    path[len] = '\0';
+    int fd = openat(g->root_fd, len ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    uint32_t lo, hi;
+    dir_range(g, dir, len, &lo, &hi);
+    size_t off = len ? len + 1 : 0;
+    int modified = 0;
+    for (uint32_t k = lo; k < hi && !modified;) {
+        const IndexEntry *e = &g->ents[k];
+        const char *name = e->path + off;   // NUL-terminated: the tail of the path
+        const char *slash = memchr(name, '/', e->len - off);
+        if (slash) {
+            size_t sub = (size_t)(slash - e->path);
+            modified = worktree_below(g, e->path, sub);
+            uint32_t shi;
+            dir_range(g, e->path, sub, &k, &shi);
+            k = shi;
+            continue;
+        }
+        struct stat st;
+        if (fd < 0 || fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            modified = worktree_entry(g, k, NULL) != ' ';
+        } else {
+            WtStat ws = { st.st_mode, (uint64_t)st.st_size, (long)st.st_mtime, (uint64_t)st.st_ino,
+                          st.st_uid, st.st_gid };
+            modified = worktree_entry(g, k, &ws) != ' ';
+        }
+        k++;
+    }
+    if (fd >= 0) close(fd);
+    strmap_put(&g->modified_dirs, dir, len, modified ? DIR_MARKED : DIR_CLEAN);
+    return modified;
+}
+
+// ---- ignore rules ----
+
+static int wildmatch(const char *p, const char *s, const char *pstart);
+
+static int match_class(const char **pp, char c) {
+    const char *p = *pp + 1;
+    int negate = (*p == '!' || *p == '^');
+    if (negate) p++;
+    int hit = 0;
+    for (int first = 1; *p && (first || *p != ']'); first = 0, p++) {
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            if (c >= p[0] && c <= p[2]) hit = 1;
+            p += 2;
+        } else if (*p == c) {
+            hit = 1;
+        }
+    }
+    if (*p != ']') return -1;   // unterminated: a literal '['
+    *pp = p;
+    return hit != negate;
+}
+
+// fnmatch(FNM_PATHNAME) plus "**": a leading "**/", a trailing "/**"
+// and an inner "/**/" match any number of directories.
+static int wildmatch(const char *p, const char *s, const char *pstart) {
+    for (; *p; p++, s++) {
+        if (*p == '*') {
+            if (p[1] == '*' && (p == pstart || p[-1] == '/') && (p[2] == '/' || p[2] == '\0')) {
+                if (p[2] == '\0') return 1;
+                for (const char *t = s;; t++) {
+                    if (wildmatch(p + 3, t, pstart)) return 1;
+                    t = strchr(t, '/');
+                    if (!t) return 0;
+                }
+            }
+            while (*p == '*') p++;
+            for (const char *t = s;; t++) {
+                if (wildmatch(p, t, pstart)) return 1;
+                if (*t == '\0' || *t == '/') return 0;
+            }
+        }
+        if (*s == '\0') return 0;
+        if (*p == '?') {
+            if (*s == '/') return 0;
+            continue;
+        }
+        if (*p == '[' && *s != '/') {
+            const char *q = p;
+            int m = match_class(&q, *s);
+            if (m >= 0) {
+                if (!m) return 0;
+                p = q;
+                continue;
+            }
+        }
+        if (*p == '\\' && p[1]) p++;
+        if (*p != *s) return 0;
+    }
+    return *s == '\0';
+}
+
+static void parse_ignores(IgnoreList *l, char *text) {
+    l->text = text;
+    if (!text) return;
+    int cap = 0;
+    for (char *line = text; line && *line;) {
+        char *nl = strchr(line, '\n');
+        if (nl) *nl = '\0';
+        char *next = nl ? nl + 1 : NULL;
+
+        size_t n = strlen(line);
+        if (n && line[n - 1] == '\r') line[--n] = '\0';
+        while (n && line[n - 1] == ' ' && !(n > 1 && line[n - 2] == '\\')) line[--n] = '\0';
+        if (!n || line[0] == '#') {
+            line = next;
+            continue;
+        }
+
+        IgnoreRule r = { line, 0, 0, 0 };
+        if (*r.pat == '!') {
+            r.negate = 1;
+            r.pat++;
+        } else if (*r.pat == '\\' && (r.pat[1] == '!' || r.pat[1] == '#')) {
+            r.pat++;
+        }
+        n = strlen(r.pat);
+        if (n && r.pat[n - 1] == '/') {
+            r.dir_only = 1;
+            r.pat[--n] = '\0';
+        }
+        if (strchr(r.pat, '/')) r.has_slash = 1;
+        if (*r.pat == '/') r.pat++;
+        if (*r.pat) {
+            if (l->n == cap) {
+                cap = cap ? cap * 2 : 16;
+                IgnoreRule *v = realloc(l->v, (size_t)cap * sizeof(*v));
+                if (!v) break;
+                l->v = v;
+            }
+            l->v[l->n++] = r;
+        }
+        line = next;
+    }
+}
+
+static void ignores_free(void *p) {
+    IgnoreList *l = p;
+    free(l->v);
+    free(l->text);
+    free(l);
+}
+
+// 1 excluded, 0 re-included by a '!' rule, -1 no rule matched. rel is
+// the path relative to the list's directory; the last match wins.
+static int match_ignores(const IgnoreList *l, const char *rel, const char *base, int is_dir) {
+    for (int i = l->n - 1; i >= 0; i--) {
+        const IgnoreRule *r = &l->v[i];
+        if (r->dir_only && !is_dir) continue;
+        if (wildmatch(r->pat, r->has_slash ? rel : base, r->pat)) return !r->negate;
+    }
+    return -1;
+}
+
+static const IgnoreList *dir_ignores(GitRepo *g, const char *dir, size_t len) {
+    void **slot = strmap_find(&g->ignores, dir, len);
+    if (slot) return *slot;
+
+    IgnoreList *l = calloc(1, sizeof(*l));
+    if (!l) return NULL;
+    char path[PATH_MAX];
+    int n = snprintf(path, sizeof(path), "%.*s%s.gitignore", (int)len, dir, len ? "/" : "");
+    if (n > 0 && n < (int)sizeof(path)) parse_ignores(l, read_file_at(g->root_fd, path, NULL));
+    if (strmap_put(&g->ignores, dir, len, l) != 0) {
+        ignores_free(l);
+        return NULL;
+    }
+    return l;
+}
+
+// Whether the rules exclude the first len bytes of path.
+static int excluded(GitRepo *g, const char *full, size_t len, int is_dir) {
+    char path[PATH_MAX];
+    memcpy(path, full, len);
+    path[len] = '\0';
+    size_t blen = parent_len(path, len);
+    const char *base = path + (blen ? blen + 1 : 0);
+    for (size_t d = blen;; d = parent_len(path, d)) {
+        const IgnoreList *l = dir_ignores(g, path, d);
+        int r = l ? match_ignores(l, path + (d ? d + 1 : 0), base, is_dir) : -1;
+        if (r >= 0) return r;
+        if (!d) break;
+    }
+    int r = match_ignores(&g->info_exclude, path, base, is_dir);
+    if (r < 0) r = match_ignores(&g->global_exclude, path, base, is_dir);
+    return r > 0;
+}
+
+// git does not look inside an ignored directory, so neither do its rules.
+static int dir_ignored(GitRepo *g, const char *dir, size_t len) {
+    if (!len) return 0;
+    void **slot = strmap_find(&g->ignored_dirs, dir, len);
+    if (slot) return *slot == DIR_MARKED;
+    int ign = dir_ignored(g, dir, parent_len(dir, len)) || excluded(g, dir, len, 1);
+    strmap_put(&g->ignored_dirs, dir, len, ign ? DIR_MARKED : DIR_CLEAN);
+    return ign;
+}
+
+static int is_ignored(GitRepo *g, const char *path, size_t len, int is_dir) {
+    return dir_ignored(g, path, parent_len(path, len)) || excluded(g, path, len, is_dir);
+}
+
+// What the directory path (len bytes of a PATH_MAX buffer, not ignored
+// and with nothing tracked below) holds, as git reports it: DIR_MARKED
+// for a file that is untracked, else DIR_IGNORED if there are ignored
+// files, else DIR_CLEAN (git does not list empty directories). Stops
+// at the first untracked file.
+static void *untracked_dir(GitRepo *g, char *path, size_t len, int depth) {
+    void **slot = strmap_find(&g->untracked, path, len);
+    if (slot) return *slot;
+
+    void *state = DIR_CLEAN;
+    path[len] = '\0';
+    int fd = openat(g->root_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d && fd >= 0) close(fd);
+    struct dirent *de;
+    while (d && state != DIR_MARKED && (de = readdir(d)) != NULL) {
+        const char *name = de->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        size_t n = strlen(name);
+        if (len + 1 + n >= PATH_MAX) continue;
+
+        int is_dir = de->d_type == DT_DIR;
+        if (de->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (is_dir && strcmp(name, ".git") == 0) {
+            state = DIR_MARKED;   // a nested repository
+            break;
+        }
+
+        path[len] = '/';
+        memcpy(path + len + 1, name, n + 1);
+        void *sub;
+        if (excluded(g, path, len + 1 + n, is_dir)) sub = DIR_IGNORED;
+        else if (!is_dir) sub = DIR_MARKED;
+        else sub = depth < 64 ? untracked_dir(g, path, len + 1 + n, depth + 1) : DIR_MARKED;
+        if (sub != DIR_CLEAN) state = sub;
+        path[len] = '\0';
+    }
+    if (d) closedir(d);
+    strmap_put(&g->untracked, path, len, state);
+    return state;
+}
+
+// ---- open / status ----
+
+// Find the work tree at or above the directory abs: its length in abs,
+// and its git directory in gitdir (PATH_MAX bytes).
+static int find_worktree(const char *abs, size_t *wt_len, char *gitdir) {
+    size_t len = strlen(abs);
+    for (;;) {
+        char cur[PATH_MAX], dotgit[PATH_MAX];
+        memcpy(cur, abs, len);
+        cur[len] = '\0';
+        struct stat st;
+        if (join_path(dotgit, cur, ".git") == 0 && lstat(dotgit, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                memcpy(gitdir, dotgit, strlen(dotgit) + 1);
+                *wt_len = len;
+                return 0;
+            }
+            // Linked work tree or submodule: "gitdir: <path>".
+            char *s = S_ISREG(st.st_mode) ? read_file_at(AT_FDCWD, dotgit, NULL) : NULL;
+            int rc = -1;
+            if (s && strncmp(s, "gitdir: ", 8) == 0) {
+                char *gd = s + 8;
+                gd[strcspn(gd, "\r\n")] = '\0';
+                rc = gd[0] == '/' ? join_path(gitdir, "", gd + 1) : join_path(gitdir, cur, gd);
+            }
+            free(s);
+            if (rc == 0) {
+                *wt_len = len;
+                return 0;
+            }
+        }
+        if (len <= 1) return -1;
+        len = parent_len(abs, len);
+        if (!len) len = 1;   // "/"
+    }
+}
+
+static int uses_sha256(const char *commondir) {
+    char *cfg = read_git_file(commondir, "config");
+    int sha256 = 0;
+    if (cfg) {
+        for (char *p = cfg; *p; p++) *p = (char)(*p >= 'A' && *p <= 'Z' ? *p + 32 : *p);
+        char *o = strstr(cfg, "objectformat");
+        if (o) {
+            o[strcspn(o, "\n")] = '\0';
+            sha256 = strstr(o, "sha256") != NULL;
+        }
+        free(cfg);
+    }
+    return sha256;
+}
+
+GitRepo *gitrepo_open(const char *path) {
+    char abs[PATH_MAX];
+    struct stat st;
+    if (!realpath(path, abs) || stat(abs, &st) != 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+    size_t abs_len = strlen(abs);
+    char dir[PATH_MAX];
+    memcpy(dir, abs, abs_len + 1);
+    if (!S_ISDIR(st.st_mode)) {
+        size_t d = parent_len(dir, abs_len);
+        dir[d ? d : 1] = '\0';
+    }
+
+    char gitdir[PATH_MAX], commondir[PATH_MAX];
+    size_t wt_len;
+    if (find_worktree(dir, &wt_len, gitdir) != 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+    // Linked work trees share objects, refs and config with the main one.
+    char *cd = read_git_file(gitdir, "commondir");
+    int rc = 0;
+    if (cd) {
+        cd[strcspn(cd, "\r\n")] = '\0';
+        if (cd[0] == '/') rc = join_path(commondir, "", cd + 1);
+        else rc = join_path(commondir, gitdir, cd);
+        free(cd);
+    } else {
+        memcpy(commondir, gitdir, strlen(gitdir) + 1);
+    }
+    if (rc != 0) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    if (uses_sha256(commondir)) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+
+    GitRepo *g = calloc(1, sizeof(*g));
+    if (!g) return NULL;
+    g->root_fd = -1;
+
+    const char *rel = abs + wt_len;
+    while (*rel == '/') rel++;
+    const char *prel = dir + wt_len;
+    while (*prel == '/') prel++;
+    g->target = strdup(rel);
+    g->prefix = strdup(prel);
+    dir[wt_len] = '\0';
+    g->root_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    char objects[PATH_MAX];
+    if (join_path(objects, commondir, "objects") == 0) g->odb = gitobj_open(objects);
+    if (!g->target || !g->prefix || g->root_fd < 0 || !g->odb) goto fail;
+
+    errno = EINVAL;   // unless the failing call says otherwise
+    if (load_index(g, gitdir) != 0) goto fail;
+    load_head(g, gitdir, commondir);
+
+    parse_ignores(&g->info_exclude, read_git_file(commondir, "info/exclude"));
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && *xdg) parse_ignores(&g->global_exclude, read_git_file(xdg, "git/ignore"));
+    else if (home) parse_ignores(&g->global_exclude, read_git_file(home, ".config/git/ignore"));
+    return g;
+
+fail:;
+    int err = errno;
+    gitrepo_close(g);
+    errno = err;
+    return NULL;
+}
+
+void gitrepo_close(GitRepo *g) {
+    if (!g) return;
+    if (g->root_fd >= 0) close(g->root_fd);
+    if (g->map) munmap((void *)g->map, g->map_len);
+    free(g->ents);
+    free(g->names);
+    free(g->wt);
+    gitobj_close(g->odb);
+    strmap_free(&g->cache_trees, free);
+    strmap_free(&g->trees, tree_free);
+    strmap_free(&g->clean_dirs, NULL);
+    strmap_free(&g->staged_dirs, NULL);
+    strmap_free(&g->modified_dirs, NULL);
+    strmap_free(&g->ignores, ignores_free);
+    strmap_free(&g->ignored_dirs, NULL);
+    strmap_free(&g->untracked, NULL);
+    free(g->info_exclude.v);
+    free(g->info_exclude.text);
+    free(g->global_exclude.v);
+    free(g->global_exclude.text);
+    free(g->prefix);
+    free(g->target);
+    free(g);
+}
+
+// Repository-relative path of the entry; -1 if it lies outside.
+static int entry_path(const GitRepo *g, const char *rel, const FileItem *item, char *out, size_t outsz) {
+    int n;
+    if (!rel) {
+        n = snprintf(out, outsz, "%s", g->target);
+    } else {
+        n = snprintf(out, outsz, "%s%s%s", g->prefix, *g->prefix && *rel ? "/" : "", rel);
+        if (n < 0 || (size_t)n >= outsz) return -1;
+        if (strcmp(item->name, "..") == 0) {
+            if (!n) return -1;
+            n = (int)parent_len(out, (size_t)n);
+        } else if (strcmp(item->name, ".") != 0) {
+            n += snprintf(out + n, outsz - (size_t)n, "%s%s", n ? "/" : "", item->name);
+        }
+    }
+    if (n < 0 || (size_t)n >= outsz) return -1;
+    out[n] = '\0';
+    return n;
+}
+
+// Whether a submodule, which has its own status, contains path.
+static int in_submodule(GitRepo *g, const char *path, size_t len) {
+    size_t dlen = parent_len(path, len);
+    if (dlen == g->last_dir_len && memcmp(path, g->last_dir, dlen) == 0) return g->last_in_submodule;
+
+    int in = 0;
+    for (size_t d = dlen; d && !in; d = parent_len(path, d)) {
+        uint32_t k;
+        in = find_entry(g, path, d, &k) && g->ents[k].mode == GIT_MODE_GITLINK;
+    }
+    memcpy(g->last_dir, path, dlen);
+    g->last_dir_len = dlen;
+    g->last_in_submodule = in;
+    return in;
+}
+
+void gitrepo_status(GitRepo *g, const char *rel, const FileItem *item, int rollup, char out[2]) {
+    out[0] = out[1] = ' ';
+    char path[PATH_MAX];
+    int n = entry_path(g, rel, item, path, sizeof(path));
+    if (n < 0) return;
+    size_t len = (size_t)n;
+    // git never lists its own directory.
+    if (strcmp(item->name, ".git") == 0 || strncmp(path, ".git/", 5) == 0 || strstr(path, "/.git/")) return;
+    if (in_submodule(g, path, len)) return;
+
+    uint32_t k;
+    if (len && find_entry(g, path, len, &k)) {
+        if (g->ents[k].flags & INDEX_STAGE_MASK) {
+            out[0] = out[1] = 'U';
+            return;
+        }
+        out[0] = staged_entry(g, k);
+        WtStat s = { item->mode, (uint64_t)item->size, (long)item->mtime, (uint64_t)item->inode,
+                     item->uid, item->gid };
+        out[1] = worktree_entry(g, k, &s);
+        return;
+    }
+
+    uint32_t lo = 0, hi = 0;
+    if (S_ISDIR(item->mode)) dir_range(g, path, len, &lo, &hi);
+    if (lo == hi) {
+        void *state = DIR_MARKED;
+        if (is_ignored(g, path, len, S_ISDIR(item->mode))) state = DIR_IGNORED;
+        else if (S_ISDIR(item->mode)) state = untracked_dir(g, path, len, 0);
+        if (state != DIR_CLEAN) out[0] = out[1] = state == DIR_IGNORED ? '!' : '?';
+        return;
+    }
+    if (!rollup) return;
+
+    for (k = lo; g->conflicts && k < hi; k++) {
+        if (g->ents[k].flags & INDEX_STAGE_MASK) {
+            out[0] = out[1] = 'U';
+            return;
+        }
+    }
+    if (staged_below(g, path, len)) out[0] = 'M';
+    if (worktree_below(g, path, len)) out[1] = 'M';
+}
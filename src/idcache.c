@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pwd.h>
+#include <grp.h>
+
+#include "idcache.h"
+#include "stats.h"
+
+typedef struct {
+    unsigned int id;
+    int used;
+    char *name;  // NULL: looked up, no such id
+} IdSlot;
+
+typedef struct {
+    IdSlot *slots;
+    size_t cap;   // power of two
+    size_t count;
+} IdTable;
+
+static IdTable g_users;
+static IdTable g_groups;
+static IdCacheStats g_stats;
+
+static size_t hash_id(unsigned int id) {
+    // Fibonacci hashing; ids are often small and sequential.
+    return (size_t)((id * 2654435769u) >> 7);
+}
+
+static IdSlot *table_find(IdTable *t, unsigned int id) {
+    if (!t->cap) return NULL;
+    size_t mask = t->cap - 1;
+    for (size_t i = hash_id(id) & mask;; i = (i + 1) & mask) {
+        IdSlot *s = &t->slots[i];
+        if (!s->used) return NULL;
+        if (s->id == id) return s;
+    }
+}
+
+static int table_grow(IdTable *t) {
+    size_t ncap = t->cap ? t->cap * 2 : 64;
+    IdSlot *ns = calloc(ncap, sizeof(*ns));
+    if (!ns) return -1;
+
+    for (size_t k = 0; k < t->cap; k++) {
+        IdSlot *s = &t->slots[k];
+        if (!s->used) continue;
+        size_t i = hash_id(s->id) & (ncap - 1);
+        while (ns[i].used) i = (i + 1) & (ncap - 1);
+        ns[i] = *s;
+    }
+    free(t->slots);
+    t->slots = ns;
+    t->cap = ncap;
+    return 0;
+}
+
+static IdSlot *table_insert(IdTable *t, unsigned int id, const char *name) {
+    if ((t->count + 1) * 4 > t->cap * 3 && table_grow(t) != 0) return NULL;
+
+    size_t mask = t->cap - 1;
+    size_t i = hash_id(id) & mask;
+    while (t->slots[i].used) {
+        if (t->slots[i].id == id) return &t->slots[i];
+        i = (i + 1) & mask;
+    }
+
+    IdSlot *s = &t->slots[i];
+    s->id = id;
+    s->used = 1;
+    s->name = NULL;
+    if (name) {
+        size_t n = strlen(name) + 1;
+        s->name = malloc(n);
+        if (s->name) memcpy(s->name, name, n);
+    }
+    t->count++;
+    return s;
+}
+
+static void table_free(IdTable *t) {
+    for (size_t k = 0; k < t->cap; k++) free(t->slots[k].name);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+const char *idcache_user(uid_t uid) {
+    g_stats.user_lookups++;
+    IdSlot *s = table_find(&g_users, (unsigned int)uid);
+    if (s) return s->name;
+
+    g_stats.user_nss++;
+    uint64_t t0 = stats_start();
+    struct passwd *pw = getpwuid(uid);
+    stats_stop(STATS_IDS, t0);
+    s = table_insert(&g_users, (unsigned int)uid, pw ? pw->pw_name : NULL);
+    if (s) return s->name;
+    return pw ? pw->pw_name : NULL;
+}
+
+const char *idcache_group(gid_t gid) {
+    g_stats.group_lookups++;
+    IdSlot *s = table_find(&g_groups, (unsigned int)gid);
+    if (s) return s->name;
+
+    g_stats.group_nss++;
+    uint64_t t0 = stats_start();
+    struct group *gr = getgrgid(gid);
+    stats_stop(STATS_IDS, t0);
+    s = table_insert(&g_groups, (unsigned int)gid, gr ? gr->gr_name : NULL);
+    if (s) return s->name;
+    return gr ? gr->gr_name : NULL;
+}
+
+void idcache_preload_all(void) {
+    uint64_t t0 = stats_start();
+    struct passwd *pw;
+    setpwent();
+    while ((pw = getpwent()) != NULL) {
+        // First entry wins, matching what getpwuid would return.
+        if (!table_find(&g_users, (unsigned int)pw->pw_uid)) {
+            table_insert(&g_users, (unsigned int)pw->pw_uid, pw->pw_name);
+        }
+    }
+    endpwent();
+
+    struct group *gr;
+    setgrent();
+    while ((gr = getgrent()) != NULL) {
+        if (!table_find(&g_groups, (unsigned int)gr->gr_gid)) {
+            table_insert(&g_groups, (unsigned int)gr->gr_gid, gr->gr_name);
+        }
+    }
+    endgrent();
+    stats_stop(STATS_IDS, t0);
+}
+
+void idcache_get_stats(IdCacheStats *out) {
+    *out = g_stats;
+}
+
+void idcache_free(void) {
+    table_free(&g_users);
+    table_free(&g_groups);
+}
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "inoset.h"
+
+#define STRIPE_BITS 6
+#define NSTRIPES (1u << STRIPE_BITS)
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    int used;
+} InoSlot;
+
+typedef struct {
+    pthread_mutex_t mu;
+    InoSlot *slots;
+    size_t cap;    // power of two
+    size_t count;
+} Stripe;
+
+struct InoSet {
+    Stripe stripes[NSTRIPES];
+};
+
+static uint64_t mix(uint64_t dev, uint64_t ino) {
+    // splitmix64 finalizer over both halves
+    uint64_t x = ino ^ (dev * 0x9E3779B97F4A7C15ull);
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+InoSet *inoset_new(void) {
+    InoSet *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    for (unsigned i = 0; i < NSTRIPES; i++) pthread_mutex_init(&s->stripes[i].mu, NULL);
+    return s;
+}
+
+void inoset_free(InoSet *s) {
+    if (!s) return;
+    for (unsigned i = 0; i < NSTRIPES; i++) {
+        pthread_mutex_destroy(&s->stripes[i].mu);
+        free(s->stripes[i].slots);
+    }
+    free(s);
+}
+
+static InoSlot *stripe_find(Stripe *st, uint64_t h, uint64_t dev, uint64_t ino) {
+    size_t mask = st->cap - 1;
+    size_t i = (size_t)h & mask;
+    while (st->slots[i].used) {
+        if (st->slots[i].dev == dev && st->slots[i].ino == ino) return &st->slots[i];
+        i = (i + 1) & mask;
+    }
+    return &st->slots[i];
+}
+
+static int stripe_grow(Stripe *st) {
+    size_t ncap = st->cap ? st->cap * 2 : 64;
+    InoSlot *old = st->slots;
+    size_t ocap = st->cap;
+
+    st->slots = calloc(ncap, sizeof(*st->slots));
+    if (!st->slots) {
+        st->slots = old;
+        return -1;
+    }
+    st->cap = ncap;
+    for (size_t i = 0; i < ocap; i++) {
+        if (!old[i].used) continue;
+        *stripe_find(st, mix(old[i].dev, old[i].ino), old[i].dev, old[i].ino) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+int inoset_insert(InoSet *s, dev_t dev, ino_t ino) {
+    uint64_t h = mix((uint64_t)dev, (uint64_t)ino);
+    Stripe *st = &s->stripes[h >> (64 - STRIPE_BITS)];
+
+    pthread_mutex_lock(&st->mu);
+    int rc;
+    if ((st->count + 1) * 4 > st->cap * 3 && stripe_grow(st) != 0) {
+        rc = -1;
+    } else {
+        InoSlot *slot = stripe_find(st, h, (uint64_t)dev, (uint64_t)ino);
+        if (slot->used) {
+            rc = 0;
+        } else {
+            slot->dev = (uint64_t)dev;
+            slot->ino = (uint64_t)ino;
+            slot->used = 1;
+            st->count++;
+            rc = 1;
+        }
+    }
+    pthread_mutex_unlock(&st->mu);
+    return rc;
+}
@@ -0,0 +1,425 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "lscolors.h"
+
+typedef enum {
+    K_NO, K_FI, K_DI, K_LN, K_PI, K_SO, K_BD, K_CD,
+    K_SU, K_SG, K_TW, K_OW, K_ST, K_EX, K_MH, K_HI,
+    K_COUNT
+} Key;
+
+static const char g_key_names[K_COUNT][3] = {
+    "no", "fi", "di", "ln", "pi", "so", "bd", "cd",
+    "su", "sg", "tw", "ow", "st", "ex", "mh", "hi",
+};
+
+// lsx's own palette, byte for byte what it printed before LS_COLORS.
+static const char *const g_builtin[K_COUNT] = {
+    [K_NO] = "\033[0m",
+    [K_DI] = "\033[36m\033[1m",
+    [K_LN] = "\033[35m\033[1m",
+    [K_EX] = "\033[32m\033[1m",
+    [K_HI] = "\033[2m\033[35m",
+};
+
+// Longest extension or suffix rule considered; longer ones are skipped.
+#define MAX_SUFFIX 255
+
+typedef struct {
+    char *suffix;     // folded to lower case, without the '*'
+    size_t len;
+    const char *seq;  // NULL: cleared by a later empty rule
+} Rule;
+
+// Rules sharing the text after their last dot, longest suffix first.
+typedef struct {
+    const char *ext;  // points into the first rule's suffix
+    size_t len;
+    int first;
+    int count;
+} ExtKey;
+
+struct LsColors {
+    const char *slot[K_COUNT];
+
+    Rule *rules;      // grouped by ExtKey, then the rules without a dot
+    int nrules;
+    int ext_rules;    // rules[0..ext_rules) belong to an ExtKey
+
+    // Hash-and-displace perfect hash over keys: bucket b is placed with
+    // seed disp[b], and slot_key maps each slot to a key or -1.
+    ExtKey *keys;
+    int nkeys;
+    uint32_t nbuckets;
+    uint32_t *disp;
+    uint32_t slot_mask;
+    int32_t *slot_key;
+
+    char *seqs;       // every escape sequence, back to back
+};
+
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+static int fold_equal(const char *a, const char *b, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        if (fold((unsigned char)a[i]) != fold((unsigned char)b[i])) return 0;
+    return 1;
+}
+
+static uint64_t fold_hash(const char *s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;  // FNV-1a
+    for (size_t i = 0; i < n; i++) {
+        h ^= fold((unsigned char)s[i]);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint32_t hash_bucket(uint64_t h, uint32_t nbuckets) {
+    return (uint32_t)(mix(h) % nbuckets);
+}
+
+static uint32_t hash_slot(uint64_t h, uint32_t seed, uint32_t mask) {
+    return (uint32_t)mix(h ^ (seed * 0x9E3779B97F4A7C15ULL)) & mask;
+}
+
+// ---- parse ----
+
+typedef struct {
+    Rule *v;
+    int n;
+    int cap;
+} RuleVec;
+
+static int valid_value(const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        if (!((s[i] >= '0' && s[i] <= '9') || s[i] == ';')) return 0;
+    return 1;
+}
+
+// Escape sequences are appended to one buffer sized for the worst case
+// up front, so the pointers handed out stay valid.
+typedef struct {
+    char *buf;
+    size_t len;
+} SeqPool;
+
+static const char *pool_seq(SeqPool *p, const char *val, size_t n) {
+    char *s = p->buf + p->len;
+    memcpy(s, "\033[", 2);
+    memcpy(s + 2, val, n);
+    s[n + 2] = 'm';
+    s[n + 3] = '\0';
+    p->len += n + 4;
+    return s;
+}
+
+static int add_rule(RuleVec *rv, const char *suffix, size_t len, const char *seq) {
+    for (int i = 0; i < rv->n; i++) {
+        if (rv->v[i].len == len && fold_equal(rv->v[i].suffix, suffix, len)) {
+            rv->v[i].seq = seq;
+            return 0;
+        }
+    }
+    if (rv->n == rv->cap) {
+        int ncap = rv->cap ? rv->cap * 2 : 64;
+        Rule *p = realloc(rv->v, (size_t)ncap * sizeof(*p));
+        if (!p) return -1;
+        rv->v = p;
+        rv->cap = ncap;
+    }
+    char *s = malloc(len + 1);
+    if (!s) return -1;
+    for (size_t i = 0; i < len; i++) s[i] = (char)fold((unsigned char)suffix[i]);
+    s[len] = '\0';
+    rv->v[rv->n++] = (Rule){ s, len, seq };
+    return 0;
+}
+
+static int apply_spec(LsColors *c, RuleVec *rv, SeqPool *pool, const char *spec) {
+    const char *p = spec;
+    while (*p) {
+        const char *end = strchr(p, ':');
+        if (!end) end = p + strlen(p);
+        const char *eq = memchr(p, '=', (size_t)(end - p));
+        if (eq) {
+            const char *val = eq + 1;
+            size_t vlen = (size_t)(end - val);
+            size_t klen = (size_t)(eq - p);
+            if (valid_value(val, vlen)) {
+                const char *seq = vlen ? pool_seq(pool, val, vlen) : NULL;
+                if (klen > 1 && p[0] == '*' && klen - 1 <= MAX_SUFFIX) {
+                    if (add_rule(rv, p + 1, klen - 1, seq) != 0) return -1;
+                } else if (klen == 2) {
+                    for (int k = 0; k < K_COUNT; k++)
+                        if (p[0] == g_key_names[k][0] && p[1] == g_key_names[k][1]) c->slot[k] = seq;
+                }
+            }
+        }
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+// ---- compile ----
+
+static const char *ext_of(const char *s, size_t len, size_t *elen) {
+    for (size_t i = len; i > 0; i--) {
+        if (s[i - 1] == '.') {
+            *elen = len - i;
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+static int rule_order(const void *a, const void *b) {
+    const Rule *x = a, *y = b;
+    size_t xl, yl;
+    const char *xe = ext_of(x->suffix, x->len, &xl);
+    const char *ye = ext_of(y->suffix, y->len, &yl);
+    // Rules with a dot first, grouped by extension, longest suffix first.
+    if (!xe || !ye) return (xe == NULL) - (ye == NULL);
+    int d = strcmp(xe, ye);
+    if (d) return d;
+    return (x->len < y->len) - (x->len > y->len);
+}
+
+typedef struct {
+    uint32_t bucket;
+    int count;
+} BucketSize;
+
+static int bucket_size_order(const void *a, const void *b) {
+    const BucketSize *x = a, *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+// Place every bucket's keys in free slots with the first seed that
+// spreads them without collisions; returns -1 if some bucket found none,
+// -2 when out of memory.
+static int place_buckets(LsColors *c, const uint64_t *hashes, const uint32_t *key_bucket) {
+    BucketSize *order = calloc(c->nbuckets, sizeof(*order));
+    int *members = malloc((size_t)c->nkeys * sizeof(*members));
+    uint32_t *tried = malloc((size_t)c->nkeys * sizeof(*tried));
+    if (!order || !members || !tried) {
+        free(order);
+        free(members);
+        free(tried);
+        return -2;
+    }
+    for (uint32_t b = 0; b < c->nbuckets; b++) order[b].bucket = b;
+    for (int k = 0; k < c->nkeys; k++) order[key_bucket[k]].count++;
+    qsort(order, c->nbuckets, sizeof(*order), bucket_size_order);
+
+    int rc = 0;
+    for (uint32_t i = 0; i < c->nbuckets && order[i].count; i++) {
+        uint32_t b = order[i].bucket;
+        int n = 0;
+        for (int k = 0; k < c->nkeys; k++)
+            if (key_bucket[k] == b) members[n++] = k;
+
+        uint32_t seed;
+        for (seed = 1; seed < 65536; seed++) {
+            int ok = 1;
+            for (int j = 0; j < n && ok; j++) {
+                uint32_t s = hash_slot(hashes[members[j]], seed, c->slot_mask);
+                if (c->slot_key[s] >= 0) ok = 0;
+                for (int q = 0; q < j && ok; q++)
+                    if (tried[q] == s) ok = 0;
+                tried[j] = s;
+            }
+            if (ok) break;
+        }
+        if (seed == 65536) {
+            rc = -1;
+            break;
+        }
+        c->disp[b] = seed;
+        for (int j = 0; j < n; j++) c->slot_key[tried[j]] = members[j];
+    }
+    free(order);
+    free(members);
+    free(tried);
+    return rc;
+}
+
+static int build_hash(LsColors *c) {
+    if (!c->nkeys) return 0;
+    uint64_t *hashes = malloc((size_t)c->nkeys * sizeof(*hashes));
+    uint32_t *key_bucket = malloc((size_t)c->nkeys * sizeof(*key_bucket));
+    if (!hashes || !key_bucket) {
+        free(hashes);
+        free(key_bucket);
+        return -1;
+    }
+    for (int k = 0; k < c->nkeys; k++) hashes[k] = fold_hash(c->keys[k].ext, c->keys[k].len);
+
+    // About two keys per bucket and a table at least twice the key count
+    // place on the first few seeds; grow the table if one ever does not.
+    c->nbuckets = (uint32_t)c->nkeys / 2 + 1;
+    for (int k = 0; k < c->nkeys; k++) key_bucket[k] = hash_bucket(hashes[k], c->nbuckets);
+    uint32_t nslots = 4;
+    while (nslots < (uint32_t)c->nkeys * 2) nslots *= 2;
+
+    int rc = -1;
+    for (int attempt = 0; attempt < 8; attempt++, nslots *= 2) {
+        free(c->disp);
+        free(c->slot_key);
+        c->disp = calloc(c->nbuckets, sizeof(*c->disp));
+        c->slot_key = malloc(nslots * sizeof(*c->slot_key));
+        if (!c->disp || !c->slot_key) break;
+        for (uint32_t s = 0; s < nslots; s++) c->slot_key[s] = -1;
+        c->slot_mask = nslots - 1;
+        rc = place_buckets(c, hashes, key_bucket);
+        if (rc != -1) break;
+    }
+    free(hashes);
+    free(key_bucket);
+    return rc == 0 ? 0 : -1;
+}
+
+static int compile(LsColors *c, RuleVec *rv) {
+    c->rules = rv->v;
+    c->nrules = rv->n;
+    if (!c->nrules) return 0;
+    qsort(c->rules, (size_t)c->nrules, sizeof(*c->rules), rule_order);
+
+    c->keys = malloc((size_t)c->nrules * sizeof(*c->keys));
+    if (!c->keys) return -1;
+    for (int i = 0; i < c->nrules; i++) {
+        size_t elen;
+        const char *ext = ext_of(c->rules[i].suffix, c->rules[i].len, &elen);
+        if (!ext) break;
+        c->ext_rules = i + 1;
+        ExtKey *last = c->nkeys ? &c->keys[c->nkeys - 1] : NULL;
+        if (last && last->len == elen && memcmp(last->ext, ext, elen) == 0) {
+            last->count++;
+        } else {
+            c->keys[c->nkeys++] = (ExtKey){ ext, elen, i, 1 };
+        }
+    }
+    return build_hash(c);
+}
+
+LsColors *lscolors_new(const char *ls_colors, const char *lsx_colors) {
+    LsColors *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    for (int k = 0; k < K_COUNT; k++) c->slot[k] = g_builtin[k];
+
+    // Each "key=value" yields at most ESC [ value m NUL: 4 bytes more
+    // than its value, and every value is followed by a separator.
+    size_t need = 1;
+    if (ls_colors) need += strlen(ls_colors) * 4;
+    if (lsx_colors) need += strlen(lsx_colors) * 4;
+    SeqPool pool = { malloc(need), 0 };
+    c->seqs = pool.buf;
+    if (!pool.buf) goto fail;
+
+    RuleVec rv = { NULL, 0, 0 };
+    if ((ls_colors && apply_spec(c, &rv, &pool, ls_colors) != 0) ||
+        (lsx_colors && apply_spec(c, &rv, &pool, lsx_colors) != 0)) {
+        c->rules = rv.v;
+        c->nrules = rv.n;
+        goto fail;
+    }
+    if (compile(c, &rv) != 0) goto fail;
+    return c;
+
+fail:
+    lscolors_free(c);
+    return NULL;
+}
+
+void lscolors_free(LsColors *c) {
+    if (!c) return;
+    for (int i = 0; i < c->nrules; i++) free(c->rules[i].suffix);
+    free(c->rules);
+    free(c->keys);
+    free(c->disp);
+    free(c->slot_key);
+    free(c->seqs);
+    free(c);
+}
+
+// ---- lookup ----
+
+static int suffix_matches(const Rule *r, const char *name, size_t len) {
+    return r->len <= len && fold_equal(name + len - r->len, r->suffix, r->len);
+}
+
+// Returns 1 and sets *seq (possibly NULL) when a suffix rule matches.
+static int match_suffix(const LsColors *c, const char *name, size_t len, const char **seq) {
+    size_t elen;
+    const char *ext = c->nkeys ? ext_of(name, len, &elen) : NULL;
+    if (ext && elen <= MAX_SUFFIX) {
+        uint64_t h = fold_hash(ext, elen);
+        uint32_t b = hash_bucket(h, c->nbuckets);
+        int32_t k = c->slot_key[hash_slot(h, c->disp[b], c->slot_mask)];
+        const ExtKey *key = k >= 0 ? &c->keys[k] : NULL;
+        if (key && key->len == elen && fold_equal(ext, key->ext, elen)) {
+            for (int i = key->first; i < key->first + key->count; i++) {
+                if (suffix_matches(&c->rules[i], name, len)) {
+                    *seq = c->rules[i].seq;
+                    return 1;
+                }
+            }
+        }
+    }
+    // Rules without a dot ("*~", "*README") are few; try them in turn.
+    for (int i = c->ext_rules; i < c->nrules; i++) {
+        if (suffix_matches(&c->rules[i], name, len)) {
+            *seq = c->rules[i].seq;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char *lscolors_pick(const LsColors *c, const char *name, size_t len, mode_t mode, nlink_t nlink) {
+    const char *seq = NULL;
+
+    if (S_ISDIR(mode)) {
+        if ((mode & S_ISVTX) && (mode & S_IWOTH)) seq = c->slot[K_TW];
+        if (!seq && (mode & S_IWOTH)) seq = c->slot[K_OW];
+        if (!seq && (mode & S_ISVTX)) seq = c->slot[K_ST];
+        if (!seq) seq = c->slot[K_DI];
+    } else if (S_ISLNK(mode)) {
+        seq = c->slot[K_LN];
+    } else {
+        // A zero type (the stat failed) is treated as a regular file.
+        int regular = S_ISREG(mode) || !(mode & S_IFMT);
+        if (S_ISFIFO(mode)) seq = c->slot[K_PI];
+        else if (S_ISSOCK(mode)) seq = c->slot[K_SO];
+        else if (S_ISBLK(mode)) seq = c->slot[K_BD];
+        else if (S_ISCHR(mode)) seq = c->slot[K_CD];
+        else {
+            if (mode & S_ISUID) seq = c->slot[K_SU];
+            if (!seq && (mode & S_ISGID)) seq = c->slot[K_SG];
+            if (!seq && (mode & S_IXUSR)) seq = c->slot[K_EX];
+            if (!seq && nlink > 1) seq = c->slot[K_MH];
+        }
+        if (!seq && len && name[0] == '.') seq = c->slot[K_HI];
+        if (!seq && regular && match_suffix(c, name, len, &seq) && seq) return seq;
+        if (!seq) seq = c->slot[K_FI];
+    }
+    return seq ? seq : c->slot[K_NO] ? c->slot[K_NO] : g_builtin[K_NO];
+}
+
+int lscolors_dir_mode_matters(const LsColors *c) {
+    return c->slot[K_TW] || c->slot[K_OW] || c->slot[K_ST];
+}
@@ -5,17 +5,37 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
-#include <pwd.h>
-#include <grp.h>
 #include <getopt.h>
 #include <locale.h>
 #include <errno.h>
+#include <poll.h>
+#include <signal.h>
 
 #include <wchar.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
 
 #include <fcntl.h>
 
+#include "filelist.h"
+#include "filesort.h"
+#include "dirscan.h"
+#include "walk.h"
+#include "out.h"
+#include "idcache.h"
+#include "timefmt.h"
+#include "textwidth.h"
+#include "match.h"
+#include "inoset.h"
+#include "mdcache.h"
+#include "watch.h"
+#include "browse.h"
+#include "stats.h"
+#include "statbatch.h"
+#include "lscolors.h"
+#include "gitstatus.h"
+#include "fsexclude.h"
+
 static int clamp_int(int v, int lo, int hi) {
     if (v < lo) return lo;
     if (v > hi) return hi;
@@ -63,9 +83,6 @@ static int get_term_width(void) {
 
     return 80; // safer fallback than 120
 }
-#define MAX_PATH 4096
-#define MAX_ITEMS 2048
-
 #define COLOR_RESET    "\033[0m"
 #define COLOR_CYAN     "\033[36m"
 #define COLOR_GREEN    "\033[32m"
@@ -79,6 +96,15 @@ static int get_term_width(void) {
 #define COLOR_GRAY     "\033[37m"
 #define COLOR_DIM      "\033[2m"
 
+// Box table, or one of the machine-readable formats, which print one
+// record per entry and skip the box and colors entirely.
+typedef enum {
+    OUTPUT_BOX,
+    OUTPUT_JSON,     // --json: one array of entry objects
+    OUTPUT_NDJSON,   // --ndjson: one object per line
+    OUTPUT_NUL,      // -0: paths, each terminated by a NUL byte
+} OutputFormat;
+
 typedef struct {
     int show_hidden;
     int long_format;
@@ -90,37 +116,49 @@ typedef struct {
     int reverse;
     int sort_by_ext;
     int sort_by_time;
+    int sort_by_size;     // -S: largest first
+    int sort_version;     // -v: natural order of numbers in names
+    int sort_collate;     // --collate: locale (LC_COLLATE) name order
     int numeric_ids;
     int comma_separated;
     int quote_names;
-    char *pattern;
 
     int depth;            // NEW: inline depth inside one box (0 = off)
+    int jobs;             // loader threads for -R / -D (1 = serial)
+    int unsorted;         // -U: stream rows in directory order
+    int preload_ids;      // enumerate passwd/group once before listing
+    int du;               // --du: recursive size / file count for directories
+    int watch;            // --watch: stay running and redraw as directories change
+    int interactive;      // -I: ncurses browser
+    int stats;            // --stats: 1 = text, 2 = JSON, on stderr at exit
+    int git;              // --git: status column from the repository's index
+    int follow;           // -L: show and descend into what symlinks point to
+    int one_fs;           // -x: do not descend into other filesystems
+    OutputFormat output;
 } Options;
 
-typedef struct {
-    char name[256];
-    char full_path[MAX_PATH];
-    mode_t mode;
-    off_t size;
-    time_t mtime;
-    uid_t uid;
-    gid_t gid;
-    ino_t inode;
-    int is_dir;
-    int is_hidden;
-} FileItem;
-
-typedef struct {
-    FileItem items[MAX_ITEMS];
-    int count;
-    char cwd[MAX_PATH];
-} FileList;
-
 static Options opts = {0};
 
 static int g_use_utf8 = 1;
 
+// Name colors: lsx's palette under LS_COLORS and LSX_COLORS, compiled
+// at startup (box output only).
+static LsColors *g_colors;
+
+// --git: the repository the target lives in, or NULL.
+static GitRepo *g_git;
+
+// Where the walk stops: -L enters each directory once, by (dev, inode),
+// -x stays on the target's filesystem and --exclude-fs off mounts of
+// the listed types. The walk then needs every directory's stat data.
+static InoSet *g_visited;
+static FsExclude *g_fs_exclude;
+static dev_t g_root_dev;
+
+static int walk_bounded(void) {
+    return opts.follow || opts.one_fs || g_fs_exclude;
+}
+
 #define U8_H  "\xE2\x94\x80"
 #define U8_V  "\xE2\x94\x82"
 #define U8_TL "\xE2\x94\x8C"
@@ -129,6 +167,7 @@ static int g_use_utf8 = 1;
 #define U8_BR "\xE2\x94\x98"
 #define U8_LJ "\xE2\x94\x9C"
 #define U8_RJ "\xE2\x94\xA4"
+#define U8_ELLIPSIS "\xE2\x80\xA6"
 
 #define A_H  "-"
 #define A_V  "|"
@@ -138,6 +177,7 @@ static int g_use_utf8 = 1;
 #define A_BR "+"
 #define A_LJ "+"
 #define A_RJ "+"
+#define A_ELLIPSIS "~"
 
 static const char *GLYPH_H  = U8_H;
 static const char *GLYPH_V  = U8_V;
@@ -147,9 +187,18 @@ static const char *GLYPH_BL = U8_BL;
 static const char *GLYPH_BR = U8_BR;
 static const char *GLYPH_LJ = U8_LJ;
 static const char *GLYPH_RJ = U8_RJ;
+static const char *GLYPH_ELLIPSIS = U8_ELLIPSIS;   // marks a cut name
 
 static void print_row_prefix(void) {
-    printf("%s%s%s ", COLOR_WHITE, GLYPH_V, COLOR_RESET);
+    out_lit(COLOR_WHITE);
+    out_puts(GLYPH_V);
+    out_lit(COLOR_RESET " ");
+}
+
+static void print_row_end(void) {
+    out_lit(COLOR_WHITE);
+    out_puts(GLYPH_V);
+    out_lit(COLOR_RESET "\n");
 }
 static void init_glyphs(void) {
     const char *lc = setlocale(LC_CTYPE, NULL);
@@ -166,94 +215,113 @@ static void init_glyphs(void) {
         GLYPH_BR = A_BR;
         GLYPH_LJ = A_LJ;
         GLYPH_RJ = A_RJ;
+        GLYPH_ELLIPSIS = A_ELLIPSIS;
     }
 }
 
-static void print_repeat(const char *s, int n) {
-    for (int i = 0; i < n; i++) fputs(s, stdout);
+// One box row under construction. Fragments are appended at a cursor with
+// their byte length and visible width known up front, so building a row is
+// linear and the padding never needs the row to be re-decoded.
+typedef struct {
+    char buf[8192];
+    size_t len;
+    int vis;
+} RowBuf;
+
+static void rb_init(RowBuf *rb) {
+    rb->len = 0;
+    rb->vis = 0;
 }
 
-// Count printable columns in a string that may include ANSI CSI escapes like "\x1b[...m".
-// Count printable terminal columns in a string that may include ANSI CSI escapes.
-// UTF-8 aware: uses mbrtowc + wcwidth to count columns correctly.
-static int visible_len_ansi(const char *s) {
-    mbstate_t st;
-    memset(&st, 0, sizeof(st));
+static void rb_add(RowBuf *rb, const char *s, size_t n, int vis) {
+    if (n > sizeof(rb->buf) - rb->len) return;
+    memcpy(rb->buf + rb->len, s, n);
+    rb->len += n;
+    rb->vis += vis;
+}
 
-    int cols = 0;
-    size_t i = 0;
+// Zero-width fragment (escape sequence); s must be a string literal or a
+// NUL-terminated color constant.
+static void rb_ansi(RowBuf *rb, const char *s) {
+    rb_add(rb, s, strlen(s), 0);
+}
 
-    while (s[i]) {
-        // Skip ANSI escape sequences: ESC [ ... final
-        if (s[i] == '\x1b' && s[i + 1] == '[') {
-            i += 2;
-            while (s[i] && !(s[i] >= '@' && s[i] <= '~')) i++;
-            if (s[i]) i++; // consume final byte
-            continue;
-        }
+// Plain text whose width is not known in advance.
+static void rb_text(RowBuf *rb, const char *s, size_t n) {
+    rb_add(rb, s, n, text_width(s, n));
+}
 
-        // Decode next UTF-8 sequence into a wide char
-        wchar_t wc;
-        size_t n = mbrtowc(&wc, s + i, MB_CUR_MAX, &st);
+static void rb_char(RowBuf *rb, char c) {
+    if (rb->len < sizeof(rb->buf)) {
+        rb->buf[rb->len++] = c;
+        rb->vis++;
+    }
+}
 
-        if (n == (size_t)-2) {
-            // Incomplete multibyte sequence; treat remaining bytes as 1 col each
-            cols += 1;
-            i += 1;
-            memset(&st, 0, sizeof(st));
-            continue;
-        }
-        if (n == (size_t)-1) {
-            // Invalid byte sequence; count as 1 and move on
-            cols += 1;
-            i += 1;
-            memset(&st, 0, sizeof(st));
-            continue;
-        }
-        if (n == 0) {
-            // NUL
-            break;
-        }
+static void rb_spaces(RowBuf *rb, int n) {
+    if (n <= 0 || (size_t)n > sizeof(rb->buf) - rb->len) return;
+    memset(rb->buf + rb->len, ' ', (size_t)n);
+    rb->len += (size_t)n;
+    rb->vis += n;
+}
 
-        int w = wcwidth(wc);
-        if (w < 0) w = 1; // non-printables fall back to 1
+static void rb_uint(RowBuf *rb, unsigned long long v) {
+    char tmp[24];
+    int n = 0;
+    do {
+        tmp[sizeof(tmp) - 1 - n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    rb_add(rb, tmp + sizeof(tmp) - n, (size_t)n, n);
+}
 
-        cols += w;
-        i += n;
-    }
+// Left-aligned text padded with spaces to at least w bytes, like "%-*s".
+static void rb_text_left(RowBuf *rb, const char *s, size_t n, int w) {
+    rb_text(rb, s, n);
+    rb_spaces(rb, w - (int)n);
+}
 
-    return cols;
+// Right-aligned text padded to at least w bytes, like "%*s".
+static void rb_text_right(RowBuf *rb, const char *s, size_t n, int w) {
+    rb_spaces(rb, w - (int)n);
+    rb_text(rb, s, n);
 }
 
-static void print_row_content(int width, const char *content) {
+static void print_row(int width, const RowBuf *rb) {
     int inner = width - 2;
     if (inner < 1) inner = 1;
 
-    int vis = visible_len_ansi(content);
-    int padding = inner - (1 + vis); // +1 because print_row_prefix prints "│ " (space after)
+    int padding = inner - (1 + rb->vis); // +1 because print_row_prefix prints "│ " (space after)
     if (padding < 0) padding = 0;
 
     print_row_prefix();          // prints left border + space
-    fputs(content, stdout);      // prints colored content
-    for (int i = 0; i < padding; i++) putchar(' ');
-    printf("%s%s%s\n", COLOR_WHITE, GLYPH_V, COLOR_RESET); // right border
+    out_write(rb->buf, rb->len); // prints colored content
+    out_spaces(padding);
+    print_row_end();             // right border
 }
+
 static void print_border_top(int width) {
-    printf("%s%s", COLOR_WHITE, GLYPH_TL);
-    print_repeat(GLYPH_H, width - 2);
-    printf("%s%s\n", GLYPH_TR, COLOR_RESET);
+    out_lit(COLOR_WHITE);
+    out_puts(GLYPH_TL);
+    out_repeat(GLYPH_H, width - 2);
+    out_puts(GLYPH_TR);
+    out_lit(COLOR_RESET "\n");
 }
 
 static void print_border_mid(int width) {
-    printf("%s%s", COLOR_WHITE, GLYPH_LJ);
-    print_repeat(GLYPH_H, width - 2);
-    printf("%s%s\n", GLYPH_RJ, COLOR_RESET);
+    out_lit(COLOR_WHITE);
+    out_puts(GLYPH_LJ);
+    out_repeat(GLYPH_H, width - 2);
+    out_puts(GLYPH_RJ);
+    out_lit(COLOR_RESET "\n");
 }
 
 static void print_border_bottom(int width) {
-    printf("%s%s", COLOR_WHITE, GLYPH_BL);
-    print_repeat(GLYPH_H, width - 2);
-    printf("%s%s\n", GLYPH_BR, COLOR_RESET);
+    out_lit(COLOR_WHITE);
+    out_puts(GLYPH_BL);
+    out_repeat(GLYPH_H, width - 2);
+    out_puts(GLYPH_BR);
+    out_lit(COLOR_RESET "\n");
 }
 
 
@@ -261,131 +329,356 @@ static void print_row_suffix(int width, int used_visible_cols) {
     int inner = width - 2;
     int padding = inner - used_visible_cols;
     if (padding < 0) padding = 0;
-    for (int i = 0; i < padding; i++) putchar(' ');
-    printf("%s%s%s\n", COLOR_WHITE, GLYPH_V, COLOR_RESET);
+    out_spaces(padding);
+    print_row_end();
 }
 
-static int matches_pattern(const char *name, const char *pattern) {
-    if (!pattern) return 1;
+// Compiled --glob / --exclude / --regex filters (NULL when none), and the
+// length of the listing root so walk paths can be made relative to it.
+static Matcher *g_matcher;
+static size_t g_root_len;
 
-    if (pattern[0] == '*' && pattern[1] == '.') {
-        const char *ext = strrchr(name, '.');
-        if (ext) return strcmp(ext, pattern + 1) == 0;
-        return 0;
-    }
-    return 1;
+static const char *root_relative(const char *path) {
+    const char *rel = strlen(path) >= g_root_len ? path + g_root_len : "";
+    while (*rel == '/') rel++;
+    return rel;
 }
 
-static int load_directory(FileList *list, const char *path) {
-    DIR *dir = opendir(path);
-    if (!dir) return -1;
+static int rel_depth(const char *rel) {
+    if (!*rel) return 0;
+    int d = 1;
+    for (const char *p = rel; *p; p++) d += (*p == '/' && p[1] && p[1] != '/');
+    return d;
+}
+
+// fstatat, timed and counted for --stats.
+static int stat_at(int dfd, const char *name, struct stat *st, int flags) {
+    uint64_t t0 = stats_start();
+    int rc = fstatat(dfd, name, st, flags);
+    stats_stop(STATS_STAT, t0);
+    return rc;
+}
 
-    list->count = 0;
-    snprintf(list->cwd, sizeof(list->cwd), "%s", path);
+// Stat one listed entry: the entry itself, or with -L what it points to,
+// falling back to the link when its target is missing.
+static int stat_entry(int dfd, const char *name, struct stat *st) {
+    if (opts.follow && stat_at(dfd, name, st, 0) == 0) return 0;
+    return stat_at(dfd, name, st, AT_SYMLINK_NOFOLLOW);
+}
+
+// Decide from the name alone (plus d_type, only for directories that do
+// not match) whether a directory entry is listed, so filtered entries
+// cost no stat. Directories that fail the include patterns are still
+// shown during -R / -D when something below them could match.
+static int entry_passes(int dfd, const char *rel, const DirEntry *e) {
+    if (!g_matcher) return 1;
+    if (matcher_excluded(g_matcher, rel, e->name)) return 0;
+    if (matcher_included(g_matcher, rel, e->name)) return 1;
+    if (rel_depth(rel) + 1 > opts.depth) return 0;
+
+    int is_dir = (e->type == DT_DIR);
+#ifdef DT_UNKNOWN
+    if (e->type == DT_UNKNOWN || (opts.follow && e->type == DT_LNK)) {
+        struct stat st;
+        is_dir = stat_entry(dfd, e->name, &st) == 0 && S_ISDIR(st.st_mode);
+    }
+#else
+    (void)dfd;
+#endif
+    return is_dir && matcher_may_contain(g_matcher, rel, e->name);
+}
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL && list->count < MAX_ITEMS) {
-        if (!opts.show_hidden && entry->d_name[0] == '.') continue;
-        if (!matches_pattern(entry->d_name, opts.pattern)) continue;
+// Hidden-file and pattern filters together; what they drop is counted.
+static int entry_listed(int dfd, const char *rel, const DirEntry *e) {
+    if ((opts.show_hidden || e->name[0] != '.') && entry_passes(dfd, rel, e)) return 1;
+    stats_add(STATS_FILTERED, 1);
+    return 0;
+}
 
-        FileItem *item = &list->items[list->count];
-        memset(item, 0, sizeof(*item));
+// Whether -x and --exclude-fs let the walk enter a directory on device
+// dev. The target's own filesystem is never excluded.
+static int dir_enterable(dev_t dev) {
+    if (opts.one_fs && dev != g_root_dev) return 0;
+    return !g_fs_exclude || dev == g_root_dev || !fsexclude_has(g_fs_exclude, dev);
+}
 
-        snprintf(item->name, sizeof(item->name), "%s", entry->d_name);
+// -L: whether the walk enters directory (dev, inode) for the first
+// time. Called right before a directory is loaded, in the order its row
+// is printed (with --du -S, in name order before the rows are sorted by
+// size), so of several paths to one directory the first one printed
+// lists it, and a symlink back up the tree finds its target already
+// entered, which breaks the cycle.
+static int first_visit(dev_t dev, ino_t ino) {
+    return !g_visited || inoset_insert(g_visited, dev, ino) != 0;
+}
 
-        int n = snprintf(item->full_path, sizeof(item->full_path), "%s/%s", path, entry->d_name);
-        if (n < 0 || (size_t)n >= sizeof(item->full_path)) continue;
+// Whether the walk should load directory entry i at all: false when no
+// include pattern could match anything beneath it, or when it is out of
+// bounds (see dir_enterable).
+static int descend_allowed(const FileList *list, int i) {
+    if (g_matcher && !matcher_may_contain(g_matcher, root_relative(list->dir), filelist_name(list, i))) return 0;
+    return dir_enterable(list->dev[i]);
+}
 
-        struct stat st;
-        if (lstat(item->full_path, &st) == 0) {
-            item->mode  = st.st_mode;
-            item->size  = st.st_size;
-            item->mtime = st.st_mtime;
-            item->uid   = st.st_uid;
-            item->gid   = st.st_gid;
-            item->inode = st.st_ino;
-            item->is_dir = S_ISDIR(st.st_mode);
-        } else {
-            item->mode = 0;
-            item->is_dir = 0;
-        }
+static void item_from_stat(FileItem *item, const struct stat *st) {
+    item->mode   = st->st_mode;
+    item->size   = st->st_size;
+    item->mtime  = st->st_mtime;
+    item->uid    = st->st_uid;
+    item->gid    = st->st_gid;
+    item->inode  = st->st_ino;
+    item->dev    = st->st_dev;
+    item->nlink  = st->st_nlink;
+    item->is_dir = S_ISDIR(st->st_mode);
+}
 
-        item->is_hidden = (entry->d_name[0] == '.');
-        list->count++;
+// Decide from the directory entry's type whether we need a stat call at
+// all. Long format, -t, -S and JSON records read the whole stat record.
+// The short listing only needs the file type, which d_type already
+// gives us, except:
+//   - the '*' icon needs the exec bit of non-directories;
+//   - LS_COLORS rules for sticky or world-writable directories need a
+//     directory's mode;
+//   - -x and --exclude-fs need a directory's device;
+//   - --git compares a symlink's stat data with the index;
+//   - -L needs to know what a symlink points to.
+static int entry_needs_stat(unsigned char d_type) {
+    if (opts.long_format || opts.sort_by_time || opts.sort_by_size) return 1;
+    if (opts.output == OUTPUT_JSON || opts.output == OUTPUT_NDJSON) return 1;
+#ifdef DT_UNKNOWN
+    switch (d_type) {
+        case DT_UNKNOWN: return 1;
+        case DT_DIR:     return walk_bounded() || (g_colors && lscolors_dir_mode_matters(g_colors));
+        case DT_LNK:     return g_git != NULL || opts.follow;
+        default:         return 1;
     }
+#else
+    (void)d_type;
+    return 1;
+#endif
+}
 
-    closedir(dir);
+// Fill what the directory entry alone tells about item (not the name).
+// Returns 1 when that is not enough: the metadata is then still zero,
+// mode included, until a stat fills it in.
+static int item_from_dirent(const DirEntry *entry, FileItem *item) {
+    memset(item, 0, sizeof(*item));
+    item->is_hidden = (entry->name[0] == '.');
+    if (entry_needs_stat(entry->type)) return 1;
+
+#ifdef DT_UNKNOWN
+    item->mode = DTTOIF(entry->type);
+    item->inode = entry->ino;
+    item->is_dir = (entry->type == DT_DIR);
+#endif
     return 0;
 }
 
-static int load_single_file(FileList *list, const char *path) {
+// Fill the metadata of item for one directory entry (not the name).
+// Stats relative to the open directory, so the kernel does not walk the
+// whole path again, and only when d_type is not enough.
+static void stat_dir_entry(int dfd, const DirEntry *entry, FileItem *item) {
     struct stat st;
-    if (lstat(path, &st) != 0) return -1;
+    if (item_from_dirent(entry, item) && stat_entry(dfd, entry->name, &st) == 0) {
+        item_from_stat(item, &st);
+    }
+}
 
-    list->count = 0;
-    snprintf(list->cwd, sizeof(list->cwd), "%s", path);
+// Whole directories are stat'ed through statbatch once they are read,
+// this many names at a time.
+#define STAT_CHUNK 1024
 
-    FileItem *item = &list->items[list->count];
-    memset(item, 0, sizeof(*item));
+typedef struct {
+    FileList *list;
+    const int *idx;   // chunk position -> list entry
+} ListStat;
+
+static void list_stat_done(int k, const struct stat *st, void *ctx) {
+    const ListStat *ls = ctx;
+    if (!st) return;   // vanished while listing: the metadata stays zero
+
+    int i = ls->idx[k];
+    FileItem item;
+    memset(&item, 0, sizeof(item));
+    item_from_stat(&item, st);
+    item.is_hidden = (filelist_name(ls->list, i)[0] == '.');
+    filelist_set(ls->list, i, &item);
+}
 
-    const char *base = strrchr(path, '/');
-    base = base ? base + 1 : path;
+// Stat every entry item_from_dirent left without a mode. Runs after the
+// last filelist_add, so the names stay put while the kernel reads them.
+static void stat_pending_entries(FileList *list, int dfd) {
+    const char *names[STAT_CHUNK];
+    int idx[STAT_CHUNK];
+    ListStat ls = { list, idx };
+    int n = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (list->mode[i]) continue;
+        idx[n] = i;
+        names[n] = filelist_name(list, i);
+        if (++n == STAT_CHUNK) {
+            statbatch_run(dfd, names, n, list_stat_done, &ls);
+            n = 0;
+        }
+    }
+    if (n) statbatch_run(dfd, names, n, list_stat_done, &ls);
+}
+
+// Add one directory entry to list unless a filter drops it; with all,
+// a dropped entry is added too, flagged FI_FILTERED. Returns 1 when its
+// metadata still waits for stat_pending_entries, -1 when out of memory.
+static int add_dir_entry(FileList *list, int dfd, const char *rel, const DirEntry *entry, int all) {
+    int listed = entry_listed(dfd, rel, entry);
+    if (!listed && !all) return 0;
+
+    int i = filelist_add(list, entry->name, strlen(entry->name));
+    if (i < 0) return -1;
+
+    FileItem item;
+    int pending = item_from_dirent(entry, &item);
+    filelist_set(list, i, &item);
+    if (!listed) list->flags[i] |= FI_FILTERED;
+    return pending;
+}
+
+// List a directory (see add_dir_entry for all). With rec, every entry
+// read (hidden and filtered ones too) is also added to it for the
+// metadata cache.
+static int scan_directory(FileList *list, const char *path, int all, MdCacheRecord *rec) {
+    DirScan *ds = dirscan_open(path);
+    if (!ds) return -1;
+
+    if (filelist_reset(list, path, path) != 0) {
+        dirscan_close(ds);
+        errno = ENOMEM;
+        return -1;
+    }
 
-    snprintf(item->name, sizeof(item->name), "%s", base);
-    snprintf(item->full_path, sizeof(item->full_path), "%s", path);
+    int dfd = dirscan_fd(ds);
+    const char *rel = root_relative(path);
 
-    item->mode  = st.st_mode;
-    item->size  = st.st_size;
-    item->mtime = st.st_mtime;
-    item->uid   = st.st_uid;
-    item->gid   = st.st_gid;
-    item->inode = st.st_ino;
-    item->is_dir = S_ISDIR(st.st_mode);
-    item->is_hidden = (base[0] == '.');
+    DirEntry entry;
+    int rc, pending = 0;
+    while ((rc = dirscan_next(ds, &entry)) > 0) {
+        if (rec) mdcache_record_add(rec, entry.name, strlen(entry.name), entry.ino, entry.type);
+        int added = add_dir_entry(list, dfd, rel, &entry, all);
+        if (added < 0) break;
+        pending |= added;
+    }
+    if (rec && rc != 0) rec->failed = 1;
+    if (pending) stat_pending_entries(list, dfd);
 
-    list->count++;
+    dirscan_close(ds);
     return 0;
 }
 
-static int compare_by_name(const void *a, const void *b) {
-    const FileItem *fa = (const FileItem *)a;
-    const FileItem *fb = (const FileItem *)b;
-    int cmp = strcmp(fa->name, fb->name);
-    return opts.reverse ? -cmp : cmp;
-}
+// --cache: while a directory is unchanged its names, types and inodes
+// come from the metadata cache instead of being read again. Sizes, times,
+// modes and owners change without touching the directory, so entries
+// that need them are stat'ed just as without the cache.
+static MdCache *g_cache;
+
+static int load_directory_cached(FileList *list, const char *path, int all) {
+    struct stat dst;
+    if (stat_at(AT_FDCWD, path, &dst, 0) != 0) return -1;
+    if (!S_ISDIR(dst.st_mode)) {
+        errno = ENOTDIR;
+        return -1;
+    }
 
-static int compare_by_ext(const void *a, const void *b) {
-    const FileItem *fa = (const FileItem *)a;
-    const FileItem *fb = (const FileItem *)b;
+    MdCacheDir cd;
+    if (!mdcache_lookup(g_cache, &dst, &cd)) {
+        MdCacheRecord rec;
+        mdcache_record_init(&rec, &dst);
+        int rc = scan_directory(list, path, all, &rec);
+        if (rc != 0) rec.failed = 1;
+        mdcache_commit(g_cache, &rec);
+        return rc;
+    }
 
-    const char *ext_a = strrchr(fa->name, '.');
-    const char *ext_b = strrchr(fb->name, '.');
+    // The directory is still opened: the stat calls, and filters that
+    // look through a symlink or an entry of unknown type, go through it.
+    int dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return -1;
+    if (filelist_reset(list, path, path) != 0) {
+        close(dfd);
+        errno = ENOMEM;
+        return -1;
+    }
 
-    if (!ext_a) ext_a = "";
-    if (!ext_b) ext_b = "";
+    const char *rel = root_relative(path);
+    int pending = 0;
+    for (uint32_t k = 0; k < cd.count; k++) {
+        const MdCacheEntry *e = &cd.ents[k];
+        DirEntry entry = { cd.names + e->name_off, (ino_t)e->ino, (unsigned char)e->type };
+        int added = add_dir_entry(list, dfd, rel, &entry, all);
+        if (added < 0) break;
+        pending |= added;
+    }
+    if (pending) stat_pending_entries(list, dfd);
 
-    int cmp = strcmp(ext_a, ext_b);
-    if (cmp == 0) cmp = strcmp(fa->name, fb->name);
-    return opts.reverse ? -cmp : cmp;
+    close(dfd);
+    return 0;
 }
 
-static int compare_by_time(const void *a, const void *b) {
-    const FileItem *fa = (const FileItem *)a;
-    const FileItem *fb = (const FileItem *)b;
+// --watch keeps every directory it lists in memory and follows it with
+// inotify, so later frames copy the kept list instead of reading again.
+static Watch *g_watch;
+
+static int load_directory(FileList *list, const char *path, int all) {
+    int wd = -1;
+    if (g_watch) {
+        const FileList *kept = watch_find(g_watch, path);
+        if (kept) {
+            if (filelist_copy(list, kept) == 0) return 0;
+            errno = ENOMEM;
+            return -1;
+        }
+        wd = watch_start(g_watch, path);
+    }
 
-    if (fa->mtime < fb->mtime) return opts.reverse ? -1 : 1;
-    if (fa->mtime > fb->mtime) return opts.reverse ? 1 : -1;
-    return 0;
+    int rc = g_cache ? load_directory_cached(list, path, all) : scan_directory(list, path, all, NULL);
+    if (rc == 0 && wd >= 0) watch_keep(g_watch, wd, path, list);
+    return rc;
 }
 
-static void sort_list(FileList *list) {
-    if (opts.sort_by_time) {
-        qsort(list->items, list->count, sizeof(FileItem), compare_by_time);
-    } else if (opts.sort_by_ext) {
-        qsort(list->items, list->count, sizeof(FileItem), compare_by_ext);
+static int load_single_file(FileList *list, const char *path) {
+    struct stat st;
+    if (stat_entry(AT_FDCWD, path, &st) != 0) return -1;
+
+    const char *base = strrchr(path, '/');
+    char parent[MAX_PATH];
+    if (base) {
+        snprintf(parent, sizeof(parent), "%.*s", (int)(base - path), path);
+        base++;
     } else {
-        qsort(list->items, list->count, sizeof(FileItem), compare_by_name);
+        snprintf(parent, sizeof(parent), ".");
+        base = path;
     }
+
+    if (filelist_reset(list, path, parent) != 0) return -1;
+
+    int i = filelist_add(list, base, strlen(base));
+    if (i < 0) return -1;
+
+    FileItem item;
+    memset(&item, 0, sizeof(item));
+    item_from_stat(&item, &st);
+    item.is_hidden = (base[0] == '.');
+    filelist_set(list, i, &item);
+    return 0;
+}
+
+static void sort_list(FileList *list) {
+    SortMode mode = opts.sort_by_size ? SORT_SIZE
+                  : opts.sort_by_time ? SORT_TIME
+                  : opts.sort_by_ext ? SORT_EXT
+                  : opts.sort_version ? SORT_VERSION
+                  : opts.sort_collate ? SORT_COLLATE
+                  : SORT_NAME;
+    uint64_t t0 = stats_start();
+    filelist_sort(list, mode, opts.reverse);
+    stats_stop(STATS_SORT, t0);
 }
 
 static void format_size(off_t size, char *str, size_t len) {
@@ -399,19 +692,16 @@ static void format_size(off_t size, char *str, size_t len) {
     }
 }
 
-static void format_time(time_t t, char *str, size_t len) {
-    struct tm *tmv = localtime(&t);
-    if (!tmv) { snprintf(str, len, "??? ?? ??:??"); return; }
-    strftime(str, len, "%b %d %H:%M", tmv);
-}
 
 
-static void make_indent_prefix(char *out, size_t outsz, int level, int is_last) {
+// Returns the number of terminal columns the prefix occupies.
+static int make_indent_prefix(char *out, size_t outsz, int level, int is_last) {
     // Simple tree-ish indent that still prints as plain text inside your box.
     // Example: "  ├─ " / "  └─ " repeated by level
     out[0] = '\0';
-    if (level <= 0) return;
+    if (level <= 0) return 0;
 
+    int cols = 0;
     size_t used = 0;
     for (int i = 0; i < level - 1; i++) {
         const char *seg = g_use_utf8 ? "  " : "  ";
@@ -420,6 +710,7 @@ static void make_indent_prefix(char *out, size_t outsz, int level, int is_last)
         memcpy(out + used, seg, seglen);
         used += seglen;
         out[used] = '\0';
+        cols += 2;
     }
 
     const char *branch = g_use_utf8 ? (is_last ? "  └─ " : "  ├─ ") : (is_last ? "  `- " : "  |- ");
@@ -428,131 +719,184 @@ static void make_indent_prefix(char *out, size_t outsz, int level, int is_last)
         memcpy(out + used, branch, blen);
         used += blen;
         out[used] = '\0';
+        cols += 5;
     }
+    return cols;
 }
 
-static void print_item_simple_line(FileItem *item, int width, const char *prefix, int prefix_visible_unused) {
-    (void)prefix_visible_unused;
+// The nine permission characters for every mode & 0777, pre-rendered with
+// their colors. Each entry is 9 visible columns.
+typedef struct {
+    char s[9 * 16];
+    unsigned char len;
+} PermStr;
 
-    const char *name_col = COLOR_RESET;
-    char icon = '-';
+static PermStr g_perm_table[512];
+
+static void init_perm_table(void) {
+    for (int m = 0; m < 512; m++) {
+        PermStr *p = &g_perm_table[m];
+        size_t len = 0;
+        for (int i = 0; i < 9; i++) {
+            char ch = (m & (0400 >> i)) ? "rwx"[i % 3] : '-';
 
-    if (item->is_dir) { icon = 'D'; name_col = COLOR_CYAN COLOR_BOLD; }
-    else if (S_ISLNK(item->mode)) { icon = '@'; name_col = COLOR_MAGENTA COLOR_BOLD; }
-    else if (item->mode & S_IXUSR) { icon = '*'; name_col = COLOR_GREEN COLOR_BOLD; }
-    else if (item->is_hidden) { icon = '.'; name_col = COLOR_DIM COLOR_MAGENTA; }
+            const char *c =
+                (ch == 'r') ? COLOR_GREEN :
+                (ch == 'w') ? COLOR_YELLOW :
+                (ch == 'x') ? (COLOR_RED COLOR_BOLD) :
+                (COLOR_DIM COLOR_GRAY);
 
-    char row[8192];
-    row[0] = '\0';
+            size_t cl = strlen(c);
+            memcpy(p->s + len, c, cl);
+            len += cl;
+            p->s[len++] = ch;
+            memcpy(p->s + len, COLOR_RESET, sizeof(COLOR_RESET) - 1);
+            len += sizeof(COLOR_RESET) - 1;
+        }
+        p->len = (unsigned char)len;
+    }
+}
 
+static void rb_prefix(RowBuf *rb, const char *prefix, int prefix_visible) {
     if (prefix && *prefix) {
-        snprintf(row + strlen(row), sizeof(row) - strlen(row),
-                 "%s%s%s", COLOR_DIM COLOR_GRAY, prefix, COLOR_RESET);
+        rb_ansi(rb, COLOR_DIM COLOR_GRAY);
+        rb_add(rb, prefix, strlen(prefix), prefix_visible);
+        rb_ansi(rb, COLOR_RESET);
     }
+}
 
-    snprintf(row + strlen(row), sizeof(row) - strlen(row),
-             "%s%c%s ", COLOR_WHITE, icon, COLOR_RESET);
+static const char *name_color(const FileItem *item) {
+    return lscolors_pick(g_colors, item->name, item->name_len, item->mode, item->nlink);
+}
 
-    if (opts.quote_names) {
-        snprintf(row + strlen(row), sizeof(row) - strlen(row),
-                 "%s\"%s\"%s", name_col, item->name, COLOR_RESET);
+// --git column: index status in green, work tree status in red.
+static void rb_git(RowBuf *rb, const char *git) {
+    if (git[0] == '!') {
+        rb_ansi(rb, COLOR_DIM COLOR_GRAY);
+        rb_add(rb, git, 2, 2);
+    } else if (git[0] == 'U') {
+        rb_ansi(rb, COLOR_RED COLOR_BOLD);
+        rb_add(rb, git, 2, 2);
     } else {
-        snprintf(row + strlen(row), sizeof(row) - strlen(row),
-                 "%s%s%s", name_col, item->name, COLOR_RESET);
+        rb_ansi(rb, git[0] == '?' ? COLOR_RED : COLOR_GREEN);
+        rb_char(rb, git[0]);
+        rb_ansi(rb, COLOR_RED);
+        rb_char(rb, git[1]);
     }
+    rb_ansi(rb, COLOR_RESET);
+}
 
-    if (opts.add_slash && item->is_dir) {
-        snprintf(row + strlen(row), sizeof(row) - strlen(row),
-                 "%s/%s", COLOR_DIM COLOR_GRAY, COLOR_RESET);
-    }
+// git is the entry's --git status, or NULL without --git.
+static void print_item_simple_line(const FileItem *item, const char *git, int width,
+                                   const char *prefix, int prefix_visible) {
+    const char *name_col = name_color(item);
+    char icon = '-';
 
-    print_row_content(width, row);
-}
+    if (item->is_dir) icon = 'D';
+    else if (S_ISLNK(item->mode)) icon = '@';
+    else if (item->mode & S_IXUSR) icon = '*';
+    else if (item->is_hidden) icon = '.';
 
-static void print_item_long_line(FileItem *item, int width, const char *prefix, int prefix_visible_unused) {
-    (void)prefix_visible_unused;
+    RowBuf rb;
+    rb_init(&rb);
+    if (git) {
+        rb_git(&rb, git);
+        rb_char(&rb, ' ');
+    }
+    rb_prefix(&rb, prefix, prefix_visible);
 
-    time_t now = time(NULL);
+    rb_ansi(&rb, COLOR_WHITE);
+    rb_char(&rb, icon);
+    rb_ansi(&rb, COLOR_RESET);
+    rb_char(&rb, ' ');
 
-    char row[8192];
-    row[0] = '\0';
+    rb_ansi(&rb, name_col);
+    if (opts.quote_names) rb_char(&rb, '"');
+    rb_add(&rb, item->name, item->name_len, item->name_width);
+    if (opts.quote_names) rb_char(&rb, '"');
+    rb_ansi(&rb, COLOR_RESET);
 
-    if (prefix && *prefix) {
-        snprintf(row + strlen(row), sizeof(row) - strlen(row),
-                 "%s%s%s", COLOR_DIM COLOR_GRAY, prefix, COLOR_RESET);
+    if (opts.add_slash && item->is_dir) {
+        rb_ansi(&rb, COLOR_DIM COLOR_GRAY);
+        rb_char(&rb, '/');
+        rb_ansi(&rb, COLOR_RESET);
     }
 
+    print_row(width, &rb);
+}
+
+// du, when given, replaces a directory's <DIR> with its recursive totals.
+static void print_item_long_line(const FileItem *item, const WalkTotals *du, const char *git, int width,
+                                 const char *prefix, int prefix_visible) {
+    time_t now = timefmt_now();
+
+    RowBuf rb;
+    rb_init(&rb);
+    rb_prefix(&rb, prefix, prefix_visible);
+
     if (opts.show_inode) {
-        char tmp[64];
-        snprintf(tmp, sizeof(tmp), "%s%-8llu%s ",
-                 COLOR_MAGENTA, (unsigned long long)item->inode, COLOR_RESET);
-        strncat(row, tmp, sizeof(row) - strlen(row) - 1);
+        rb_ansi(&rb, COLOR_MAGENTA);
+        size_t before = rb.len;
+        rb_uint(&rb, (unsigned long long)item->inode);
+        rb_spaces(&rb, 8 - (int)(rb.len - before));
+        rb_ansi(&rb, COLOR_RESET);
+        rb_char(&rb, ' ');
     }
 
-    // perms (write into row using a temp buffer)
+    // perms
     {
-        char perm[128];
         char t = S_ISDIR(item->mode) ? 'd' : S_ISLNK(item->mode) ? 'l' : '-';
         const char *tcol = S_ISDIR(item->mode) ? (COLOR_CYAN COLOR_BOLD)
                         : S_ISLNK(item->mode) ? (COLOR_MAGENTA COLOR_BOLD)
                         : (COLOR_DIM COLOR_GRAY);
 
-        snprintf(perm, sizeof(perm), "%s%c%s", tcol, t, COLOR_RESET);
-        strncat(row, perm, sizeof(row) - strlen(row) - 1);
-
-        const mode_t bits[9] = {
-            S_IRUSR, S_IWUSR, S_IXUSR,
-            S_IRGRP, S_IWGRP, S_IXGRP,
-            S_IROTH, S_IWOTH, S_IXOTH
-        };
-
-        for (int i = 0; i < 9; i++) {
-            char ch;
-            if (item->mode & bits[i]) ch = (i % 3 == 0) ? 'r' : (i % 3 == 1) ? 'w' : 'x';
-            else ch = '-';
-
-            const char *c =
-                (ch == 'r') ? COLOR_GREEN :
-                (ch == 'w') ? COLOR_YELLOW :
-                (ch == 'x') ? (COLOR_RED COLOR_BOLD) :
-                (COLOR_DIM COLOR_GRAY);
-
-            char one[32];
-            snprintf(one, sizeof(one), "%s%c%s", c, ch, COLOR_RESET);
-            strncat(row, one, sizeof(row) - strlen(row) - 1);
-        }
+        rb_ansi(&rb, tcol);
+        rb_char(&rb, t);
+        rb_ansi(&rb, COLOR_RESET);
 
-        strncat(row, " ", sizeof(row) - strlen(row) - 1);
+        const PermStr *p = &g_perm_table[item->mode & 0777];
+        rb_add(&rb, p->s, p->len, 9);
+        rb_char(&rb, ' ');
     }
 
     // owner / group
     if (opts.numeric_ids) {
-        char tmp[128];
-        snprintf(tmp, sizeof(tmp), "%s%-8u%s ", COLOR_CYAN, item->uid, COLOR_RESET);
-        strncat(row, tmp, sizeof(row) - strlen(row) - 1);
+        size_t before;
+        rb_ansi(&rb, COLOR_CYAN);
+        before = rb.len;
+        rb_uint(&rb, item->uid);
+        rb_spaces(&rb, 8 - (int)(rb.len - before));
+        rb_ansi(&rb, COLOR_RESET);
+        rb_char(&rb, ' ');
 
         if (!opts.omit_group) {
-            snprintf(tmp, sizeof(tmp), "%s%-8u%s ", COLOR_CYAN, item->gid, COLOR_RESET);
-            strncat(row, tmp, sizeof(row) - strlen(row) - 1);
+            rb_ansi(&rb, COLOR_CYAN);
+            before = rb.len;
+            rb_uint(&rb, item->gid);
+            rb_spaces(&rb, 8 - (int)(rb.len - before));
+            rb_ansi(&rb, COLOR_RESET);
+            rb_char(&rb, ' ');
         }
     } else {
-        struct passwd *pw = getpwuid(item->uid);
-        char owner[9];
-        if (pw) snprintf(owner, sizeof(owner), "%-.8s", pw->pw_name);
-        else snprintf(owner, sizeof(owner), "%u", item->uid);
-
-        char tmp[128];
-        snprintf(tmp, sizeof(tmp), "%s%-8s%s ", COLOR_CYAN, owner, COLOR_RESET);
-        strncat(row, tmp, sizeof(row) - strlen(row) - 1);
+        size_t before;
+        const char *user = idcache_user(item->uid);
+        rb_ansi(&rb, COLOR_CYAN);
+        before = rb.len;
+        if (user) rb_text(&rb, user, strnlen(user, 8));
+        else rb_uint(&rb, item->uid);
+        rb_spaces(&rb, 8 - (int)(rb.len - before));
+        rb_ansi(&rb, COLOR_RESET);
+        rb_char(&rb, ' ');
 
         if (!opts.omit_group) {
-            struct group *gr = getgrgid(item->gid);
-            char group[9];
-            if (gr) snprintf(group, sizeof(group), "%-.8s", gr->gr_name);
-            else snprintf(group, sizeof(group), "%u", item->gid);
-
-            snprintf(tmp, sizeof(tmp), "%s%-8s%s ", COLOR_CYAN, group, COLOR_RESET);
-            strncat(row, tmp, sizeof(row) - strlen(row) - 1);
+            const char *gname = idcache_group(item->gid);
+            rb_ansi(&rb, COLOR_CYAN);
+            before = rb.len;
+            if (gname) rb_text(&rb, gname, strnlen(gname, 8));
+            else rb_uint(&rb, item->gid);
+            rb_spaces(&rb, 8 - (int)(rb.len - before));
+            rb_ansi(&rb, COLOR_RESET);
+            rb_char(&rb, ' ');
         }
     }
 
@@ -560,105 +904,408 @@ static void print_item_long_line(FileItem *item, int width, const char *prefix,
     {
         char size_str[32];
         const char *size_col = COLOR_RESET;
-        if (item->is_dir) {
+        if (item->is_dir && !du) {
             snprintf(size_str, sizeof(size_str), "<DIR>");
             size_col = COLOR_CYAN COLOR_BOLD;
         } else {
-            format_size(item->size, size_str, sizeof(size_str));
-            if (item->size >= (off_t)1024 * 1024 * 1024) size_col = COLOR_RED COLOR_BOLD;
-            else if (item->size >= (off_t)1024 * 1024 * 50) size_col = COLOR_YELLOW COLOR_BOLD;
+            off_t size = du ? (off_t)du->bytes : item->size;
+            format_size(size, size_str, sizeof(size_str));
+            if (size >= (off_t)1024 * 1024 * 1024) size_col = COLOR_RED COLOR_BOLD;
+            else if (size >= (off_t)1024 * 1024 * 50) size_col = COLOR_YELLOW COLOR_BOLD;
             else size_col = COLOR_GREEN;
         }
 
-        char tmp[128];
-        snprintf(tmp, sizeof(tmp), "%s%10s%s  ", size_col, size_str, COLOR_RESET);
-        strncat(row, tmp, sizeof(row) - strlen(row) - 1);
+        rb_ansi(&rb, size_col);
+        rb_text_right(&rb, size_str, strlen(size_str), 10);
+        rb_ansi(&rb, COLOR_RESET);
+        rb_spaces(&rb, 2);
+    }
+
+    // recursive file count
+    if (opts.du) {
+        if (du) {
+            char files_str[24];
+            int n = snprintf(files_str, sizeof(files_str), "%llu", du->files);
+            rb_ansi(&rb, COLOR_CYAN);
+            rb_text_right(&rb, files_str, (size_t)n, 8);
+            rb_ansi(&rb, COLOR_RESET);
+        } else {
+            rb_spaces(&rb, 8);
+        }
+        rb_spaces(&rb, 2);
     }
 
     // time
     {
         char time_str[32];
-        format_time(item->mtime, time_str, sizeof(time_str));
+        timefmt_format(item->mtime, time_str, sizeof(time_str));
         double age = difftime(now, item->mtime);
         const char *tcol = (age < 60 * 60 * 24 * 2) ? (COLOR_GREEN COLOR_BOLD) : (COLOR_DIM COLOR_GRAY);
 
-        char tmp[128];
-        snprintf(tmp, sizeof(tmp), "%s%-12s%s  ", tcol, time_str, COLOR_RESET);
-        strncat(row, tmp, sizeof(row) - strlen(row) - 1);
+        rb_ansi(&rb, tcol);
+        rb_text_left(&rb, time_str, strlen(time_str), 12);
+        rb_ansi(&rb, COLOR_RESET);
+        rb_spaces(&rb, 2);
+    }
+
+    if (git) {
+        rb_git(&rb, git);
+        rb_spaces(&rb, 2);
     }
 
     // icon + name
     {
         char icon = '-';
-        const char *name_col = COLOR_RESET;
+        const char *name_col = name_color(item);
+
+        if (item->is_dir) icon = 'D';
+        else if (S_ISLNK(item->mode)) icon = '@';
+        else if (item->mode & S_IXUSR) icon = '*';
+        else if (item->is_hidden) icon = '.';
+
+        rb_ansi(&rb, COLOR_WHITE);
+        rb_char(&rb, icon);
+        rb_ansi(&rb, COLOR_RESET);
+        rb_char(&rb, ' ');
+
+        // --du rows on a terminal cut the name to what the columns before
+        // it leave, since FILES makes nested rows run out of room fast.
+        // Pipes and plain -l keep whole names for scripts; a row with no
+        // room at all overflows as it is.
+        int room = 0;
+        if (opts.du && out_is_tty()) {
+            room = width - 3 - rb.vis - (opts.quote_names ? 2 : 0) - (opts.add_slash && item->is_dir);
+        }
+        rb_ansi(&rb, name_col);
+        if (opts.quote_names) rb_char(&rb, '"');
+        if (item->name_width > room && room > 0) {
+            int w;
+            size_t n = text_fit(item->name, item->name_len, room - 1, &w);
+            rb_add(&rb, item->name, n, w);
+            rb_add(&rb, GLYPH_ELLIPSIS, strlen(GLYPH_ELLIPSIS), 1);
+        } else {
+            rb_add(&rb, item->name, item->name_len, item->name_width);
+        }
+        if (opts.quote_names) rb_char(&rb, '"');
+
+        if (opts.add_slash && item->is_dir) {
+            rb_ansi(&rb, COLOR_DIM COLOR_GRAY);
+            rb_char(&rb, '/');
+        }
+        rb_ansi(&rb, COLOR_RESET);
+    }
 
-        if (item->is_dir) { icon = 'D'; name_col = COLOR_CYAN COLOR_BOLD; }
-        else if (S_ISLNK(item->mode)) { icon = '@'; name_col = COLOR_MAGENTA COLOR_BOLD; }
-        else if (item->mode & S_IXUSR) { icon = '*'; name_col = COLOR_GREEN COLOR_BOLD; }
-        else if (item->is_hidden) { icon = '.'; name_col = COLOR_DIM COLOR_MAGENTA; }
+    print_row(width, &rb);
+}
 
-        char tmp[512];
-        snprintf(tmp, sizeof(tmp), "%s%c%s %s%s%s",
-                 COLOR_WHITE, icon, COLOR_RESET,
-                 name_col,
-                 opts.quote_names ? "\"" : "",
-                 item->name);
-        strncat(row, tmp, sizeof(row) - strlen(row) - 1);
+static int is_dot_entry(const char *name) {
+    return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
 
-        if (opts.quote_names) strncat(row, "\"", sizeof(row) - strlen(row) - 1);
+// --json / --ndjson / -0: records go straight from the FileItem into
+// the output buffer, with nothing formatted or allocated in between.
+// Paths are relative to the current directory when no target was given,
+// and start with the target as written otherwise, like find(1).
+static const char *g_path_base;
+static unsigned long g_records;
 
-        if (opts.add_slash && item->is_dir) {
-            strncat(row, COLOR_DIM COLOR_GRAY "/", sizeof(row) - strlen(row) - 1);
-            strncat(row, COLOR_RESET, sizeof(row) - strlen(row) - 1);
-        } else {
-            strncat(row, COLOR_RESET, sizeof(row) - strlen(row) - 1);
+static void emit_path_part(const char *s, size_t n) {
+    if (opts.output == OUTPUT_NUL) out_write(s, n);
+    else                           out_json_chars(s, n);
+}
+
+// dir is the directory item lives in, or NULL when item is the target itself.
+static void emit_record_path(const char *dir, const FileItem *item) {
+    if (!dir) {
+        if (g_path_base) emit_path_part(g_path_base, strlen(g_path_base));
+        else             emit_path_part(item->name, item->name_len);
+        return;
+    }
+    if (g_path_base) {
+        size_t n = strlen(g_path_base);
+        emit_path_part(g_path_base, n);
+        if (n && g_path_base[n - 1] != '/') emit_path_part("/", 1);
+    }
+    const char *rel = root_relative(dir);
+    if (*rel) {
+        emit_path_part(rel, strlen(rel));
+        emit_path_part("/", 1);
+    }
+    emit_path_part(item->name, item->name_len);
+}
+
+static const char *record_type(mode_t mode) {
+    if (S_ISREG(mode))  return "file";
+    if (S_ISDIR(mode))  return "dir";
+    if (S_ISLNK(mode))  return "symlink";
+    if (S_ISFIFO(mode)) return "fifo";
+    if (S_ISSOCK(mode)) return "socket";
+    if (S_ISCHR(mode))  return "char";
+    if (S_ISBLK(mode))  return "block";
+    return "unknown";
+}
+
+static void print_record(const char *dir, const FileItem *item, const WalkTotals *du, const char *git) {
+    g_records++;
+    if (opts.output == OUTPUT_NUL) {
+        emit_record_path(dir, item);
+        out_putc('\0');
+        return;
+    }
+
+    if (opts.output == OUTPUT_JSON) {
+        if (g_records > 1) out_putc(',');
+        out_putc('\n');
+    }
+    out_lit("{\"path\":\"");
+    emit_record_path(dir, item);
+    out_lit("\",\"name\":\"");
+    out_json_chars(item->name, item->name_len);
+    out_lit("\",\"type\":\"");
+    out_puts(record_type(item->mode));
+
+    char mode[4];
+    unsigned perm = (unsigned)item->mode & 07777;
+    for (int k = 3; k >= 0; k--, perm >>= 3) mode[k] = (char)('0' + (perm & 7));
+    out_lit("\",\"mode\":\"");
+    out_write(mode, sizeof(mode));
+
+    out_lit("\",\"size\":");
+    out_int((long long)item->size);
+    out_lit(",\"mtime\":");
+    out_int((long long)item->mtime);
+    out_lit(",\"uid\":");
+    out_uint((unsigned long long)item->uid);
+    out_lit(",\"gid\":");
+    out_uint((unsigned long long)item->gid);
+    if (opts.long_format && !opts.numeric_ids) {
+        const char *user = idcache_user(item->uid);
+        const char *group = idcache_group(item->gid);
+        if (user) {
+            out_lit(",\"user\":\"");
+            out_json_chars(user, strlen(user));
+            out_putc('"');
         }
+        if (group) {
+            out_lit(",\"group\":\"");
+            out_json_chars(group, strlen(group));
+            out_putc('"');
+        }
+    }
+    out_lit(",\"ino\":");
+    out_uint((unsigned long long)item->inode);
+    out_lit(",\"nlink\":");
+    out_uint((unsigned long long)item->nlink);
+    if (du && item->is_dir) {
+        out_lit(",\"du_bytes\":");
+        out_uint(du->bytes);
+        out_lit(",\"du_files\":");
+        out_uint(du->files);
+    }
+    if (git) {
+        out_lit(",\"git\":\"");
+        out_json_chars(git, 2);
+        out_putc('"');
     }
+    out_putc('}');
+    if (opts.output == OUTPUT_NDJSON) out_putc('\n');
+}
+
+// One entry of the listing, nested level deep under dir (see print_record).
+static void print_entry_row(const char *dir, const FileItem *item, int level, int is_last, int width,
+                            const WalkTotals *du) {
+    // Directories sum up what is below them when the listing shows it.
+    char git_buf[2];
+    const char *git = NULL;
+    if (g_git) {
+        uint64_t t0 = stats_start();
+        gitrepo_status(g_git, dir ? root_relative(dir) : NULL, item, opts.depth > 0 || opts.interactive, git_buf);
+        stats_stop(STATS_GIT, t0);
+        git = git_buf;
+    }
+
+    if (opts.output != OUTPUT_BOX) {
+        print_record(dir, item, du, git);
+        return;
+    }
+
+    char prefix[256];
+    int prefix_visible = make_indent_prefix(prefix, sizeof(prefix), level, is_last);
 
-    print_row_content(width, row);
+    if (opts.long_format) print_item_long_line(item, du, git, width, prefix, prefix_visible);
+    else                 print_item_simple_line(item, git, width, prefix, prefix_visible);
 }
+
+static void print_nested_row(const FileList *list, int i, int is_last, int level, int width,
+                             const WalkTotals *du) {
+    FileItem child;
+    filelist_get(list, i, &child);
+    print_entry_row(list->dir, &child, level, is_last, width, du);
+}
+
+// Nested levels of the -R / -D walk are loaded into one reusable scratch
+// list, then frozen into a stack arena that is pushed on entry and popped
+// on exit, so siblings reuse the same memory and peak usage tracks the
+// entries along the current path rather than the depth.
+static Arena g_walk_arena;
+static FileList g_walk_scratch;
+
 static void emit_directory_children_inline(const char *dir_path, int level, int width) {
     if (opts.depth <= 0) return;
     if (level > opts.depth) return;   // also fixes -D 1 behavior
 
-    FileList *list = calloc(1, sizeof(*list));
-    if (!list) return;
+    if (load_directory(&g_walk_scratch, dir_path, 0) != 0) return;
 
-    if (load_directory(list, dir_path) != 0) {
-        free(list);
+    sort_list(&g_walk_scratch);
+
+    ArenaMark mark = arena_mark(&g_walk_arena);
+    FileList list;
+    if (filelist_freeze(&g_walk_scratch, &g_walk_arena, &list) != 0) {
+        arena_release(&g_walk_arena, mark);
         return;
     }
 
+    char child_path[MAX_PATH];
+    for (int i = 0; i < list.count; i++) {
+        if (is_dot_entry(filelist_name(&list, i))) continue;
+
+        print_nested_row(&list, i, i == list.count - 1, level, width, NULL);
+
+        if ((list.flags[i] & FI_DIR) && level < opts.depth && descend_allowed(&list, i) &&
+            first_visit(list.dev[i], list.inode[i]) && filelist_path(&list, i, child_path, sizeof(child_path)) >= 0) {
+            emit_directory_children_inline(child_path, level + 1, width);
+        }
+    }
+
+    arena_release(&g_walk_arena, mark);
+}
+
+// With -j N > 1 the same walk is prefetched by a pool of loader threads;
+// rows are still emitted here, in the same depth-first order.
+static Walker *g_walker;
+
+static int walk_load(FileList *list, const char *path, void *ctx) {
+    (void)ctx;
+    // -L: the walker's directories are claimed as they are loaded, which
+    // without workers is in the order their rows are printed.
+    if (g_visited) {
+        struct stat st;
+        if (stat_at(AT_FDCWD, path, &st, 0) == 0 && !first_visit(st.st_dev, st.st_ino)) return -1;
+    }
+    // --du counts what -a and the patterns leave off the rows too.
+    if (load_directory(list, path, opts.du) != 0) return -1;
     sort_list(list);
+    return 0;
+}
 
+// --du needs every subdirectory counted, however deep the rows go and
+// whatever the patterns say.
+static int walk_descend(const FileList *list, int i, int level, void *ctx) {
+    (void)ctx;
+    if (!(list->flags[i] & FI_DIR) || is_dot_entry(filelist_name(list, i))) return 0;
+    if (opts.du) return dir_enterable(list->dev[i]);
+    return level + 1 <= opts.depth && descend_allowed(list, i);
+}
+
+// --du: files are counted once per (dev, inode) across the whole walk,
+// so hardlinks (and with -L files reached through symlinks) are not
+// double counted; directories themselves are not counted, only what
+// they contain.
+static InoSet *g_du_links;
+
+static void du_sum(const FileList *list, WalkTotals *own, void *ctx) {
+    (void)ctx;
+    own->bytes = 0;
+    own->files = 0;
     for (int i = 0; i < list->count; i++) {
-        FileItem *child = &list->items[i];
+        if (list->flags[i] & FI_DIR) continue;
+        if ((opts.follow || list->nlink[i] > 1) && inoset_insert(g_du_links, list->dev[i], list->inode[i]) == 0) continue;
+        own->bytes += (unsigned long long)list->size[i];
+        own->files++;
+    }
+}
+
+static WalkNode *row_node(WalkNode *node, WalkNode *const *roots, int i) {
+    if (node) return walk_node_child(node, i);
+    return roots ? roots[i] : NULL;
+}
+
+// -S with --du: order rows by their recursive totals, which means
+// waiting for every subtree of the list first. The list is sorted
+// through a view whose size column carries the totals. Returns NULL
+// when rows print in list order.
+static uint32_t *du_size_order(const FileList *list, WalkNode *node, WalkNode *const *roots) {
+    if (!opts.du || !opts.sort_by_size || !g_walker || list->count < 2) return NULL;
+
+    off_t *sizes = malloc((size_t)list->count * sizeof(*sizes));
+    uint32_t *order = malloc((size_t)list->count * sizeof(*order));
+    if (!sizes || !order) {
+        free(sizes);
+        free(order);
+        return NULL;
+    }
+
+    for (int i = 0; i < list->count; i++) {
+        WalkNode *c = row_node(node, roots, i);
+        WalkTotals t;
+        if (c) walker_wait_totals(g_walker, c, &t);
+        sizes[i] = c ? (off_t)t.bytes : list->size[i];
+    }
 
-        if (strcmp(child->name, ".") == 0 || strcmp(child->name, "..") == 0) continue;
+    FileList view = *list;
+    view.size = sizes;
+    uint64_t t0 = stats_start();
+    if (filelist_sort_order(&view, SORT_SIZE, opts.reverse, order) != 0) {
+        free(order);
+        order = NULL;
+    }
+    stats_stop(STATS_SORT, t0);
+    free(sizes);
+    return order;
+}
 
-        int is_last = (i == list->count - 1);
+// Totals for the row of subtree node c (NULL without --du).
+static const WalkTotals *du_row_totals(WalkNode *c, WalkTotals *buf) {
+    if (!opts.du || !c) return NULL;
+    walker_wait_totals(g_walker, c, buf);
+    return buf;
+}
+
+// Emit the subtree below a row, or, for a node that was only walked to
+// be counted, just let it go.
+static void emit_walk_node(WalkNode *node, int level, int width);
+
+static void emit_row_subtree(WalkNode *c, int level, int width) {
+    if (walk_node_shown(c)) emit_walk_node(c, level, width);
+    else walker_release(g_walker, c);
+}
 
-        char prefix[256];
-        make_indent_prefix(prefix, sizeof(prefix), level, is_last);
-        int prefix_visible = (int)strlen(prefix);
+static void emit_walk_node(WalkNode *node, int level, int width) {
+    if (walker_wait(g_walker, node) == 0) {
+        const FileList *list = walk_node_list(node);
+        uint32_t *order = du_size_order(list, node, NULL);
+        for (int k = 0; k < list->count; k++) {
+            int i = order ? (int)order[k] : k;
+            if (is_dot_entry(filelist_name(list, i))) continue;
 
-        if (opts.long_format) print_item_long_line(child, width, prefix, prefix_visible);
-        else                 print_item_simple_line(child, width, prefix, prefix_visible);
+            WalkNode *child = walk_node_child(node, i);
+            WalkTotals t;
+            print_nested_row(list, i, k == list->count - 1, level, width, du_row_totals(child, &t));
 
-        if (child->is_dir) {
-            emit_directory_children_inline(child->full_path, level + 1, width);
+            if (child) emit_row_subtree(child, level + 1, width);
         }
+        free(order);
     }
-
-    free(list);
+    walker_release(g_walker, node);
 }
 
-static void draw_header(FileList *list, int width) {
+static void draw_header(const char *title, int width) {
     print_border_top(width);
 
-    printf("%s%s%s ", COLOR_WHITE, GLYPH_V, COLOR_RESET);
-    printf("%s%slsx%s %s", COLOR_BG_CYAN, COLOR_BOLD, COLOR_RESET, list->cwd);
-    int title_visible = 1 + (int)strlen("lsx ") + (int)strlen(list->cwd);
+    print_row_prefix();
+    out_lit(COLOR_BG_CYAN COLOR_BOLD "lsx" COLOR_RESET " ");
+    out_puts(title);
+    int title_visible = 1 + (int)strlen("lsx ") + (int)strlen(title);
     print_row_suffix(width, title_visible);
 
     print_border_mid(width);
@@ -670,114 +1317,634 @@ static void draw_long_header_row(int width) {
 
     // no prefix column in header; nested items will insert a prefix before inode/perms, etc.
     if (opts.show_inode) {
-        printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "INODE", COLOR_RESET);
+        out_printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "INODE", COLOR_RESET);
         used += 9;
     }
 
-    printf("%s%-10s%s ", COLOR_YELLOW COLOR_BOLD, "PERMS", COLOR_RESET);
+    out_printf("%s%-10s%s ", COLOR_YELLOW COLOR_BOLD, "PERMS", COLOR_RESET);
     used += 11;
 
     if (opts.numeric_ids) {
-        printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "UID", COLOR_RESET);
+        out_printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "UID", COLOR_RESET);
         used += 9;
         if (!opts.omit_group) {
-            printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "GID", COLOR_RESET);
+            out_printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "GID", COLOR_RESET);
             used += 9;
         }
     } else {
-        printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "OWNER", COLOR_RESET);
+        out_printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "OWNER", COLOR_RESET);
         used += 9;
         if (!opts.omit_group) {
-            printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "GROUP", COLOR_RESET);
+            out_printf("%s%-8s%s ", COLOR_YELLOW COLOR_BOLD, "GROUP", COLOR_RESET);
             used += 9;
         }
     }
 
-    printf("%s%10s%s  %s%-12s%s  %s%s%s",
-           COLOR_YELLOW COLOR_BOLD, "SIZE", COLOR_RESET,
-           COLOR_YELLOW COLOR_BOLD, "MODIFIED", COLOR_RESET,
-           COLOR_YELLOW COLOR_BOLD, "NAME", COLOR_RESET);
+    out_printf("%s%10s%s  ", COLOR_YELLOW COLOR_BOLD, "SIZE", COLOR_RESET);
+    used += 10 + 2;
+
+    if (opts.du) {
+        out_printf("%s%8s%s  ", COLOR_YELLOW COLOR_BOLD, "FILES", COLOR_RESET);
+        used += 8 + 2;
+    }
+
+    out_printf("%s%-12s%s  ", COLOR_YELLOW COLOR_BOLD, "MODIFIED", COLOR_RESET);
+    used += 12 + 2;
+
+    if (g_git) {
+        // Wider than the two-character column it heads.
+        out_printf("%s%s%s ", COLOR_YELLOW COLOR_BOLD, "GIT", COLOR_RESET);
+        used += 3 + 1;
+    }
 
-    used += 10 + 2 + 12 + 2 + 4;
+    out_printf("%s%s%s", COLOR_YELLOW COLOR_BOLD, "NAME", COLOR_RESET);
+    used += 4;
     print_row_suffix(width, used);
 
     print_border_mid(width);
 }
 
+// Everything printed before the first row and after the last one.
+static void listing_begin(const char *title, int width) {
+    if (opts.output == OUTPUT_JSON) out_putc('[');
+    if (opts.output != OUTPUT_BOX) return;
+
+    draw_header(title, width);
+    if (opts.long_format) draw_long_header_row(width);
+}
+
+static void listing_end(int count, int width) {
+    if (opts.output == OUTPUT_JSON) out_lit("\n]\n");
+    if (opts.output != OUTPUT_BOX) return;
+
+    print_border_bottom(width);
+    out_printf("%s  %d items total%s\n", COLOR_DIM COLOR_GRAY, count, COLOR_RESET);
+}
+
 static void draw_single_box_listing(const char *target_path) {
     int width = get_term_width();
-    FileList *list = (FileList *)calloc(1, sizeof(*list));
-    if (!list) return;
-
-    if (load_directory(list, target_path) != 0) {
-        if (errno == ENOTDIR) {
-            if (load_single_file(list, target_path) != 0) { free(list); return; }
-        } else {
-            if (load_single_file(list, target_path) != 0) { free(list); return; }
-        }
+    FileList list;
+    filelist_init(&list);
+
+    const char *dir = NULL;
+    if (load_directory(&list, target_path, 0) == 0) {
+        dir = list.dir;
+    } else if (load_single_file(&list, target_path) != 0) {
+        if (opts.output == OUTPUT_JSON) out_lit("[]\n");
+        filelist_free(&list);
+        return;
     }
 
-    sort_list(list);
+    sort_list(&list);
 
     // COMMA MODE: keep your original behavior (no boxes); depth doesn't apply here.
     if (opts.comma_separated) {
-        for (int i = 0; i < list->count; i++) {
-            FileItem *item = &list->items[i];
-            const char *color = COLOR_RESET;
-            if (item->is_dir) color = COLOR_CYAN;
-            else if (item->mode & S_IXUSR) color = COLOR_GREEN;
-            else if (S_ISLNK(item->mode)) color = COLOR_MAGENTA;
-
-            printf("%s", color);
-            if (opts.quote_names) printf("\"%s\"", item->name);
-            else printf("%s", item->name);
-            printf("%s", COLOR_RESET);
-            if (i < list->count - 1) printf(", ");
-        }
-        printf("\n");
-        if (opts.pattern) { /* freed in main */ }
-        free(list);
+        for (int i = 0; i < list.count; i++) {
+            FileItem item;
+            filelist_get(&list, i, &item);
+            out_puts(name_color(&item));
+            if (opts.quote_names) out_putc('"');
+            out_write(item.name, item.name_len);
+            if (opts.quote_names) out_putc('"');
+            out_lit(COLOR_RESET);
+            if (i < list.count - 1) out_lit(", ");
+        }
+        out_putc('\n');
+        filelist_free(&list);
         return;
     }
 
-    // Draw ONE box header
-    draw_header(list, width);
+    // Hand every top-level subtree to the loader threads up front, in
+    // listing order, so they are warm by the time we print them.
+    char item_path[MAX_PATH];
+    WalkNode **roots = NULL;
+    if (g_walker && list.count > 0) {
+        roots = calloc((size_t)list.count, sizeof(*roots));
+        for (int i = 0; roots && i < list.count; i++) {
+            if (walk_descend(&list, i, 0, NULL) &&
+                filelist_path(&list, i, item_path, sizeof(item_path)) >= 0) {
+                roots[i] = walker_submit(g_walker, item_path, 1);
+            }
+        }
+    }
+
+    listing_begin(list.cwd, width);
+
+    uint32_t *order = du_size_order(&list, NULL, roots);
+    for (int k = 0; k < list.count; k++) {
+        int i = order ? (int)order[k] : k;
+        FileItem item;
+        filelist_get(&list, i, &item);
+
+        WalkTotals t;
+        print_entry_row(dir, &item, 0, 0, width, du_row_totals(roots ? roots[i] : NULL, &t));
+
+        // Inline children (depth). With roots, walk_descend already had
+        // its say.
+        if (roots && roots[i]) {
+            emit_row_subtree(roots[i], 1, width);
+        } else if (!roots && walk_descend(&list, i, 0, NULL) && first_visit(list.dev[i], list.inode[i]) &&
+                   filelist_path(&list, i, item_path, sizeof(item_path)) >= 0) {
+            emit_directory_children_inline(item_path, 1, width);
+        }
+    }
+    free(order);
+    free(roots);
+
+    listing_end(list.count, width);
+
+    filelist_free(&list);
+}
+
+// -U: rows are printed as the directory is read, in on-disk order, with
+// nothing kept but the entry being printed and a one-entry lookahead per
+// level (the tree prefix needs to know whether an entry is the last one).
+// Nested levels use small read buffers so deep trees stay cheap.
+#define STREAM_NESTED_BUF (32 * 1024)
+
+typedef struct {
+    char name[256];
+    FileItem item;
+} StreamRow;
+
+static int stream_next(DirScan *ds, const char *rel, StreamRow *row) {
+    DirEntry entry;
+    while (dirscan_next(ds, &entry) > 0) {
+        if (!entry_listed(dirscan_fd(ds), rel, &entry)) continue;
+
+        stat_dir_entry(dirscan_fd(ds), &entry, &row->item);
+        snprintf(row->name, sizeof(row->name), "%s", entry.name);
+        row->item.name = row->name;
+        row->item.name_len = strlen(row->name);
+        row->item.name_width = text_width(row->name, row->item.name_len);
+        return 1;
+    }
+    return 0;
+}
 
-    if (opts.long_format) {
-        draw_long_header_row(width);
+static void stream_print_row(const char *dir, const FileItem *item, int level, int is_last, int width) {
+    print_entry_row(dir, item, level, is_last, width, NULL);
+    out_flush_tty();
+}
 
-        for (int i = 0; i < list->count; i++) {
-            FileItem *item = &list->items[i];
-            print_item_long_line(item, width, "", 0);
+static int stream_child_path(const char *dir, const StreamRow *row, char *out, size_t outsz) {
+    int n = snprintf(out, outsz, "%s/%s", dir, row->name);
+    return (n < 0 || (size_t)n >= outsz) ? -1 : 0;
+}
 
-            // Inline children (depth)
-            if (opts.depth > 0 && item->is_dir &&
-                strcmp(item->name, ".") != 0 && strcmp(item->name, "..") != 0) {
-                emit_directory_children_inline(item->full_path, 1, width);
+static void stream_children_inline(const char *dir_path, int level, int width) {
+    if (opts.depth <= 0) return;
+    if (level > opts.depth) return;
+
+    DirScan *ds = dirscan_open_sized(dir_path, STREAM_NESTED_BUF);
+    if (!ds) return;
+
+    const char *rel = root_relative(dir_path);
+    StreamRow rows[2];
+    int cur = 0;
+    int have = stream_next(ds, rel, &rows[cur]);
+
+    char child_path[MAX_PATH];
+    while (have) {
+        int more = stream_next(ds, rel, &rows[!cur]);
+        StreamRow *row = &rows[cur];
+
+        if (!is_dot_entry(row->name)) {
+            stream_print_row(dir_path, &row->item, level, !more, width);
+            if (row->item.is_dir && level < opts.depth &&
+                (!g_matcher || matcher_may_contain(g_matcher, rel, row->name)) &&
+                dir_enterable(row->item.dev) && first_visit(row->item.dev, row->item.inode) &&
+                stream_child_path(dir_path, row, child_path, sizeof(child_path)) == 0) {
+                stream_children_inline(child_path, level + 1, width);
             }
         }
 
+        cur = !cur;
+        have = more;
+    }
+
+    dirscan_close(ds);
+}
+
+static void draw_streaming_listing(const char *target_path) {
+    DirScan *ds = dirscan_open(target_path);
+    if (!ds) {
+        // Not a directory (or unreadable): nothing to stream.
+        draw_single_box_listing(target_path);
+        return;
+    }
+
+    int width = get_term_width();
+    int count = 0;
+    StreamRow row;
+
+    if (opts.comma_separated) {
+        while (stream_next(ds, "", &row)) {
+            if (count++ > 0) out_lit(", ");
+            out_puts(name_color(&row.item));
+            if (opts.quote_names) out_putc('"');
+            out_write(row.name, row.item.name_len);
+            if (opts.quote_names) out_putc('"');
+            out_lit(COLOR_RESET);
+            out_flush_tty();
+        }
+        out_putc('\n');
+        dirscan_close(ds);
+        return;
+    }
+
+    listing_begin(target_path, width);
+
+    char child_path[MAX_PATH];
+    while (stream_next(ds, "", &row)) {
+        count++;
+        stream_print_row(target_path, &row.item, 0, 0, width);
+
+        if (opts.depth > 0 && row.item.is_dir && !is_dot_entry(row.name) &&
+            (!g_matcher || matcher_may_contain(g_matcher, "", row.name)) &&
+            dir_enterable(row.item.dev) && first_visit(row.item.dev, row.item.inode) &&
+            stream_child_path(target_path, &row, child_path, sizeof(child_path)) == 0) {
+            stream_children_inline(child_path, 1, width);
+        }
+    }
+    dirscan_close(ds);
+
+    listing_end(count, width);
+}
+
+// --watch: each frame is rendered into memory and compared line by line
+// with the one on screen; only lines that differ are rewritten, with the
+// cursor moved to them. Between frames lsx sleeps in poll() on the
+// inotify descriptor.
+#define WATCH_SETTLE_MS 50    // let a burst of events finish before drawing
+#define WATCH_SETTLE_MAX 10   // but redraw at least every 0.5 s while it lasts
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    size_t *lines;   // start offset of each line
+    int nlines;
+    int lines_cap;
+} Frame;
+
+static volatile sig_atomic_t g_watch_stop;
+static volatile sig_atomic_t g_watch_resized;
+
+static void on_watch_signal(int sig) {
+    if (sig == SIGWINCH) g_watch_resized = 1;
+    else g_watch_stop = 1;
+}
+
+static void frame_sink(const char *s, size_t n, void *ctx) {
+    Frame *f = ctx;
+    if (f->len + n > f->cap) {
+        size_t ncap = f->cap ? f->cap : 64 * 1024;
+        while (ncap < f->len + n) ncap *= 2;
+        char *p = realloc(f->buf, ncap);
+        if (!p) return;
+        f->buf = p;
+        f->cap = ncap;
+    }
+    memcpy(f->buf + f->len, s, n);
+    f->len += n;
+}
+
+static void frame_split(Frame *f) {
+    f->nlines = 0;
+    size_t start = 0;
+    while (start < f->len) {
+        if (f->nlines == f->lines_cap) {
+            int ncap = f->lines_cap ? f->lines_cap * 2 : 256;
+            size_t *p = realloc(f->lines, (size_t)ncap * sizeof(*p));
+            if (!p) return;
+            f->lines = p;
+            f->lines_cap = ncap;
+        }
+        f->lines[f->nlines++] = start;
+        const char *nl = memchr(f->buf + start, '\n', f->len - start);
+        start = nl ? (size_t)(nl - f->buf) + 1 : f->len;
+    }
+}
+
+// Line k without its newline.
+static const char *frame_line(const Frame *f, int k, size_t *len) {
+    size_t end = k + 1 < f->nlines ? f->lines[k + 1] : f->len;
+    const char *s = f->buf + f->lines[k];
+    if (end > f->lines[k] && f->buf[end - 1] == '\n') end--;
+    *len = end - f->lines[k];
+    return s;
+}
+
+static int term_height(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0) return ws.ws_row;
+    const char *env = getenv("LINES");
+    int h = env ? atoi(env) : 0;
+    return h > 0 ? h : 24;
+}
+
+// Draw cur over prev (what the terminal shows now), or everything after
+// a clear when full is set. Lines past the bottom of the screen are not
+// drawn: addressing them would scroll the frame.
+static void frame_draw(const Frame *prev, const Frame *cur, int full) {
+    int height = term_height();
+    int shown = cur->nlines < height ? cur->nlines : height;
+    int was = full ? 0 : (prev->nlines < height ? prev->nlines : height);
+
+    int drawn = 0;
+    if (full) out_lit("\033[H\033[2J");
+    for (int k = 0; k < shown; k++) {
+        size_t n, pn = 0;
+        const char *line = frame_line(cur, k, &n);
+        const char *old = k < was ? frame_line(prev, k, &pn) : NULL;
+        if (old && pn == n && memcmp(old, line, n) == 0) continue;
+
+        out_printf("\033[%d;1H", k + 1);
+        out_write(line, n);
+        out_lit("\033[K");
+        drawn++;
+    }
+    if (shown < was) {
+        out_printf("\033[%d;1H\033[J", shown + 1);
+        drawn++;
+    }
+    if (drawn || full) out_printf("\033[%d;1H", shown < height ? shown + 1 : height);
+}
+
+// Fill an entry reported by inotify the same way a directory read would.
+static int watch_fill(const char *dir, const char *name, FileItem *item, void *ctx) {
+    (void)ctx;
+    if (!opts.show_hidden && name[0] == '.') return 0;
+
+    char path[MAX_PATH];
+    struct stat st;
+    int n = snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (n < 0 || (size_t)n >= sizeof(path) || lstat(path, &st) != 0) return 0;
+
+    DirEntry entry = { name, st.st_ino, 0 };
+#ifdef DT_UNKNOWN
+    entry.type = IFTODT(st.st_mode);
+#endif
+    if (!entry_passes(-1, root_relative(dir), &entry)) return 0;
+
+    memset(item, 0, sizeof(*item));
+    if (entry_needs_stat(entry.type)) {
+        item_from_stat(item, &st);
     } else {
-        for (int i = 0; i < list->count; i++) {
-            FileItem *item = &list->items[i];
-            print_item_simple_line(item, width, "", 0);
-
-            // Inline children (depth)
-            if (opts.depth > 0 && item->is_dir &&
-                strcmp(item->name, ".") != 0 && strcmp(item->name, "..") != 0) {
-                emit_directory_children_inline(item->full_path, 1, width);
-            }
+        item->mode = st.st_mode & S_IFMT;
+        item->inode = st.st_ino;
+        item->is_dir = S_ISDIR(st.st_mode);
+    }
+    item->is_hidden = (name[0] == '.');
+    return 1;
+}
+
+// Wait for the next thing worth a new frame. Returns 0 to draw, 1 to draw
+// from a cleared screen, -1 to stop.
+static int watch_wait(const char *target) {
+    struct pollfd pfd = { watch_fd(g_watch), POLLIN, 0 };
+    for (;;) {
+        int r = poll(&pfd, 1, -1);
+        if (g_watch_stop) return -1;
+        if (g_watch_resized) {
+            g_watch_resized = 0;
+            return 1;
+        }
+        if (r <= 0) continue;
+
+        int changed = watch_process(g_watch, target);
+        for (int k = 0; changed >= 0 && k < WATCH_SETTLE_MAX &&
+                        poll(&pfd, 1, WATCH_SETTLE_MS) > 0; k++) {
+            int more = watch_process(g_watch, target);
+            changed = more < 0 ? more : changed + more;
+        }
+        if (changed < 0) {
+            fprintf(stderr, "lsx: %s: directory is gone\n", target);
+            return -1;
         }
+        if (changed > 0) return 0;
     }
+}
+
+static int run_watch(const char *target) {
+    struct stat st;
+    if (stat(target, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "lsx: --watch needs a directory: %s\n", target);
+        return 1;
+    }
+    g_watch = watch_new(watch_fill, NULL);
+    if (!g_watch) {
+        fprintf(stderr, "lsx: --watch: %s\n", strerror(errno));
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_watch_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGWINCH, &sa, NULL);
+
+    Frame frames[2];
+    memset(frames, 0, sizeof(frames));
+    Frame *prev = &frames[0], *cur = &frames[1];
+
+    out_lit("\033[?25l");
+    for (int full = 1; full >= 0; full = watch_wait(target)) {
+        cur->len = 0;
+        timefmt_refresh();   // recent files stop being recent while we watch
+        out_set_sink(frame_sink, cur);
+        draw_single_box_listing(target);
+        out_set_sink(NULL, NULL);
+        frame_split(cur);
+
+        frame_draw(prev, cur, full);
+        out_flush();
+
+        Frame *t = prev;
+        prev = cur;
+        cur = t;
+    }
+    out_lit("\033[?25h");
+
+    for (int k = 0; k < 2; k++) {
+        free(frames[k].buf);
+        free(frames[k].lines);
+    }
+    watch_free(g_watch);
+    g_watch = NULL;
+    return 0;
+}
+
+// -I: the browser draws rows with the same code as the box listing.
+static void browse_header(const char *title, int width, void *ctx) {
+    (void)ctx;
+    draw_header(title, width);
+    if (opts.long_format) draw_long_header_row(width);
+}
+
+static void browse_row(const FileList *list, int i, int level, int is_last, int width, void *ctx) {
+    (void)ctx;
+    print_nested_row(list, i, is_last, level, width, NULL);
+}
 
+static void browse_note(const char *text, int level, int width, void *ctx) {
+    (void)ctx;
+    char prefix[256];
+    int prefix_visible = make_indent_prefix(prefix, sizeof(prefix), level, 1);
+
+    RowBuf rb;
+    rb_init(&rb);
+    rb_prefix(&rb, prefix, prefix_visible);
+    rb_ansi(&rb, COLOR_DIM COLOR_GRAY);
+    rb_text(&rb, text, strlen(text));
+    rb_ansi(&rb, COLOR_RESET);
+    print_row(width, &rb);
+}
+
+static void browse_footer(int width, void *ctx) {
+    (void)ctx;
     print_border_bottom(width);
-    printf("%s  %d items total%s\n", COLOR_DIM COLOR_GRAY, list->count, COLOR_RESET);
+}
 
-    free(list);
+// Only what the user opens is loaded.
+static int browse_descend(const FileList *list, int i, int level, void *ctx) {
+    (void)list;
+    (void)i;
+    (void)level;
+    (void)ctx;
+    return 0;
+}
+
+static int run_browser(const char *target, int threads) {
+    struct stat st;
+    if (stat(target, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "lsx: -I needs a directory: %s\n", target);
+        return 1;
+    }
+
+    Walker *w = walker_create(threads, walk_load, browse_descend, NULL);
+    if (!w) {
+        fprintf(stderr, "lsx: out of memory\n");
+        return 1;
+    }
+    BrowseConfig cfg = { w, browse_header, browse_row, browse_note, browse_footer, NULL };
+    int rc = browse_run(target, &cfg);
+    walker_destroy(w);
+
+    if (rc != 0) {
+        fprintf(stderr, "lsx: -I: could not initialize the terminal\n");
+        return 1;
+    }
+    return 0;
+}
+
+// --stats (or LSX_STATS=1) prints where the time went to stderr after
+// the listing; --stats=json (LSX_STATS=json) prints the same as one JSON
+// object per run, for collecting over time.
+static double ms(uint64_t ns) {
+    return (double)ns / 1e6;
+}
+
+static uint64_t tv_ns(struct timeval tv) {
+    return (uint64_t)tv.tv_sec * 1000000000u + (uint64_t)tv.tv_usec * 1000u;
+}
+
+static void print_stats(void) {
+    if (!opts.stats) return;
+
+    StatsSnapshot st;
+    stats_get(&st);
+    DirScanStats ds;
+    dirscan_get_stats(&ds);
+    IdCacheStats ids;
+    idcache_get_stats(&ids);
+    MdCacheStats cs;
+    if (g_cache) mdcache_get_stats(g_cache, &cs);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    long maxrss_kb = ru.ru_maxrss / 1024;
+#else
+    long maxrss_kb = ru.ru_maxrss;
+#endif
+
+    if (opts.stats == 2) {
+        fprintf(stderr, "{\"wall_ns\":%llu,\"user_ns\":%llu,\"sys_ns\":%llu,\"maxrss_kb\":%ld",
+                (unsigned long long)st.elapsed_ns, (unsigned long long)tv_ns(ru.ru_utime),
+                (unsigned long long)tv_ns(ru.ru_stime), maxrss_kb);
+        for (int p = 0; p < STATS_PHASES; p++) {
+            fprintf(stderr, ",\"%s_ns\":%llu,\"%s_calls\":%lu", stats_phase_name(p),
+                    (unsigned long long)st.phase_ns[p], stats_phase_name(p), st.phase_calls[p]);
+        }
+        fprintf(stderr, ",\"stat_backend\":\"%s\"", statbatch_backend());
+        fprintf(stderr, ",\"dirs_opened\":%lu,\"entries_seen\":%lu,\"entries_filtered\":%lu",
+                ds.opens, ds.entries, st.counters[STATS_FILTERED]);
+        fprintf(stderr, ",\"user_lookups\":%lu,\"group_lookups\":%lu,\"user_nss\":%lu,\"group_nss\":%lu",
+                ids.user_lookups, ids.group_lookups, ids.user_nss, ids.group_nss);
+        fprintf(stderr, ",\"bytes_written\":%llu,\"arena_high_water\":%zu",
+                out_bytes_written(), g_walk_arena.high_water);
+        if (g_cache) {
+            fprintf(stderr, ",\"cache_hits\":%lu,\"cache_misses\":%lu", cs.hits, cs.misses);
+        }
+        fprintf(stderr, "}\n");
+        return;
+    }
+
+    fprintf(stderr, "lsx: %.1f ms wall, %.1f ms user, %.1f ms sys, peak RSS %ld KB\n",
+            ms(st.elapsed_ns), ms(tv_ns(ru.ru_utime)), ms(tv_ns(ru.ru_stime)), maxrss_kb);
+    fprintf(stderr, "lsx:   readdir %9.1f ms  %lu dirs, %lu %s calls (%zu KB buffer), %lu entries, %lu filtered out\n",
+            ms(st.phase_ns[STATS_READDIR]), ds.opens, ds.reads, dirscan_backend(), dirscan_bufsize() / 1024,
+            ds.entries, st.counters[STATS_FILTERED]);
+    fprintf(stderr, "lsx:   stat    %9.1f ms  %lu calls (%s)\n", ms(st.phase_ns[STATS_STAT]), st.phase_calls[STATS_STAT],
+            statbatch_backend());
+    fprintf(stderr, "lsx:   ids     %9.1f ms  %lu user / %lu group lookups, %lu / %lu through NSS\n",
+            ms(st.phase_ns[STATS_IDS]), ids.user_lookups, ids.group_lookups, ids.user_nss, ids.group_nss);
+    fprintf(stderr, "lsx:   sort    %9.1f ms  %lu lists\n", ms(st.phase_ns[STATS_SORT]), st.phase_calls[STATS_SORT]);
+    fprintf(stderr, "lsx:   write   %9.1f ms  %lu calls, %llu bytes\n", ms(st.phase_ns[STATS_WRITE]),
+            st.phase_calls[STATS_WRITE], out_bytes_written());
+    if (g_git) {
+        fprintf(stderr, "lsx:   git     %9.1f ms  index and %lu entries\n", ms(st.phase_ns[STATS_GIT]),
+                st.phase_calls[STATS_GIT] - 1);
+    }
+
+    // With loader threads the phases overlap, so there is no remainder.
+    if (!g_walker) {
+        uint64_t timed = 0;
+        for (int p = 0; p < STATS_PHASES; p++) timed += st.phase_ns[p];
+        if (timed < st.elapsed_ns) {
+            fprintf(stderr, "lsx:   other   %9.1f ms  formatting and everything else\n", ms(st.elapsed_ns - timed));
+        }
+    } else {
+        fprintf(stderr, "lsx:   (phase times are summed over the loader threads)\n");
+    }
+
+    fprintf(stderr, "lsx: walk arena high-water: %zu bytes (%zu reserved)\n",
+            g_walk_arena.high_water, g_walk_arena.reserved);
+    if (g_cache) {
+        fprintf(stderr, "lsx: metadata cache: %lu hits (%llu entries), %lu misses, %lu dirs stored, %lu in file\n",
+                cs.hits, cs.entries, cs.misses, cs.stored, cs.records);
+    }
+}
+
+// Parse a byte count with an optional K/M suffix ("512K", "1M").
+static int parse_size(const char *s, size_t *out) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno || end == s) return -1;
+    if (*end == 'k' || *end == 'K') { v *= 1024; end++; }
+    else if (*end == 'm' || *end == 'M') { v *= 1024 * 1024; end++; }
+    if (*end) return -1;
+    *out = (size_t)v;
+    return 0;
 }
 
 static void print_usage(const char *prog) {
-    fprintf(stderr, "Usage: %s [OPTIONS] [DIRECTORY|FILE]\n", prog);
+    fprintf(stderr, "Usage: %s [OPTIONS] [DIRECTORY|FILE|PATTERN]\n", prog);
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  -a            Show all files including hidden\n");
     fprintf(stderr, "  -l            Long format (table)\n");
@@ -788,31 +1955,119 @@ static void print_usage(const char *prog) {
     fprintf(stderr, "  -R            Recursive listing (infinite inline depth)\n");
     fprintf(stderr, "  -D N          Inline depth inside ONE box (like tree -L). Example: -D 5\n");
     fprintf(stderr, "  --depth N     Same as -D\n");
+    fprintf(stderr, "  -j N          Load directories with N threads during -R / -D\n");
     fprintf(stderr, "  -r            Reverse sort order\n");
     fprintf(stderr, "  -X            Sort by extension\n");
     fprintf(stderr, "  -t            Sort by modification time\n");
+    fprintf(stderr, "  -S            Sort by size, largest first (by recursive size with --du)\n");
+    fprintf(stderr, "  -v            Natural sort of numbers in names (file2 before file10)\n");
+    fprintf(stderr, "  --collate     Sort names in the locale's collation order\n");
     fprintf(stderr, "  -n            Show numeric UIDs/GIDs\n");
     fprintf(stderr, "  -m            Comma-separated output\n");
     fprintf(stderr, "  -Q            Quote filenames\n");
+    fprintf(stderr, "  -U            Unsorted: print entries as they are read (constant memory)\n");
+    fprintf(stderr, "  -L            Follow symlinks: show and descend into what they point to;\n");
+    fprintf(stderr, "                each directory is entered once, so link cycles end (ignores -j)\n");
+    fprintf(stderr, "  -x            Do not descend into other filesystems (--one-file-system)\n");
+    fprintf(stderr, "  --du          Show recursive size and file count of directories (implies -l)\n");
+    fprintf(stderr, "  --git         Show git status (XY as in git status -s); directories sum up\n");
+    fprintf(stderr, "                their contents with -R/-D\n");
+    fprintf(stderr, "  --glob PAT    Only list names matching PAT (*, ?, [...], **; repeatable)\n");
+    fprintf(stderr, "  --exclude PAT Skip names matching PAT; excluded dirs are not descended\n");
+    fprintf(stderr, "  --exclude-fs TYPES  Do not descend into mounts of these filesystem types\n");
+    fprintf(stderr, "                (comma-separated, e.g. nfs,fuse; nfs includes nfs4)\n");
+    fprintf(stderr, "  --regex RE    Only list names matching the extended regex RE\n");
+    fprintf(stderr, "  --dirbuf SIZE Directory read buffer, e.g. 1M (default 256K)\n");
+    fprintf(stderr, "  --preload-ids Enumerate all users/groups once up front (with -l)\n");
+    fprintf(stderr, "  --json        Print entries as a JSON array instead of the table\n");
+    fprintf(stderr, "  --ndjson      Print one JSON object per entry and line (streams with -R)\n");
+    fprintf(stderr, "  -0            Print entry paths terminated by NUL bytes, for xargs -0\n");
+    fprintf(stderr, "  --stats[=FMT] Print time per phase and counters to stderr at exit\n");
+    fprintf(stderr, "                (FMT is text, the default, or json)\n");
+    fprintf(stderr, "  -I            Interactive browser: arrows/jk move, enter/l opens, h closes, q quits\n");
+    fprintf(stderr, "  --watch       Keep the listing on screen and update it as files change\n");
+    fprintf(stderr, "  --cache FILE  Reuse directory listings saved in FILE while the directory\n");
+    fprintf(stderr, "                is unchanged (sizes and times are always read fresh)\n");
     fprintf(stderr, "\nEnvironment:\n");
     fprintf(stderr, "  LSX_ASCII=1   Force ASCII borders (no UTF-8 box drawing)\n");
+    fprintf(stderr, "  LS_COLORS     Name colors, in dircolors syntax\n");
+    fprintf(stderr, "  LSX_COLORS    Overrides LS_COLORS for lsx only; hi= colors hidden files\n");
+    fprintf(stderr, "  LSX_DIRBUF=N  Same as --dirbuf\n");
+    fprintf(stderr, "  LSX_CACHE=F   Same as --cache\n");
+    fprintf(stderr, "  LSX_URING_DEPTH=N  Stat through io_uring with N requests in flight per\n");
+    fprintf(stderr, "                thread, on every filesystem (default: %d, network ones\n", STATBATCH_DEFAULT_DEPTH);
+    fprintf(stderr, "                only; 0 never uses io_uring)\n");
+    fprintf(stderr, "  LSX_STATS=1   Same as --stats (LSX_STATS=json for --stats=json)\n");
 }
 
+enum {
+    OPT_DIRBUF = 256,
+    OPT_PRELOAD_IDS,
+    OPT_COLLATE,
+    OPT_GLOB,
+    OPT_EXCLUDE,
+    OPT_REGEX,
+    OPT_DU,
+    OPT_CACHE,
+    OPT_WATCH,
+    OPT_JSON,
+    OPT_NDJSON,
+    OPT_STATS,
+    OPT_GIT,
+    OPT_EXCLUDE_FS,
+};
+
 static struct option long_opts[] = {
     {"depth", required_argument, 0, 'D'},
+    {"dirbuf", required_argument, 0, OPT_DIRBUF},
+    {"preload-ids", no_argument, 0, OPT_PRELOAD_IDS},
+    {"collate", no_argument, 0, OPT_COLLATE},
+    {"glob", required_argument, 0, OPT_GLOB},
+    {"exclude", required_argument, 0, OPT_EXCLUDE},
+    {"regex", required_argument, 0, OPT_REGEX},
+    {"du", no_argument, 0, OPT_DU},
+    {"cache", required_argument, 0, OPT_CACHE},
+    {"watch", no_argument, 0, OPT_WATCH},
+    {"json", no_argument, 0, OPT_JSON},
+    {"ndjson", no_argument, 0, OPT_NDJSON},
+    {"stats", optional_argument, 0, OPT_STATS},
+    {"git", no_argument, 0, OPT_GIT},
+    {"dereference", no_argument, 0, 'L'},
+    {"one-file-system", no_argument, 0, 'x'},
+    {"exclude-fs", required_argument, 0, OPT_EXCLUDE_FS},
     {0, 0, 0, 0}
 };
 
 int main(int argc, char *argv[]) {
     setlocale(LC_ALL, "");
     init_glyphs();
+    init_perm_table();
+    timefmt_init();
+    out_init(STDOUT_FILENO);
 
     int opt;
     char cwd[MAX_PATH];
 
     opts.depth = 0;
+    opts.jobs = 1;
+    int jobs_given = 0;
 
-    while ((opt = getopt_long(argc, argv, "alhgFiRrXtnmQD:", long_opts, NULL)) != -1) {
+    const char *dirbuf_env = getenv("LSX_DIRBUF");
+    size_t dirbuf;
+    if (dirbuf_env && *dirbuf_env && parse_size(dirbuf_env, &dirbuf) == 0) {
+        dirscan_set_bufsize(dirbuf);
+    }
+
+    const char *depth_env = getenv("LSX_URING_DEPTH");
+    if (depth_env && *depth_env) statbatch_set_depth((unsigned)strtoul(depth_env, NULL, 10));
+
+    const char *cache_path = getenv("LSX_CACHE");
+    if (cache_path && !*cache_path) cache_path = NULL;
+
+    const char *stats_env = getenv("LSX_STATS");
+    if (stats_env && *stats_env) opts.stats = strcmp(stats_env, "json") == 0 ? 2 : 1;
+
+    while ((opt = getopt_long(argc, argv, "alhgFiIRrXtSvnmQULx0D:j:", long_opts, NULL)) != -1) {
         switch (opt) {
             case 'a': opts.show_hidden = 1; break;
             case 'l': opts.long_format = 1; break;
@@ -820,13 +2075,20 @@ int main(int argc, char *argv[]) {
             case 'g': opts.omit_group = 1; break;
             case 'F': opts.add_slash = 1; break;
             case 'i': opts.show_inode = 1; break;
+            case 'I': opts.interactive = 1; break;
             case 'R': opts.recursive = 1; break;
             case 'r': opts.reverse = 1; break;
             case 'X': opts.sort_by_ext = 1; break;
             case 't': opts.sort_by_time = 1; break;
+            case 'S': opts.sort_by_size = 1; break;
+            case 'v': opts.sort_version = 1; break;
             case 'n': opts.numeric_ids = 1; break;
             case 'm': opts.comma_separated = 1; break;
             case 'Q': opts.quote_names = 1; break;
+            case 'U': opts.unsorted = 1; break;
+            case 'L': opts.follow = 1; break;
+            case 'x': opts.one_fs = 1; break;
+            case '0': opts.output = OUTPUT_NUL; break;
 
             case 'D': {
                 int d = atoi(optarg);
@@ -838,23 +2100,163 @@ int main(int argc, char *argv[]) {
                 break;
             }
 
+            case 'j': {
+                int j = atoi(optarg);
+                if (j < 1) {
+                    fprintf(stderr, "lsx: -j must be >= 1\n");
+                    return 1;
+                }
+                opts.jobs = j;
+                jobs_given = 1;
+                break;
+            }
+
+            case OPT_DIRBUF:
+                if (parse_size(optarg, &dirbuf) != 0) {
+                    fprintf(stderr, "lsx: invalid --dirbuf size: %s\n", optarg);
+                    return 1;
+                }
+                dirscan_set_bufsize(dirbuf);
+                break;
+
+            case OPT_PRELOAD_IDS: opts.preload_ids = 1; break;
+            case OPT_COLLATE: opts.sort_collate = 1; break;
+            case OPT_DU: opts.du = 1; break;
+            case OPT_CACHE: cache_path = optarg; break;
+            case OPT_WATCH: opts.watch = 1; break;
+            case OPT_JSON: opts.output = OUTPUT_JSON; break;
+            case OPT_NDJSON: opts.output = OUTPUT_NDJSON; break;
+            case OPT_GIT: opts.git = 1; break;
+
+            case OPT_STATS:
+                if (!optarg || strcmp(optarg, "text") == 0) {
+                    opts.stats = 1;
+                } else if (strcmp(optarg, "json") == 0) {
+                    opts.stats = 2;
+                } else {
+                    fprintf(stderr, "lsx: invalid --stats format: %s (text or json)\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case OPT_GLOB:
+            case OPT_EXCLUDE:
+                if (!g_matcher) g_matcher = matcher_new();
+                if (!g_matcher || matcher_add_glob(g_matcher, optarg, opt == OPT_EXCLUDE) != 0) {
+                    fprintf(stderr, "lsx: out of memory\n");
+                    return 1;
+                }
+                break;
+
+            case OPT_EXCLUDE_FS:
+                if (!g_fs_exclude) g_fs_exclude = fsexclude_new();
+                if (!g_fs_exclude || fsexclude_add_types(g_fs_exclude, optarg) != 0) {
+                    fprintf(stderr, "lsx: out of memory\n");
+                    return 1;
+                }
+                break;
+
+            case OPT_REGEX: {
+                char err[256];
+                if (!g_matcher) g_matcher = matcher_new();
+                if (!g_matcher) {
+                    fprintf(stderr, "lsx: out of memory\n");
+                    return 1;
+                }
+                if (matcher_add_regex(g_matcher, optarg, err, sizeof(err)) != 0) {
+                    fprintf(stderr, "lsx: invalid --regex '%s': %s\n", optarg, err);
+                    return 1;
+                }
+                break;
+            }
+
             default:
                 print_usage(argv[0]);
                 return 1;
         }
     }
 
+    if (opts.stats) stats_enable();
+
+    if (opts.output != OUTPUT_BOX) {
+        const char *name = opts.output == OUTPUT_JSON ? "--json" : opts.output == OUTPUT_NDJSON ? "--ndjson" : "-0";
+        const char *clash = opts.interactive ? "-I" : opts.watch ? "--watch" : opts.comma_separated ? "-m" : NULL;
+        if (clash) {
+            fprintf(stderr, "lsx: %s cannot be combined with %s\n", name, clash);
+            return 1;
+        }
+    }
+
+    if (opts.interactive) {
+        const char *clash = opts.unsorted ? "-U" : opts.watch ? "--watch" : opts.du ? "--du"
+                          : opts.comma_separated ? "-m" : NULL;
+        if (clash) {
+            fprintf(stderr, "lsx: -I cannot be combined with %s\n", clash);
+            return 1;
+        }
+        if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+            fprintf(stderr, "lsx: -I needs a terminal\n");
+            return 1;
+        }
+    }
+
+    if (opts.watch && (opts.unsorted || opts.du || opts.git || opts.follow)) {
+        fprintf(stderr, "lsx: --watch cannot be combined with %s\n",
+                opts.unsorted ? "-U" : opts.du ? "--du" : opts.git ? "--git" : "-L");
+        return 1;
+    }
+
+    // The index records symlinks themselves, not what they point to.
+    if (opts.git && opts.follow) {
+        fprintf(stderr, "lsx: --git cannot be combined with -L\n");
+        return 1;
+    }
+
+    if (opts.du) {
+        if (opts.unsorted || opts.comma_separated) {
+            fprintf(stderr, "lsx: --du cannot be combined with %s\n", opts.unsorted ? "-U" : "-m");
+            return 1;
+        }
+        opts.long_format = 1;
+    }
+
     // Make -R enable infinite inline depth
     if (opts.recursive && opts.depth == 0) {
         opts.depth = 999;
     }
 
     const char *target = ".";
+    char root[MAX_PATH];
     if (optind < argc) {
         target = argv[optind];
-        if (strchr(target, '*')) {
-            opts.pattern = strdup(target);
-            target = ".";
+        g_path_base = target;
+
+        // A target with glob characters that is not itself an existing
+        // path splits into its deepest literal directory and the pattern
+        // below it: "src/**/*.c" lists src with "**/*.c".
+        const char *meta = strpbrk(target, "*?[");
+        struct stat st;
+        if (meta && lstat(target, &st) != 0) {
+            const char *slash = NULL;
+            for (const char *p = target; p < meta; p++) {
+                if (*p == '/') slash = p;
+            }
+            const char *pattern = target;
+            if (slash) {
+                snprintf(root, sizeof(root), "%.*s", slash == target ? 1 : (int)(slash - target), target);
+                pattern = slash + 1;
+                target = root;
+                g_path_base = root;
+            } else {
+                target = ".";
+                g_path_base = NULL;
+            }
+
+            if (!g_matcher) g_matcher = matcher_new();
+            if (!g_matcher || matcher_add_glob(g_matcher, pattern, 0) != 0) {
+                fprintf(stderr, "lsx: out of memory\n");
+                return 1;
+            }
         }
     } else if (!getcwd(cwd, sizeof(cwd))) {
         perror("getcwd");
@@ -863,8 +2265,116 @@ int main(int argc, char *argv[]) {
         target = cwd;
     }
 
-    draw_single_box_listing(target);
+    g_root_len = strlen(target);
 
-    if (opts.pattern) free(opts.pattern);
-    return 0;
+    // A pattern with directory components implies enough inline depth
+    // to reach what it names.
+    if (g_matcher && opts.depth == 0) {
+        int d = matcher_include_depth(g_matcher);
+        opts.depth = d < 0 ? 999 : d;
+    }
+
+    if (opts.output == OUTPUT_BOX) {
+        g_colors = lscolors_new(getenv("LS_COLORS"), getenv("LSX_COLORS"));
+        if (!g_colors) {
+            fprintf(stderr, "lsx: out of memory\n");
+            return 1;
+        }
+    }
+
+    // Outside a repository --git just adds nothing. -m and -0 have no
+    // place for the column.
+    if (opts.git && !opts.comma_separated && opts.output != OUTPUT_NUL) {
+        uint64_t t0 = stats_start();
+        g_git = gitrepo_open(target);
+        stats_stop(STATS_GIT, t0);
+        if (!g_git && errno == ENOTSUP) {
+            fprintf(stderr, "lsx: --git: repository format not supported, status not shown\n");
+        } else if (!g_git && errno != ENOENT) {
+            fprintf(stderr, "lsx: --git: cannot read the index: %s\n", strerror(errno));
+        }
+    }
+
+    // The walk's bounds are taken from the target itself, which with -L
+    // is the first directory entered.
+    if (opts.follow || opts.one_fs || g_fs_exclude) {
+        struct stat st;
+        int root_ok = stat(target, &st) == 0;
+        if (root_ok) g_root_dev = st.st_dev;
+        // The browser opens whatever it is asked to, as often as asked.
+        if (opts.follow && !opts.interactive) {
+            g_visited = inoset_new();
+            if (!g_visited) {
+                fprintf(stderr, "lsx: out of memory\n");
+                return 1;
+            }
+            if (root_ok && S_ISDIR(st.st_mode)) inoset_insert(g_visited, st.st_dev, st.st_ino);
+        }
+        if (opts.follow) statbatch_set_follow(1);
+        if (g_fs_exclude && fsexclude_read_mounts(g_fs_exclude) != 0) {
+            fprintf(stderr, "lsx: --exclude-fs: cannot read the mount table: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    // -U reads the directory as it prints and never goes through the
+    // cache, and -L would need it to record what links point to.
+    if (cache_path && !opts.unsorted && !opts.follow) {
+        g_cache = mdcache_open(cache_path);
+        if (!g_cache) {
+            fprintf(stderr, "lsx: out of memory\n");
+            return 1;
+        }
+    }
+
+    arena_init(&g_walk_arena, 0);
+    filelist_init(&g_walk_scratch);
+    if ((opts.du || (opts.depth > 0 && (opts.jobs > 1 || opts.follow))) && !opts.comma_separated &&
+        !opts.unsorted && !opts.watch && !opts.interactive) {
+        // --du always aggregates in parallel, one thread per CPU unless -j says otherwise.
+        int threads = opts.jobs;
+        if (opts.du && !jobs_given) {
+            long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = ncpu < 1 ? 1 : ncpu > 16 ? 16 : (int)ncpu;
+        }
+        // -L: the first path printed lists a directory (see first_visit),
+        // so directories must be loaded in the order rows are printed. A
+        // walker without workers loads them on this thread, depth first,
+        // as the rows need them, with or without --du.
+        if (opts.follow) threads = 0;
+        g_walker = walker_create(threads, walk_load, walk_descend, NULL);
+        if (g_walker && opts.du) {
+            g_du_links = inoset_new();
+            if (g_du_links) walker_set_totals(g_walker, du_sum, opts.depth);
+            else opts.du = 0;
+        }
+    }
+
+    if (opts.preload_ids && opts.long_format && !opts.numeric_ids) idcache_preload_all();
+
+    int status = 0;
+    if (opts.interactive)   status = run_browser(target, jobs_given ? opts.jobs : 2);
+    else if (opts.watch)    status = run_watch(target);
+    else if (opts.unsorted) draw_streaming_listing(target);
+    else                    draw_single_box_listing(target);
+    walker_destroy(g_walker);
+    inoset_free(g_du_links);
+    inoset_free(g_visited);
+    fsexclude_free(g_fs_exclude);
+    out_flush();
+    print_stats();
+    if (mdcache_close(g_cache) != 0) {
+        fprintf(stderr, "lsx: could not write cache %s: %s\n", cache_path, strerror(errno));
+    }
+
+    filelist_free(&g_walk_scratch);
+    arena_destroy(&g_walk_arena);
+    dirscan_thread_cleanup();
+    statbatch_thread_cleanup();
+    idcache_free();
+
+    matcher_free(g_matcher);
+    lscolors_free(g_colors);
+    gitrepo_close(g_git);
+    return status;
 }
@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <regex.h>
+
+#include "match.h"
+
+#define MAX_COMPONENTS 1024
+
+typedef enum {
+    TOK_LIT,    // literal bytes
+    TOK_ANY,    // '?': one character
+    TOK_STAR,   // '*': any run within a component
+    TOK_CLASS,  // '[...]': one byte from a set
+} TokKind;
+
+typedef struct {
+    TokKind kind;
+    int negate;
+    const char *lit;
+    size_t len;
+    uint8_t set[32];
+} Tok;
+
+// Common segment shapes get a direct test instead of the token loop.
+typedef enum {
+    SEG_GENERAL,
+    SEG_GLOBSTAR,  // "**"
+    SEG_ALL,       // "*"
+    SEG_EXACT,     // literal
+    SEG_SUFFIX,    // "*literal", e.g. "*.c"
+    SEG_PREFIX,    // "literal*"
+} SegKind;
+
+typedef struct {
+    SegKind kind;
+    Tok *toks;
+    int ntok;
+} Seg;
+
+typedef struct {
+    char *text;  // unescaped literals point into this copy
+    Seg *segs;
+    int nseg;
+    int is_path;
+    int has_globstar;
+} Glob;
+
+typedef struct {
+    Glob *v;
+    int n;
+    int cap;
+} GlobVec;
+
+struct Matcher {
+    GlobVec include;
+    GlobVec exclude;
+    regex_t *regex;
+    int nregex;
+    int any_name_include;  // an include that can match at any depth
+};
+
+typedef struct {
+    const char *s;
+    size_t len;
+} Comp;
+
+// ---- compile ----
+
+static size_t parse_class(const char *p, Tok *t) {
+    // p points just past '['. Returns the bytes consumed including the
+    // closing ']', or 0 if the class is unterminated.
+    size_t i = 0;
+    memset(t->set, 0, sizeof(t->set));
+    t->negate = 0;
+    if (p[i] == '!' || p[i] == '^') {
+        t->negate = 1;
+        i++;
+    }
+
+    int first = 1;
+    while (p[i] && (p[i] != ']' || first)) {
+        unsigned char lo = (unsigned char)p[i];
+        if (lo == '\\' && p[i + 1]) lo = (unsigned char)p[++i];
+        i++;
+
+        unsigned char hi = lo;
+        if (p[i] == '-' && p[i + 1] && p[i + 1] != ']') {
+            hi = (unsigned char)p[i + 1];
+            if (hi == '\\' && p[i + 2]) hi = (unsigned char)p[++i + 1];
+            i += 2;
+        }
+        for (unsigned c = lo; c <= hi; c++) t->set[c >> 3] |= (uint8_t)(1u << (c & 7));
+        first = 0;
+    }
+    if (p[i] != ']') return 0;
+
+    t->kind = TOK_CLASS;
+    return i + 1;
+}
+
+// Tokenize one component [s, s + n). Literal runs are unescaped in
+// place, which is safe because unescaping only ever shrinks them.
+static int compile_segment(char *s, size_t n, Seg *seg) {
+    seg->toks = NULL;
+    seg->ntok = 0;
+
+    if (n == 2 && s[0] == '*' && s[1] == '*') {
+        seg->kind = SEG_GLOBSTAR;
+        return 0;
+    }
+
+    Tok *toks = calloc(n ? n : 1, sizeof(*toks));
+    if (!toks) return -1;
+    int nt = 0;
+
+    size_t i = 0;
+    while (i < n) {
+        char c = s[i];
+        if (c == '*') {
+            while (i < n && s[i] == '*') i++;
+            toks[nt++].kind = TOK_STAR;
+            continue;
+        }
+        if (c == '?') {
+            toks[nt++].kind = TOK_ANY;
+            i++;
+            continue;
+        }
+        if (c == '[') {
+            char save = s[n];
+            s[n] = '\0';
+            size_t used = parse_class(s + i + 1, &toks[nt]);
+            s[n] = save;
+            if (used) {
+                nt++;
+                i += 1 + used;
+                continue;
+            }
+            // unterminated: fall through and treat '[' as a literal
+        }
+
+        // literal run, unescaped into its own start
+        char *out = s + i;
+        Tok *t = &toks[nt++];
+        t->kind = TOK_LIT;
+        t->lit = out;
+        size_t len = 0;
+        for (;;) {
+            if (s[i] == '\\' && i + 1 < n) i++;
+            out[len++] = s[i++];
+            if (i >= n || s[i] == '*' || s[i] == '?' || s[i] == '[') break;
+        }
+        t->len = len;
+    }
+
+    seg->toks = toks;
+    seg->ntok = nt;
+
+    if (nt == 1 && toks[0].kind == TOK_STAR) seg->kind = SEG_ALL;
+    else if (nt == 1 && toks[0].kind == TOK_LIT) seg->kind = SEG_EXACT;
+    else if (nt == 2 && toks[0].kind == TOK_STAR && toks[1].kind == TOK_LIT) seg->kind = SEG_SUFFIX;
+    else if (nt == 2 && toks[0].kind == TOK_LIT && toks[1].kind == TOK_STAR) seg->kind = SEG_PREFIX;
+    else seg->kind = SEG_GENERAL;
+    return 0;
+}
+
+static void glob_free(Glob *g) {
+    for (int i = 0; i < g->nseg; i++) free(g->segs[i].toks);
+    free(g->segs);
+    free(g->text);
+}
+
+static int glob_compile(Glob *g, const char *pattern) {
+    memset(g, 0, sizeof(*g));
+
+    // A leading "./" or "/" means the root of the listing.
+    while (pattern[0] == '.' && pattern[1] == '/') pattern += 2;
+    while (pattern[0] == '/') pattern++;
+
+    g->text = strdup(pattern);
+    if (!g->text) return -1;
+
+    size_t len = strlen(g->text);
+    int nseg = 1;
+    for (size_t i = 0; i < len; i++) nseg += (g->text[i] == '/');
+    g->segs = calloc((size_t)nseg, sizeof(*g->segs));
+    if (!g->segs) {
+        free(g->text);
+        return -1;
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i <= len; i++) {
+        if (i < len && g->text[i] != '/') continue;
+        if (i > start) {
+            Seg *seg = &g->segs[g->nseg];
+            if (compile_segment(g->text + start, i - start, seg) != 0) {
+                glob_free(g);
+                return -1;
+            }
+            if (seg->kind == SEG_GLOBSTAR) g->has_globstar = 1;
+            g->nseg++;
+        }
+        start = i + 1;
+    }
+
+    g->is_path = g->nseg > 1 || g->has_globstar;
+    return 0;
+}
+
+static int vec_push(GlobVec *v, const char *pattern) {
+    if (v->n == v->cap) {
+        int ncap = v->cap ? v->cap * 2 : 4;
+        Glob *p = realloc(v->v, (size_t)ncap * sizeof(*p));
+        if (!p) return -1;
+        v->v = p;
+        v->cap = ncap;
+    }
+    if (glob_compile(&v->v[v->n], pattern) != 0) return -1;
+    v->n++;
+    return 0;
+}
+
+Matcher *matcher_new(void) {
+    return calloc(1, sizeof(Matcher));
+}
+
+void matcher_free(Matcher *m) {
+    if (!m) return;
+    for (int i = 0; i < m->include.n; i++) glob_free(&m->include.v[i]);
+    for (int i = 0; i < m->exclude.n; i++) glob_free(&m->exclude.v[i]);
+    free(m->include.v);
+    free(m->exclude.v);
+    for (int i = 0; i < m->nregex; i++) regfree(&m->regex[i]);
+    free(m->regex);
+    free(m);
+}
+
+int matcher_add_glob(Matcher *m, const char *pattern, int exclude) {
+    GlobVec *v = exclude ? &m->exclude : &m->include;
+    if (vec_push(v, pattern) != 0) return -1;
+    if (!exclude && !v->v[v->n - 1].is_path) m->any_name_include = 1;
+    return 0;
+}
+
+int matcher_add_regex(Matcher *m, const char *re, char *err, size_t errsz) {
+    regex_t *p = realloc(m->regex, (size_t)(m->nregex + 1) * sizeof(*p));
+    if (!p) {
+        snprintf(err, errsz, "out of memory");
+        return -1;
+    }
+    m->regex = p;
+
+    int rc = regcomp(&m->regex[m->nregex], re, REG_EXTENDED | REG_NOSUB);
+    if (rc != 0) {
+        regerror(rc, &m->regex[m->nregex], err, errsz);
+        return -1;
+    }
+    m->nregex++;
+    m->any_name_include = 1;
+    return 0;
+}
+
+int matcher_include_depth(const Matcher *m) {
+    int depth = 0;
+    for (int i = 0; i < m->include.n; i++) {
+        const Glob *g = &m->include.v[i];
+        if (g->has_globstar) return -1;
+        if (g->nseg - 1 > depth) depth = g->nseg - 1;
+    }
+    return depth;
+}
+
+// ---- match ----
+
+// Bytes in the UTF-8 sequence starting at s (1 for anything malformed),
+// so '?' and '*' never split a character.
+static size_t char_len(const char *s, size_t n) {
+    unsigned char c = (unsigned char)s[0];
+    size_t len = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    if (len > n) return 1;
+    for (size_t i = 1; i < len; i++) {
+        if (((unsigned char)s[i] & 0xC0) != 0x80) return 1;
+    }
+    return len;
+}
+
+static int tok_general(const Seg *seg, const char *s, size_t n) {
+    int ti = 0;
+    size_t si = 0;
+    int star_ti = -1;
+    size_t star_si = 0;
+
+    while (si < n || ti < seg->ntok) {
+        if (ti < seg->ntok) {
+            const Tok *t = &seg->toks[ti];
+            switch (t->kind) {
+            case TOK_STAR:
+                star_ti = ti++;
+                star_si = si;
+                continue;
+            case TOK_LIT:
+                if (n - si >= t->len && memcmp(s + si, t->lit, t->len) == 0) {
+                    si += t->len;
+                    ti++;
+                    continue;
+                }
+                break;
+            case TOK_ANY:
+                if (si < n) {
+                    si += char_len(s + si, n - si);
+                    ti++;
+                    continue;
+                }
+                break;
+            case TOK_CLASS:
+                if (si < n) {
+                    unsigned char c = (unsigned char)s[si];
+                    int in = (t->set[c >> 3] >> (c & 7)) & 1;
+                    if (in != t->negate) {
+                        si++;
+                        ti++;
+                        continue;
+                    }
+                }
+                break;
+            }
+        }
+
+        // Mismatch: let the last '*' swallow one more character.
+        if (star_ti >= 0 && star_si < n) {
+            star_si += char_len(s + star_si, n - star_si);
+            si = star_si;
+            ti = star_ti + 1;
+            continue;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static int seg_match(const Seg *seg, const char *s, size_t n) {
+    switch (seg->kind) {
+    case SEG_GLOBSTAR:
+    case SEG_ALL:
+        return 1;
+    case SEG_EXACT:
+        return n == seg->toks[0].len && memcmp(s, seg->toks[0].lit, n) == 0;
+    case SEG_SUFFIX: {
+        size_t l = seg->toks[1].len;
+        return n >= l && memcmp(s + n - l, seg->toks[1].lit, l) == 0;
+    }
+    case SEG_PREFIX: {
+        size_t l = seg->toks[0].len;
+        return n >= l && memcmp(s, seg->toks[0].lit, l) == 0;
+    }
+    case SEG_GENERAL:
+    default:
+        return tok_general(seg, s, n);
+    }
+}
+
+// Full match of segments [si..] against components [ci..]. With
+// partial set, running out of components first also counts (something
+// deeper could still match).
+static int path_match(const Glob *g, int si, const Comp *c, int nc, int ci, int partial) {
+    while (si < g->nseg) {
+        const Seg *seg = &g->segs[si];
+        if (seg->kind == SEG_GLOBSTAR) {
+            // zero components, or eat one and stay on "**"
+            if (path_match(g, si + 1, c, nc, ci, partial)) return 1;
+            if (ci < nc) return path_match(g, si, c, nc, ci + 1, partial);
+            return partial;
+        }
+        if (ci == nc) return partial;
+        if (!seg_match(seg, c[ci].s, c[ci].len)) return 0;
+        si++;
+        ci++;
+    }
+    return ci == nc;
+}
+
+static int split_path(const char *dir, const char *name, Comp *c) {
+    int nc = 0;
+    const char *p = dir;
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        const char *e = strchr(p, '/');
+        size_t len = e ? (size_t)(e - p) : strlen(p);
+        if (!(len == 1 && p[0] == '.')) {
+            if (nc == MAX_COMPONENTS - 1) return -1;
+            c[nc].s = p;
+            c[nc].len = len;
+            nc++;
+        }
+        p += len;
+    }
+    c[nc].s = name;
+    c[nc].len = strlen(name);
+    return nc + 1;
+}
+
+static int glob_test(const Glob *g, const char *dir, const char *name, int partial) {
+    if (!g->is_path) return seg_match(&g->segs[0], name, strlen(name));
+
+    Comp comps[MAX_COMPONENTS];
+    int nc = split_path(dir, name, comps);
+    if (nc < 0) return 0;
+    return path_match(g, 0, comps, nc, 0, partial);
+}
+
+int matcher_excluded(const Matcher *m, const char *dir, const char *name) {
+    for (int i = 0; i < m->exclude.n; i++) {
+        if (glob_test(&m->exclude.v[i], dir, name, 0)) return 1;
+    }
+    return 0;
+}
+
+int matcher_included(const Matcher *m, const char *dir, const char *name) {
+    if (!m->include.n && !m->nregex) return 1;
+
+    for (int i = 0; i < m->include.n; i++) {
+        if (glob_test(&m->include.v[i], dir, name, 0)) return 1;
+    }
+    for (int i = 0; i < m->nregex; i++) {
+        if (regexec(&m->regex[i], name, 0, NULL, 0) == 0) return 1;
+    }
+    return 0;
+}
+
+int matcher_may_contain(const Matcher *m, const char *dir, const char *name) {
+    if (!m->include.n && !m->nregex) return 1;
+    if (m->any_name_include) return 1;
+
+    Comp comps[MAX_COMPONENTS];
+    int nc = split_path(dir, name, comps);
+    if (nc < 0) return 1;
+
+    for (int i = 0; i < m->include.n; i++) {
+        const Glob *g = &m->include.v[i];
+        // Something below matches if the directory's own components
+        // leave a (possibly empty) tail of the pattern unmatched.
+        if (path_match(g, 0, comps, nc, 0, 1) && !path_match(g, 0, comps, nc, 0, 0)) return 1;
+        if (g->has_globstar && path_match(g, 0, comps, nc, 0, 0)) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#include "mdcache.h"
+
+#define MDCACHE_MAGIC     "LSXMDC\0\0"
+#define MDCACHE_VERSION   2
+#define MDCACHE_BYTEORDER 0x01020304u
+
+// Records not used by any of the last KEEP_GENERATIONS writes are
+// dropped, so directories that were deleted or are no longer listed do
+// not accumulate.
+#define KEEP_GENERATIONS 32
+
+// A directory changed this recently may still be changing within the
+// same timestamp tick; caching it could hide that change.
+#define RACY_SECONDS 2
+
+#ifdef __APPLE__
+#define ST_MTIM(st) ((st)->st_mtimespec)
+#define ST_CTIM(st) ((st)->st_ctimespec)
+#else
+#define ST_MTIM(st) ((st)->st_mtim)
+#define ST_CTIM(st) ((st)->st_ctim)
+#endif
+
+// File layout, all fields in the writer's byte order, every section
+// 8-byte aligned:
+//
+//   FileHdr
+//   IndexEnt[ndirs]          sorted by (dev, ino)
+//   records, each: DirHdr, MdCacheEntry[count], names (padded to 8)
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t entry_size;   // sizeof(MdCacheEntry), guards layout changes
+    uint32_t generation;   // bumped on every write
+    uint32_t ndirs;
+    uint32_t pad;
+    uint64_t index_off;
+    uint64_t file_size;
+} FileHdr;
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t off;
+} IndexEnt;
+
+typedef struct {
+    int64_t  mtime_sec;
+    int64_t  ctime_sec;
+    uint32_t mtime_nsec;
+    uint32_t ctime_nsec;
+    uint32_t count;
+    uint32_t names_len;
+    uint32_t generation;   // last write that saw the directory in use
+    uint32_t pad;
+} DirHdr;
+
+// A record read this run, serialized (DirHdr onward) and waiting for the
+// write at close.
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    unsigned char *blob;
+    size_t len;
+} Pending;
+
+struct MdCache {
+    char *path;
+
+    const unsigned char *map;
+    size_t map_size;
+    const IndexEnt *index;
+    uint32_t ndirs;
+    uint32_t generation;
+    atomic_uchar *touched;   // per index slot: served a hit this run
+
+    pthread_mutex_t mu;
+    Pending *pending;
+    size_t npending;
+    size_t pending_cap;
+
+    atomic_ulong hits;
+    atomic_ulong misses;
+    atomic_ulong stored;
+    atomic_ullong entries;
+};
+
+static size_t pad8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static int header_valid(const FileHdr *h, size_t size) {
+    if (memcmp(h->magic, MDCACHE_MAGIC, sizeof(h->magic)) != 0) return 0;
+    if (h->version != MDCACHE_VERSION || h->byte_order != MDCACHE_BYTEORDER) return 0;
+    if (h->entry_size != sizeof(MdCacheEntry) || h->file_size != size) return 0;
+    if (h->index_off % 8 || h->index_off < sizeof(FileHdr) || h->index_off > size) return 0;
+    return h->ndirs <= (size - h->index_off) / sizeof(IndexEnt);
+}
+
+MdCache *mdcache_open(const char *path) {
+    MdCache *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->path = strdup(path);
+    if (!c->path) {
+        free(c);
+        return NULL;
+    }
+    pthread_mutex_init(&c->mu, NULL);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return c;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t)st.st_size >= sizeof(FileHdr)) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            const FileHdr *h = p;
+            if (header_valid(h, (size_t)st.st_size) &&
+                (c->touched = calloc(h->ndirs ? h->ndirs : 1, sizeof(*c->touched))) != NULL) {
+                c->map = p;
+                c->map_size = (size_t)st.st_size;
+                c->index = (const IndexEnt *)(c->map + h->index_off);
+                c->ndirs = h->ndirs;
+                c->generation = h->generation;
+            } else {
+                munmap(p, (size_t)st.st_size);
+            }
+        }
+    }
+    close(fd);
+    return c;
+}
+
+// The record at off, or NULL if it does not lie wholly inside the file
+// or its names are not properly terminated.
+static const DirHdr *record_at(const MdCache *c, uint64_t off, size_t *len) {
+    if (off % 8 || off > c->map_size || c->map_size - off < sizeof(DirHdr)) return NULL;
+    const DirHdr *h = (const DirHdr *)(c->map + off);
+    size_t room = c->map_size - off - sizeof(DirHdr);
+    if (h->count > room / sizeof(MdCacheEntry)) return NULL;
+    room -= (size_t)h->count * sizeof(MdCacheEntry);
+    if (pad8(h->names_len) > room) return NULL;
+
+    const MdCacheEntry *ents = (const MdCacheEntry *)(h + 1);
+    const char *names = (const char *)(ents + h->count);
+    for (uint32_t k = 0; k < h->count; k++) {
+        if (ents[k].name_off >= h->names_len ||
+            ents[k].name_len >= h->names_len - ents[k].name_off ||
+            names[ents[k].name_off + ents[k].name_len] != '\0') return NULL;
+    }
+
+    if (len) *len = sizeof(DirHdr) + (size_t)h->count * sizeof(MdCacheEntry) + pad8(h->names_len);
+    return h;
+}
+
+static long find_slot(const MdCache *c, uint64_t dev, uint64_t ino) {
+    long lo = 0, hi = (long)c->ndirs - 1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        const IndexEnt *e = &c->index[mid];
+        if (e->dev == dev && e->ino == ino) return mid;
+        if (e->dev < dev || (e->dev == dev && e->ino < ino)) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+static int validator_matches(const DirHdr *h, const struct stat *dir) {
+    return h->mtime_sec == (int64_t)ST_MTIM(dir).tv_sec &&
+           h->mtime_nsec == (uint32_t)ST_MTIM(dir).tv_nsec &&
+           h->ctime_sec == (int64_t)ST_CTIM(dir).tv_sec &&
+           h->ctime_nsec == (uint32_t)ST_CTIM(dir).tv_nsec;
+}
+
+int mdcache_lookup(MdCache *c, const struct stat *dir, MdCacheDir *out) {
+    long k = find_slot(c, (uint64_t)dir->st_dev, (uint64_t)dir->st_ino);
+    const DirHdr *h = k >= 0 ? record_at(c, c->index[k].off, NULL) : NULL;
+
+    if (!h || !validator_matches(h, dir)) {
+        atomic_fetch_add(&c->misses, 1);
+        return 0;
+    }
+
+    out->ents = (const MdCacheEntry *)(h + 1);
+    out->names = (const char *)(out->ents + h->count);
+    out->count = h->count;
+    atomic_store_explicit(&c->touched[k], 1, memory_order_relaxed);
+    atomic_fetch_add(&c->hits, 1);
+    atomic_fetch_add(&c->entries, h->count);
+    return 1;
+}
+
+void mdcache_record_init(MdCacheRecord *r, const struct stat *dir) {
+    memset(r, 0, sizeof(*r));
+    r->dir = *dir;
+}
+
+int mdcache_record_add(MdCacheRecord *r, const char *name, size_t len, uint64_t ino,
+                       unsigned char type) {
+    if (r->failed) return -1;
+
+    if (r->count == r->cap) {
+        uint32_t ncap = r->cap ? r->cap * 2 : 64;
+        MdCacheEntry *p = realloc(r->ents, (size_t)ncap * sizeof(*p));
+        if (!p) goto fail;
+        r->ents = p;
+        r->cap = ncap;
+    }
+    if ((size_t)r->names_len + len + 1 > r->names_cap) {
+        size_t ncap = r->names_cap ? r->names_cap : 4096;
+        while (ncap < (size_t)r->names_len + len + 1) ncap *= 2;
+        if (ncap > UINT32_MAX) goto fail;
+        char *p = realloc(r->names, ncap);
+        if (!p) goto fail;
+        r->names = p;
+        r->names_cap = (uint32_t)ncap;
+    }
+
+    MdCacheEntry *e = &r->ents[r->count++];
+    memset(e, 0, sizeof(*e));
+    e->ino = ino;
+    e->type = type;
+    e->name_off = r->names_len;
+    e->name_len = (uint32_t)len;
+    memcpy(r->names + r->names_len, name, len);
+    r->names[r->names_len + len] = '\0';
+    r->names_len += (uint32_t)len + 1;
+    return 0;
+
+fail:
+    r->failed = 1;
+    return -1;
+}
+
+static void record_free(MdCacheRecord *r) {
+    free(r->ents);
+    free(r->names);
+    memset(r, 0, sizeof(*r));
+}
+
+static int too_recent(const struct stat *dir) {
+    time_t now = time(NULL);
+    time_t changed = ST_CTIM(dir).tv_sec > ST_MTIM(dir).tv_sec ? ST_CTIM(dir).tv_sec
+                                                                : ST_MTIM(dir).tv_sec;
+    return changed > now - RACY_SECONDS;
+}
+
+void mdcache_commit(MdCache *c, MdCacheRecord *r) {
+    if (r->failed || too_recent(&r->dir)) {
+        record_free(r);
+        return;
+    }
+
+    size_t ents_len = (size_t)r->count * sizeof(MdCacheEntry);
+    size_t len = sizeof(DirHdr) + ents_len + pad8(r->names_len);
+    unsigned char *blob = calloc(1, len);
+    if (!blob) {
+        record_free(r);
+        return;
+    }
+
+    DirHdr *h = (DirHdr *)blob;
+    h->mtime_sec  = (int64_t)ST_MTIM(&r->dir).tv_sec;
+    h->mtime_nsec = (uint32_t)ST_MTIM(&r->dir).tv_nsec;
+    h->ctime_sec  = (int64_t)ST_CTIM(&r->dir).tv_sec;
+    h->ctime_nsec = (uint32_t)ST_CTIM(&r->dir).tv_nsec;
+    h->count      = r->count;
+    h->names_len  = r->names_len;
+    if (ents_len) memcpy(blob + sizeof(DirHdr), r->ents, ents_len);
+    if (r->names_len) memcpy(blob + sizeof(DirHdr) + ents_len, r->names, r->names_len);
+
+    Pending p = { (uint64_t)r->dir.st_dev, (uint64_t)r->dir.st_ino, blob, len };
+    record_free(r);
+
+    pthread_mutex_lock(&c->mu);
+    if (c->npending == c->pending_cap) {
+        size_t ncap = c->pending_cap ? c->pending_cap * 2 : 64;
+        Pending *np = realloc(c->pending, ncap * sizeof(*np));
+        if (!np) {
+            pthread_mutex_unlock(&c->mu);
+            free(blob);
+            return;
+        }
+        c->pending = np;
+        c->pending_cap = ncap;
+    }
+    c->pending[c->npending++] = p;
+    pthread_mutex_unlock(&c->mu);
+    atomic_fetch_add(&c->stored, 1);
+}
+
+// One record of the file being written: an old one still in the mapping
+// or a pending one. seq orders duplicates so the newest wins.
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    size_t seq;
+    const unsigned char *src;
+    size_t len;
+    int fresh;     // stamp with the new generation
+} OutRec;
+
+static int outrec_cmp(const void *a, const void *b) {
+    const OutRec *x = a, *y = b;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// Whether the file is worth rewriting: something new was read, or a
+// record still in use is halfway to expiring.
+static int needs_write(const MdCache *c) {
+    if (c->npending) return 1;
+    for (uint32_t k = 0; k < c->ndirs; k++) {
+        if (!atomic_load_explicit(&c->touched[k], memory_order_relaxed)) continue;
+        const DirHdr *h = record_at(c, c->index[k].off, NULL);
+        if (h && c->generation - h->generation >= KEEP_GENERATIONS / 2) return 1;
+    }
+    return 0;
+}
+
+static int write_cache(MdCache *c) {
+    uint32_t gen = c->generation + 1;
+    size_t cap = (size_t)c->ndirs + c->npending;
+    OutRec *recs = malloc((cap ? cap : 1) * sizeof(*recs));
+    if (!recs) return -1;
+
+    size_t n = 0;
+    for (uint32_t k = 0; k < c->ndirs; k++) {
+        size_t len;
+        const DirHdr *h = record_at(c, c->index[k].off, &len);
+        if (!h) continue;
+        int used = atomic_load_explicit(&c->touched[k], memory_order_relaxed);
+        if (!used && gen - h->generation >= KEEP_GENERATIONS) continue;
+        recs[n++] = (OutRec){ c->index[k].dev, c->index[k].ino, k, (const unsigned char *)h, len, used };
+    }
+    for (size_t k = 0; k < c->npending; k++) {
+        const Pending *p = &c->pending[k];
+        recs[n++] = (OutRec){ p->dev, p->ino, (size_t)c->ndirs + k, p->blob, p->len, 1 };
+    }
+
+    qsort(recs, n, sizeof(*recs), outrec_cmp);
+    size_t m = 0;
+    for (size_t k = 0; k < n; k++) {
+        if (m && recs[m - 1].dev == recs[k].dev && recs[m - 1].ino == recs[k].ino) m--;
+        recs[m++] = recs[k];
+    }
+
+    FileHdr fh;
+    memset(&fh, 0, sizeof(fh));
+    memcpy(fh.magic, MDCACHE_MAGIC, sizeof(fh.magic));
+    fh.version = MDCACHE_VERSION;
+    fh.byte_order = MDCACHE_BYTEORDER;
+    fh.entry_size = sizeof(MdCacheEntry);
+    fh.generation = gen;
+    fh.ndirs = (uint32_t)m;
+    fh.index_off = sizeof(FileHdr);
+    uint64_t off = fh.index_off + (uint64_t)m * sizeof(IndexEnt);
+    for (size_t k = 0; k < m; k++) off += recs[k].len;
+    fh.file_size = off;
+
+    size_t plen = strlen(c->path);
+    char *tmp = malloc(plen + 8);
+    if (!tmp) {
+        free(recs);
+        return -1;
+    }
+    memcpy(tmp, c->path, plen);
+    memcpy(tmp + plen, ".XXXXXX", 8);
+
+    int fd = mkstemp(tmp);
+    FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!f) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        free(tmp);
+        free(recs);
+        return -1;
+    }
+
+    int ok = fwrite(&fh, sizeof(fh), 1, f) == 1;
+    off = fh.index_off + (uint64_t)m * sizeof(IndexEnt);
+    for (size_t k = 0; ok && k < m; k++) {
+        IndexEnt e = { recs[k].dev, recs[k].ino, off };
+        ok = fwrite(&e, sizeof(e), 1, f) == 1;
+        off += recs[k].len;
+    }
+    for (size_t k = 0; ok && k < m; k++) {
+        DirHdr h;
+        memcpy(&h, recs[k].src, sizeof(h));
+        if (recs[k].fresh) h.generation = gen;
+        ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(recs[k].src + sizeof(h), 1, recs[k].len - sizeof(h), f) == recs[k].len - sizeof(h);
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (ok && rename(tmp, c->path) != 0) ok = 0;
+    if (!ok) unlink(tmp);
+
+    free(tmp);
+    free(recs);
+    return ok ? 0 : -1;
+}
+
+int mdcache_close(MdCache *c) {
+    if (!c) return 0;
+
+    int rc = needs_write(c) ? write_cache(c) : 0;
+    int saved_errno = errno;
+
+    for (size_t k = 0; k < c->npending; k++) free(c->pending[k].blob);
+    free(c->pending);
+    if (c->map) munmap((void *)c->map, c->map_size);
+    free(c->touched);
+    pthread_mutex_destroy(&c->mu);
+    free(c->path);
+    free(c);
+    errno = saved_errno;
+    return rc;
+}
+
+void mdcache_get_stats(const MdCache *c, MdCacheStats *out) {
+    out->hits = atomic_load(&c->hits);
+    out->misses = atomic_load(&c->misses);
+    out->stored = atomic_load(&c->stored);
+    out->entries = atomic_load(&c->entries);
+    out->records = c->ndirs;
+}
@@ -0,0 +1,263 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "out.h"
+#include "stats.h"
+
+static char g_buf[OUT_BUF_SIZE];
+static size_t g_len;
+static int g_fd = 1;
+static int g_is_tty;
+static int g_failed;
+static unsigned long long g_written;
+static OutSinkFn g_sink;
+static void *g_sink_ctx;
+
+void out_init(int fd) {
+    g_fd = fd;
+    g_len = 0;
+    g_failed = 0;
+    g_written = 0;
+    g_is_tty = isatty(fd);
+}
+
+int out_is_tty(void) {
+    return g_is_tty;
+}
+
+// Write all iovecs, retrying on short writes and EINTR. On a hard error
+// (EPIPE from a closed pager, a full disk) further output is dropped.
+static void write_all(struct iovec *iov, int iovcnt) {
+    if (g_sink) {
+        for (int i = 0; i < iovcnt; i++) {
+            g_sink(iov[i].iov_base, iov[i].iov_len, g_sink_ctx);
+            g_written += iov[i].iov_len;
+        }
+        return;
+    }
+    while (iovcnt > 0 && !g_failed) {
+        uint64_t t0 = stats_start();
+        ssize_t n = writev(g_fd, iov, iovcnt);
+        stats_stop(STATS_WRITE, t0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            g_failed = 1;
+            return;
+        }
+        g_written += (unsigned long long)n;
+
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+}
+
+void out_flush(void) {
+    if (g_len == 0) return;
+    struct iovec iov = { g_buf, g_len };
+    write_all(&iov, 1);
+    g_len = 0;
+}
+
+void out_flush_tty(void) {
+    if (g_is_tty) out_flush();
+}
+
+void out_write(const char *s, size_t n) {
+    if (n <= sizeof(g_buf) - g_len) {
+        memcpy(g_buf + g_len, s, n);
+        g_len += n;
+        return;
+    }
+
+    if (n < sizeof(g_buf) / 2) {
+        out_flush();
+        memcpy(g_buf, s, n);
+        g_len = n;
+        return;
+    }
+
+    struct iovec iov[2] = { { g_buf, g_len }, { (void *)s, n } };
+    write_all(g_len ? iov : iov + 1, g_len ? 2 : 1);
+    g_len = 0;
+}
+
+void out_puts(const char *s) {
+    out_write(s, strlen(s));
+}
+
+void out_putc(char c) {
+    if (g_len == sizeof(g_buf)) out_flush();
+    g_buf[g_len++] = c;
+}
+
+void out_spaces(int n) {
+    while (n > 0) {
+        if (g_len == sizeof(g_buf)) out_flush();
+        size_t room = sizeof(g_buf) - g_len;
+        size_t k = (size_t)n < room ? (size_t)n : room;
+        memset(g_buf + g_len, ' ', k);
+        g_len += k;
+        n -= (int)k;
+    }
+}
+
+void out_repeat(const char *s, int count) {
+    size_t len = strlen(s);
+    if (len == 1) {
+        // Same fast path as spaces, for ASCII borders.
+        while (count > 0) {
+            if (g_len == sizeof(g_buf)) out_flush();
+            size_t room = sizeof(g_buf) - g_len;
+            size_t k = (size_t)count < room ? (size_t)count : room;
+            memset(g_buf + g_len, s[0], k);
+            g_len += k;
+            count -= (int)k;
+        }
+        return;
+    }
+    for (int i = 0; i < count; i++) out_write(s, len);
+}
+
+void out_uint(unsigned long long v) {
+    char tmp[20];
+    size_t i = sizeof(tmp);
+    do {
+        tmp[--i] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    out_write(tmp + i, sizeof(tmp) - i);
+}
+
+void out_int(long long v) {
+    if (v < 0) {
+        out_putc('-');
+        out_uint(0ULL - (unsigned long long)v);
+        return;
+    }
+    out_uint((unsigned long long)v);
+}
+
+// Length of the well-formed UTF-8 sequence at s (at most n bytes), or 0
+// when the lead byte does not start one: overlong forms, surrogates and
+// values past U+10FFFF are rejected.
+static size_t utf8_seq_len(const unsigned char *s, size_t n) {
+    unsigned char c = s[0];
+    size_t len;
+    unsigned char lo = 0x80, hi = 0xBF;
+
+    if (c >= 0xC2 && c <= 0xDF) len = 2;
+    else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        return 0;
+    }
+
+    if (n < len || s[1] < lo || s[1] > hi) return 0;
+    for (size_t k = 2; k < len; k++) {
+        if ((s[k] & 0xC0) != 0x80) return 0;
+    }
+    return len;
+}
+
+void out_json_chars(const char *s, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *p = (const unsigned char *)s;
+    size_t i = 0;
+
+    while (i < n) {
+        // Copy the longest run that needs no escaping in one go.
+        size_t j = i;
+        while (j < n) {
+            unsigned char c = p[j];
+            if (c < 0x80) {
+                if (c < 0x20 || c == '"' || c == '\\') break;
+                j++;
+                continue;
+            }
+            size_t len = utf8_seq_len(p + j, n - j);
+            if (!len) break;
+            j += len;
+        }
+        if (j > i) out_write(s + i, j - i);
+        if (j == n) return;
+
+        unsigned char c = p[j];
+        char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+        switch (c) {
+            case '"':  out_lit("\\\""); break;
+            case '\\': out_lit("\\\\"); break;
+            case '\n': out_lit("\\n"); break;
+            case '\t': out_lit("\\t"); break;
+            case '\r': out_lit("\\r"); break;
+            default:
+                if (c >= 0x80) {
+                    esc[2] = 'd';
+                    esc[3] = 'c';
+                }
+                out_write(esc, sizeof(esc));
+                break;
+        }
+        i = j + 1;
+    }
+}
+
+void out_printf(const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    size_t room = sizeof(g_buf) - g_len;
+    int n = vsnprintf(g_buf + g_len, room, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n < room) {
+        g_len += (size_t)n;
+        return;
+    }
+
+    // Did not fit: flush and format again, spilling to the heap for
+    // output larger than the whole buffer.
+    out_flush();
+    if ((size_t)n < sizeof(g_buf)) {
+        va_start(ap, fmt);
+        vsnprintf(g_buf, sizeof(g_buf), fmt, ap);
+        va_end(ap);
+        g_len = (size_t)n;
+        return;
+    }
+
+    char *tmp = malloc((size_t)n + 1);
+    if (!tmp) return;
+    va_start(ap, fmt);
+    vsnprintf(tmp, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    out_write(tmp, (size_t)n);
+    free(tmp);
+}
+
+unsigned long long out_bytes_written(void) {
+    return g_written + g_len;
+}
+
+void out_set_sink(OutSinkFn fn, void *ctx) {
+    out_flush();
+    g_sink = fn;
+    g_sink_ctx = ctx;
+}
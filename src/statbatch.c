@@ -0,0 +1,349 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#endif
+
+#include "statbatch.h"
+#include "stats.h"
+
+// Below this many names the ring's setup and wakeups cost more than
+// they save.
+#define STATBATCH_MIN 16
+
+static unsigned g_depth = STATBATCH_DEFAULT_DEPTH;
+static int g_everywhere;
+static int g_follow;
+static atomic_int g_used;
+
+void statbatch_set_depth(unsigned depth) {
+    g_depth = depth > STATBATCH_MAX_DEPTH ? STATBATCH_MAX_DEPTH : depth;
+    g_everywhere = 1;
+}
+
+void statbatch_set_follow(int follow) {
+    g_follow = follow;
+}
+
+const char *statbatch_backend(void) {
+    return atomic_load(&g_used) ? "io_uring" : "fstatat";
+}
+
+// A link whose target is missing (or a loop) is reported as the link.
+static void stat_sync(int dfd, const char *name, int k, StatBatchFn done, void *ctx) {
+    struct stat st;
+    int ok = (g_follow && fstatat(dfd, name, &st, 0) == 0) || fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+    done(k, ok ? &st : NULL, ctx);
+}
+
+static void run_sync(int dfd, const char *const *names, int from, int count, StatBatchFn done, void *ctx) {
+    for (int k = from; k < count; k++) stat_sync(dfd, names[k], k, done, ctx);
+}
+
+#ifdef __linux__
+
+// A ring per thread, driven with the raw syscalls. Each in-flight statx
+// owns a slot: its result buffer and the index of the name it is for.
+typedef struct {
+    int fd;
+    unsigned depth;
+
+    unsigned *sq_head, *sq_tail, sq_mask;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+
+    struct statx *bufs;
+    int *slot_k;
+    unsigned *free_slots;
+    unsigned nfree;
+} Ring;
+
+static _Thread_local Ring *g_ring;
+// Set once io_uring turned out to be missing, disabled or without
+// statx, so no other thread tries again.
+static atomic_int g_unavailable;
+
+static int ring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ring_enter(int fd, unsigned submit, unsigned wait) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+static int has_statx(int fd) {
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    if (!probe) return 0;
+    int ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+             probe->last_op >= IORING_OP_STATX && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+static void ring_unmap(Ring *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_len);
+    if (r->sq_map && r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_map_len);
+}
+
+static void ring_free(Ring *r) {
+    ring_unmap(r);
+    if (r->fd >= 0) close(r->fd);
+    free(r->bufs);
+    free(r->slot_k);
+    free(r->free_slots);
+    free(r);
+}
+
+static Ring *ring_create(unsigned depth) {
+    struct io_uring_params p;
+    unsigned flags = 0;
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(IORING_SETUP_DEFER_TASKRUN)
+    // The ring never leaves its thread; completions are only needed when
+    // we wait for them anyway.
+    flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+#endif
+    memset(&p, 0, sizeof(p));
+    p.flags = flags;
+    int fd = ring_setup(depth, &p);
+    if (fd < 0 && errno == EINVAL && flags) {
+        // Kernel older than 6.1.
+        memset(&p, 0, sizeof(p));
+        fd = ring_setup(depth, &p);
+    }
+    if (fd < 0) return NULL;
+
+    Ring *r = calloc(1, sizeof(*r));
+    if (!r) {
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+    if (!has_statx(fd)) goto fail;
+
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_len > r->sq_map_len) r->sq_map_len = r->cq_map_len;
+        r->cq_map_len = r->sq_map_len;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map = mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) goto fail;
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail;
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    // Submission entries are used in ring order, so the indirection
+    // array is the identity.
+    unsigned *array = (unsigned *)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;
+
+    // At most sq_entries requests are in flight and the completion ring
+    // is at least that large, so it cannot overflow.
+    r->depth = p.sq_entries;
+    r->bufs = malloc(r->depth * sizeof(*r->bufs));
+    r->slot_k = malloc(r->depth * sizeof(*r->slot_k));
+    r->free_slots = malloc(r->depth * sizeof(*r->free_slots));
+    if (!r->bufs || !r->slot_k || !r->free_slots) goto fail;
+    for (unsigned i = 0; i < r->depth; i++) {
+        r->slot_k[i] = -1;
+        r->free_slots[i] = i;
+    }
+    r->nfree = r->depth;
+    return r;
+
+fail:
+    ring_free(r);
+    return NULL;
+}
+
+// Filesystems where a stat is a round trip to a server (or to a FUSE
+// daemon), by statfs magic.
+static int remote_fs(int dfd) {
+    struct statfs sfs;
+    if (fstatfs(dfd, &sfs) != 0) return 0;
+    switch ((uint32_t)sfs.f_type) {
+        case 0x00006969:   // NFS
+        case 0x0000517B:   // SMB
+        case 0xFF534D42:   // CIFS
+        case 0xFE534D42:   // SMB2
+        case 0x00C36400:   // Ceph
+        case 0x65735546:   // FUSE (sshfs, s3fs, ...)
+        case 0x01021997:   // 9P
+        case 0x5346414F:   // AFS
+        case 0x73757245:   // Coda
+        case 0x0BD00BD0:   // Lustre
+        case 0x47504653:   // GPFS
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static Ring *thread_ring(void) {
+    if (g_ring) return g_ring;
+    if (!g_depth || atomic_load_explicit(&g_unavailable, memory_order_relaxed)) return NULL;
+    g_ring = ring_create(g_depth);
+    if (!g_ring) {
+        atomic_store(&g_unavailable, 1);
+        return NULL;
+    }
+    atomic_store(&g_used, 1);
+    return g_ring;
+}
+
+void statbatch_thread_cleanup(void) {
+    if (g_ring) ring_free(g_ring);
+    g_ring = NULL;
+}
+
+static void from_statx(const struct statx *x, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(x->stx_dev_major, x->stx_dev_minor);
+    st->st_ino = x->stx_ino;
+    st->st_mode = x->stx_mode;
+    st->st_nlink = x->stx_nlink;
+    st->st_uid = x->stx_uid;
+    st->st_gid = x->stx_gid;
+    st->st_rdev = makedev(x->stx_rdev_major, x->stx_rdev_minor);
+    st->st_size = (off_t)x->stx_size;
+    st->st_blksize = (blksize_t)x->stx_blksize;
+    st->st_blocks = (blkcnt_t)x->stx_blocks;
+    st->st_atim.tv_sec = x->stx_atime.tv_sec;
+    st->st_atim.tv_nsec = x->stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = x->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = x->stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = x->stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = x->stx_ctime.tv_nsec;
+}
+
+// Hand every posted completion to its caller. Failures other than a
+// vanished entry are retried with fstatat, so results never depend on
+// which path was taken; when following symlinks that includes ENOENT,
+// which then may only mean the link dangles.
+static unsigned reap(Ring *r, int dfd, const char *const *names, StatBatchFn done, void *ctx) {
+    unsigned head = *r->cq_head, n = 0;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++, n++) {
+        const struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+        unsigned slot = (unsigned)cqe->user_data;
+        int k = r->slot_k[slot];
+        if (cqe->res == 0) {
+            struct stat st;
+            from_statx(&r->bufs[slot], &st);
+            done(k, &st, ctx);
+        } else if (cqe->res == -ENOENT && !g_follow) {
+            done(k, NULL, ctx);
+        } else {
+            stat_sync(dfd, names[k], k, done, ctx);
+        }
+        r->slot_k[slot] = -1;
+        r->free_slots[r->nfree++] = slot;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+// Returns 0 when all names were handled, or -1 if the ring failed; the
+// names of requests still in flight and those never queued are then
+// finished synchronously, and the ring is dropped without releasing the
+// buffers the kernel may still write to.
+static int run_ring(Ring *r, int dfd, const char *const *names, int count, StatBatchFn done, void *ctx) {
+    int next = 0;
+    unsigned inflight = 0;
+    while (next < count || inflight) {
+        unsigned tail = *r->sq_tail, queued = 0;
+        while (next < count && r->nfree) {
+            unsigned slot = r->free_slots[--r->nfree];
+            struct io_uring_sqe *sqe = &r->sqes[tail & r->sq_mask];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dfd;
+            sqe->addr = (uint64_t)(uintptr_t)names[next];
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (uint64_t)(uintptr_t)&r->bufs[slot];
+            sqe->statx_flags = g_follow ? 0 : AT_SYMLINK_NOFOLLOW;
+            sqe->user_data = slot;
+            r->slot_k[slot] = next++;
+            tail++;
+            queued++;
+        }
+        __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+        inflight += queued;
+
+        int ret;
+        do ret = ring_enter(r->fd, tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE), 1);
+        while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            // Entries the kernel did not consume are never submitted now;
+            // every slot still owned by a request is redone here.
+            for (unsigned slot = 0; slot < r->depth; slot++)
+                if (r->slot_k[slot] >= 0) stat_sync(dfd, names[r->slot_k[slot]], r->slot_k[slot], done, ctx);
+            run_sync(dfd, names, next, count, done, ctx);
+            ring_unmap(r);
+            close(r->fd);
+            free(r->slot_k);
+            free(r->free_slots);
+            free(r);
+            return -1;
+        }
+        inflight -= reap(r, dfd, names, done, ctx);
+    }
+    return 0;
+}
+
+void statbatch_run(int dfd, const char *const *names, int count, StatBatchFn done, void *ctx) {
+    uint64_t t0 = stats_start();
+    Ring *r = count >= STATBATCH_MIN && (g_everywhere || remote_fs(dfd)) ? thread_ring() : NULL;
+    if (!r) {
+        run_sync(dfd, names, 0, count, done, ctx);
+    } else if (run_ring(r, dfd, names, count, done, ctx) != 0) {
+        g_ring = NULL;
+        atomic_store(&g_unavailable, 1);
+    }
+    stats_stop_n(STATS_STAT, t0, (unsigned long)count);
+}
+
+#else
+
+void statbatch_thread_cleanup(void) {
+}
+
+void statbatch_run(int dfd, const char *const *names, int count, StatBatchFn done, void *ctx) {
+    uint64_t t0 = stats_start();
+    run_sync(dfd, names, 0, count, done, ctx);
+    stats_stop_n(STATS_STAT, t0, (unsigned long)count);
+}
+
+#endif
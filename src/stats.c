@@ -0,0 +1,60 @@
+#include <stdatomic.h>
+#include <time.h>
+
+#include "stats.h"
+
+static int g_enabled;
+static uint64_t g_enabled_at;
+
+static atomic_ullong g_phase_ns[STATS_PHASES];
+static atomic_ulong g_phase_calls[STATS_PHASES];
+static atomic_ulong g_counters[STATS_COUNTERS];
+
+static const char *const PHASE_NAMES[STATS_PHASES] = { "readdir", "stat", "ids", "sort", "write", "git" };
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Called before any loader thread exists, so the plain flag is safe.
+void stats_enable(void) {
+    g_enabled = 1;
+    g_enabled_at = now_ns();
+}
+
+int stats_enabled(void) {
+    return g_enabled;
+}
+
+uint64_t stats_start(void) {
+    return g_enabled ? now_ns() : 0;
+}
+
+void stats_stop(StatsPhase phase, uint64_t start) {
+    stats_stop_n(phase, start, 1);
+}
+
+void stats_stop_n(StatsPhase phase, uint64_t start, unsigned long calls) {
+    if (!start) return;
+    atomic_fetch_add_explicit(&g_phase_ns[phase], now_ns() - start, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_phase_calls[phase], calls, memory_order_relaxed);
+}
+
+void stats_add(StatsCounter counter, unsigned long n) {
+    if (g_enabled) atomic_fetch_add_explicit(&g_counters[counter], n, memory_order_relaxed);
+}
+
+void stats_get(StatsSnapshot *out) {
+    out->elapsed_ns = g_enabled ? now_ns() - g_enabled_at : 0;
+    for (int p = 0; p < STATS_PHASES; p++) {
+        out->phase_ns[p] = atomic_load(&g_phase_ns[p]);
+        out->phase_calls[p] = atomic_load(&g_phase_calls[p]);
+    }
+    for (int c = 0; c < STATS_COUNTERS; c++) out->counters[c] = atomic_load(&g_counters[c]);
+}
+
+const char *stats_phase_name(StatsPhase phase) {
+    return PHASE_NAMES[phase];
+}
@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "textwidth.h"
+
+// Length of the leading run of bytes that are each exactly one column
+// wide: everything below 0x80 except ESC and NUL. Control characters
+// count as one column, matching the wcwidth fallback used for them.
+static size_t ascii_run(const unsigned char *s, size_t n) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i esc = _mm_set1_epi8(0x1b);
+    const __m128i nul = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(v)
+                   | (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, esc))
+                   | (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nul));
+        if (m) return i + (size_t)__builtin_ctz(m);
+    }
+#else
+    // SWAR: eight bytes at a time. The zero-byte test can report false
+    // positives above a real hit, so the exact position is left to the
+    // byte loop below.
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t high = 0x8080808080808080ull;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, sizeof(w));
+        uint64_t e = w ^ (ones * 0x1b);
+        uint64_t hit = (w & high)
+                     | ((w - ones) & ~w & high)
+                     | ((e - ones) & ~e & high);
+        if (hit) break;
+    }
+#endif
+
+    while (i < n && s[i] < 0x80 && s[i] != 0x1b && s[i] != 0) i++;
+    return i;
+}
+
+int text_width(const char *str, size_t len) {
+    const unsigned char *s = (const unsigned char *)str;
+    mbstate_t st;
+    memset(&st, 0, sizeof(st));
+
+    int cols = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t run = ascii_run(s + i, len - i);
+        cols += (int)run;
+        i += run;
+        if (i >= len || s[i] == 0) break;
+
+        // Skip ANSI escape sequences: ESC [ ... final
+        if (s[i] == 0x1b) {
+            if (i + 1 < len && s[i + 1] == '[') {
+                i += 2;
+                while (i < len && s[i] && !(s[i] >= '@' && s[i] <= '~')) i++;
+                if (i < len && s[i]) i++; // consume final byte
+            } else {
+                cols += 1; // a lone ESC is a non-printable: one column
+                i += 1;
+            }
+            continue;
+        }
+
+        // Genuinely multibyte span: decode until the next ASCII byte.
+        while (i < len && s[i] >= 0x80) {
+            wchar_t wc;
+            size_t avail = len - i;
+            size_t n = mbrtowc(&wc, str + i, avail < MB_CUR_MAX ? avail : MB_CUR_MAX, &st);
+
+            if (n == (size_t)-1 || n == (size_t)-2 || n == 0) {
+                // Invalid or truncated sequence; count as 1 and move on
+                cols += 1;
+                i += 1;
+                memset(&st, 0, sizeof(st));
+                continue;
+            }
+
+            int w = wcwidth(wc);
+            if (w < 0) w = 1; // non-printables fall back to 1
+
+            cols += w;
+            i += n;
+        }
+    }
+
+    return cols;
+}
+
+size_t text_fit(const char *str, size_t len, int cols, int *width) {
+    const unsigned char *s = (const unsigned char *)str;
+    mbstate_t st;
+    memset(&st, 0, sizeof(st));
+
+    int used = 0;
+    size_t i = 0;
+
+    while (i < len && s[i]) {
+        size_t run = ascii_run(s + i, len - i);
+        if (run) {
+            if (run > (size_t)(cols - used)) run = (size_t)(cols - used);
+            used += (int)run;
+            i += run;
+            if (used == cols) break;
+            continue;
+        }
+
+        size_t n;
+        int w;
+        if (s[i] == 0x1b && i + 1 < len && s[i + 1] == '[') {
+            n = 2;
+            while (i + n < len && s[i + n] && !(s[i + n] >= '@' && s[i + n] <= '~')) n++;
+            if (i + n < len && s[i + n]) n++;
+            w = 0;
+        } else if (s[i] == 0x1b) {
+            n = 1;
+            w = 1;
+        } else {
+            wchar_t wc;
+            size_t avail = len - i;
+            n = mbrtowc(&wc, str + i, avail < MB_CUR_MAX ? avail : MB_CUR_MAX, &st);
+            if (n == (size_t)-1 || n == (size_t)-2 || n == 0) {
+                n = 1;
+                w = 1;
+                memset(&st, 0, sizeof(st));
+            } else {
+                w = wcwidth(wc);
+                if (w < 0) w = 1;
+            }
+        }
+        if (used + w > cols) break;
+        used += w;
+        i += n;
+    }
+
+    *width = used;
+    return i;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "timefmt.h"
+
+#define SECS_PER_DAY 86400
+#define OFFSET_CACHE_SIZE 64
+
+typedef struct {
+    int64_t day;   // UTC day number
+    long offset;   // seconds east of UTC, constant over the whole day
+    int valid;
+} OffsetSlot;
+
+static time_t g_now;
+static char g_months[12][32];
+static OffsetSlot g_offsets[OFFSET_CACHE_SIZE];
+
+void timefmt_init(void) {
+    tzset();
+    timefmt_refresh();
+
+    for (int m = 0; m < 12; m++) {
+        struct tm tmv;
+        memset(&tmv, 0, sizeof(tmv));
+        tmv.tm_year = 100;
+        tmv.tm_mon = m;
+        tmv.tm_mday = 1;
+        if (strftime(g_months[m], sizeof(g_months[m]), "%b", &tmv) == 0) g_months[m][0] = '\0';
+    }
+    memset(g_offsets, 0, sizeof(g_offsets));
+}
+
+time_t timefmt_now(void) {
+    return g_now;
+}
+
+void timefmt_refresh(void) {
+    g_now = time(NULL);
+}
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    if ((a % b) != 0 && ((a < 0) != (b < 0))) q--;
+    return q;
+}
+
+// Offset of local time from UTC at t, or -1 if the day starting at the
+// UTC midnight before t has an offset change (or localtime_r fails).
+static int day_offset(time_t t, long *offset) {
+    int64_t day = floor_div((int64_t)t, SECS_PER_DAY);
+    OffsetSlot *slot = &g_offsets[(uint64_t)day % OFFSET_CACHE_SIZE];
+    if (slot->valid && slot->day == day) {
+        *offset = slot->offset;
+        return 0;
+    }
+
+    time_t start = (time_t)(day * SECS_PER_DAY);
+    time_t end = start + SECS_PER_DAY - 1;
+    struct tm a, b;
+    if (!localtime_r(&start, &a) || !localtime_r(&end, &b)) return -1;
+    if (a.tm_gmtoff != b.tm_gmtoff) return -1;
+
+    slot->day = day;
+    slot->offset = a.tm_gmtoff;
+    slot->valid = 1;
+    *offset = a.tm_gmtoff;
+    return 0;
+}
+
+// Days since 1970-01-01 to civil month (0-11) and day of month (1-31),
+// after Howard Hinnant's days_from_civil inverse.
+static void civil_from_days(int64_t z, int *month, int *mday) {
+    z += 719468;
+    int64_t era = floor_div(z, 146097);
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    *mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *month = (int)(mp < 10 ? mp + 2 : mp - 10);
+}
+
+static void format_slow(time_t t, char *out, size_t outsz) {
+    struct tm tmv;
+    if (!localtime_r(&t, &tmv)) { snprintf(out, outsz, "??? ?? ??:??"); return; }
+    strftime(out, outsz, "%b %d %H:%M", &tmv);
+}
+
+void timefmt_format(time_t t, char *out, size_t outsz) {
+    long offset;
+    if (day_offset(t, &offset) != 0) {
+        format_slow(t, out, outsz);
+        return;
+    }
+
+    int64_t local = (int64_t)t + offset;
+    int64_t day = floor_div(local, SECS_PER_DAY);
+    int secs = (int)(local - day * SECS_PER_DAY);
+
+    int month, mday;
+    civil_from_days(day, &month, &mday);
+
+    const char *mon = g_months[month];
+    size_t mlen = strlen(mon);
+    if (mlen + 13 > outsz) {
+        format_slow(t, out, outsz);
+        return;
+    }
+
+    int hour = secs / 3600;
+    int min = (secs / 60) % 60;
+    char *p = out;
+    memcpy(p, mon, mlen);
+    p += mlen;
+    *p++ = ' ';
+    *p++ = (char)('0' + mday / 10);
+    *p++ = (char)('0' + mday % 10);
+    *p++ = ' ';
+    *p++ = (char)('0' + hour / 10);
+    *p++ = (char)('0' + hour % 10);
+    *p++ = ':';
+    *p++ = (char)('0' + min / 10);
+    *p++ = (char)('0' + min % 10);
+    *p = '\0';
+}
@@ -0,0 +1,529 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "walk.h"
+#include "dirscan.h"
+#include "statbatch.h"
+
+// Soft cap on entries that are loaded but not yet released by the
+// consumer. Workers stop taking new directories above it.
+#define WALK_MAX_LOADED 262144
+
+enum { NODE_PENDING, NODE_CLAIMED, NODE_DONE };
+
+struct WalkNode {
+    char *path;
+    int level;
+    int ok;
+    int shown;        // rows will be emitted (always, unless totals are on)
+    FileList list;
+    WalkNode **children;
+    atomic_int state;
+    atomic_int refs;  // consumer + every deque slot + every child holding it
+
+    // Subtree totals (only with walker_set_totals). pending counts the
+    // node itself plus each child subtree still being counted; whoever
+    // takes it to zero finalizes total and hands it to the parent.
+    WalkNode *parent;
+    WalkTotals own;
+    WalkTotals total;
+    atomic_ullong acc_bytes;
+    atomic_ullong acc_files;
+    atomic_int pending;
+    atomic_int subtree_done;
+};
+
+// Mutex-protected deque. The owner pushes and pops at the bottom (depth
+// first, good locality); thieves take from the top, which holds the
+// oldest and usually shallowest, i.e. largest, subtrees.
+typedef struct {
+    pthread_mutex_t mu;
+    WalkNode **slots;
+    size_t cap;
+    size_t head;  // index of top
+    size_t len;
+} Deque;
+
+typedef struct {
+    Walker *w;
+    int id;
+    pthread_t thread;
+} Worker;
+
+struct Walker {
+    WalkLoadFn load;
+    WalkDescendFn descend;
+    WalkSumFn sum;
+    int keep_level;
+    void *ctx;
+
+    int nworkers;    // threads actually running
+    int ndeques;
+    Worker *workers;
+    Deque *deques;   // one per worker
+    Deque inject;    // roots and children queued by the consumer
+
+    pthread_mutex_t mu;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    pthread_cond_t space_cv;
+
+    atomic_int queued;
+    atomic_long loaded;
+    atomic_int stop;
+};
+
+static void deque_init(Deque *d) {
+    pthread_mutex_init(&d->mu, NULL);
+    d->slots = NULL;
+    d->cap = 0;
+    d->head = 0;
+    d->len = 0;
+}
+
+static void deque_destroy(Deque *d) {
+    free(d->slots);
+    pthread_mutex_destroy(&d->mu);
+}
+
+static int deque_push_bottom(Deque *d, WalkNode *n) {
+    pthread_mutex_lock(&d->mu);
+    if (d->len == d->cap) {
+        size_t ncap = d->cap ? d->cap * 2 : 64;
+        WalkNode **ns = malloc(ncap * sizeof(*ns));
+        if (!ns) { pthread_mutex_unlock(&d->mu); return -1; }
+        for (size_t k = 0; k < d->len; k++) ns[k] = d->slots[(d->head + k) % d->cap];
+        free(d->slots);
+        d->slots = ns;
+        d->cap = ncap;
+        d->head = 0;
+    }
+    d->slots[(d->head + d->len) % d->cap] = n;
+    d->len++;
+    pthread_mutex_unlock(&d->mu);
+    return 0;
+}
+
+static WalkNode *deque_pop_bottom(Deque *d) {
+    WalkNode *n = NULL;
+    pthread_mutex_lock(&d->mu);
+    if (d->len) {
+        d->len--;
+        n = d->slots[(d->head + d->len) % d->cap];
+    }
+    pthread_mutex_unlock(&d->mu);
+    return n;
+}
+
+static WalkNode *deque_steal_top(Deque *d) {
+    WalkNode *n = NULL;
+    pthread_mutex_lock(&d->mu);
+    if (d->len) {
+        n = d->slots[d->head];
+        d->head = (d->head + 1) % d->cap;
+        d->len--;
+    }
+    pthread_mutex_unlock(&d->mu);
+    return n;
+}
+
+static WalkNode *node_new(const char *path, int level) {
+    WalkNode *n = calloc(1, sizeof(*n));
+    if (!n) return NULL;
+    size_t len = strlen(path) + 1;
+    n->path = malloc(len);
+    if (!n->path) { free(n); return NULL; }
+    memcpy(n->path, path, len);
+    n->level = level;
+    filelist_init(&n->list);
+    n->shown = 1;
+    atomic_init(&n->state, NODE_PENDING);
+    atomic_init(&n->refs, 1);
+    atomic_init(&n->acc_bytes, 0);
+    atomic_init(&n->acc_files, 0);
+    atomic_init(&n->pending, 1);
+    atomic_init(&n->subtree_done, 0);
+    return n;
+}
+
+static void node_unref(WalkNode *n) {
+    if (atomic_fetch_sub(&n->refs, 1) == 1) {
+        free(n->path);
+        free(n);
+    }
+}
+
+static int enqueue(Walker *w, Deque *d, WalkNode *n) {
+    // Without workers nobody would ever take it off the queue, and the
+    // slot's reference would keep the node until walker_destroy.
+    if (!w->nworkers) return -1;
+    atomic_fetch_add(&n->refs, 1);
+    if (deque_push_bottom(d, n) != 0) {
+        // Not queued: the consumer will load it when it gets there.
+        atomic_fetch_sub(&n->refs, 1);
+        return -1;
+    }
+    atomic_fetch_add(&w->queued, 1);
+    return 0;
+}
+
+static void wake_workers(Walker *w) {
+    pthread_mutex_lock(&w->mu);
+    pthread_cond_broadcast(&w->work_cv);
+    pthread_mutex_unlock(&w->mu);
+}
+
+static int claim(WalkNode *n) {
+    int expected = NODE_PENDING;
+    return atomic_compare_exchange_strong(&n->state, &expected, NODE_CLAIMED);
+}
+
+// Count one finished node (or child subtree) against n. The call that
+// completes a subtree publishes its total, adds it into the parent and
+// carries on upwards, dropping the reference each child holds on its
+// parent as it goes.
+static void subtree_dec(Walker *w, WalkNode *n) {
+    WalkNode *held = NULL;
+    for (;;) {
+        WalkNode *up = NULL;
+        if (atomic_fetch_sub(&n->pending, 1) == 1) {
+            n->total.bytes = n->own.bytes + atomic_load(&n->acc_bytes);
+            n->total.files = n->own.files + atomic_load(&n->acc_files);
+            up = n->parent;
+            if (up) {
+                atomic_fetch_add(&up->acc_bytes, n->total.bytes);
+                atomic_fetch_add(&up->acc_files, n->total.files);
+            }
+
+            pthread_mutex_lock(&w->mu);
+            atomic_store(&n->subtree_done, 1);
+            pthread_cond_broadcast(&w->done_cv);
+            pthread_mutex_unlock(&w->mu);
+        }
+        if (held) node_unref(held);
+        if (!up) return;
+        held = n = up;
+    }
+}
+
+// Remove the entries that were loaded only to be counted, and the
+// consumer's reference to their subtrees, which are counted like those
+// past keep_level.
+static void drop_filtered(WalkNode *n) {
+    int kept = 0;
+    for (int i = 0; i < n->list.count; i++) {
+        WalkNode *c = n->children ? n->children[i] : NULL;
+        if (n->list.flags[i] & FI_FILTERED) {
+            if (c) node_unref(c);
+            continue;
+        }
+        if (n->children) n->children[kept] = c;
+        kept++;
+    }
+    if (kept < n->list.count) filelist_drop_flagged(&n->list, FI_FILTERED);
+}
+
+// Load a claimed node, create its children and queue them on d so that
+// popping from the bottom yields them in listing order.
+static void process(Walker *w, WalkNode *n, Deque *d) {
+    char child_path[MAX_PATH];
+
+    n->ok = (w->load(&n->list, n->path, w->ctx) == 0);
+    if (n->ok && n->list.count > 0) {
+        n->children = calloc((size_t)n->list.count, sizeof(*n->children));
+    }
+
+    int nkids = 0;
+    if (n->children) {
+        for (int i = 0; i < n->list.count; i++) {
+            if (!w->descend(&n->list, i, n->level, w->ctx)) continue;
+            if (filelist_path(&n->list, i, child_path, sizeof(child_path)) < 0) continue;
+
+            WalkNode *c = node_new(child_path, n->level + 1);
+            if (!c) continue;
+            if (w->sum) {
+                c->shown = c->level <= w->keep_level && !(n->list.flags[i] & FI_FILTERED);
+                c->parent = n;
+                atomic_fetch_add(&n->refs, 1);
+            }
+            n->children[i] = c;
+            nkids++;
+        }
+    }
+
+    // Totals must be armed before any child can finish.
+    if (w->sum) {
+        w->sum(&n->list, &n->own, w->ctx);
+        atomic_store(&n->pending, nkids + 1);
+    }
+
+    // Without workers nothing is queued, and the children are gone
+    // through in listing order so the walk stays depth first.
+    for (int k = 0; n->children && k < n->list.count; k++) {
+        int i = w->nworkers ? n->list.count - 1 - k : k;
+        WalkNode *c = n->children[i];
+        if (!c || enqueue(w, d, c) == 0) continue;
+        // A node the consumer will never visit has to be counted now.
+        if (!c->shown && claim(c)) process(w, c, d);
+    }
+
+    // Past the emitted levels the list was only needed for counting, and
+    // nobody will come for the children: drop both now. On them, only
+    // the filtered entries go.
+    if (n->shown) drop_filtered(n);
+    long count = n->list.count;
+    if (!n->shown) {
+        if (n->children) {
+            for (int i = 0; i < n->list.count; i++) {
+                if (n->children[i]) node_unref(n->children[i]);
+            }
+        }
+        free(n->children);
+        n->children = NULL;
+        filelist_free(&n->list);
+    } else {
+        atomic_fetch_add(&w->loaded, count);
+    }
+
+    pthread_mutex_lock(&w->mu);
+    atomic_store(&n->state, NODE_DONE);
+    pthread_cond_broadcast(&w->done_cv);
+    if (nkids) pthread_cond_broadcast(&w->work_cv);
+    pthread_mutex_unlock(&w->mu);
+
+    if (w->sum) subtree_dec(w, n);
+}
+
+static WalkNode *find_work(Walker *w, int self) {
+    WalkNode *n = deque_pop_bottom(&w->deques[self]);
+    if (n) return n;
+
+    n = deque_steal_top(&w->inject);
+    if (n) return n;
+
+    for (int k = 1; k < w->ndeques; k++) {
+        n = deque_steal_top(&w->deques[(self + k) % w->ndeques]);
+        if (n) return n;
+    }
+    return NULL;
+}
+
+static void *worker_main(void *arg) {
+    Worker *me = arg;
+    Walker *w = me->w;
+
+    while (!atomic_load(&w->stop)) {
+        if (atomic_load(&w->loaded) > WALK_MAX_LOADED) {
+            pthread_mutex_lock(&w->mu);
+            while (atomic_load(&w->loaded) > WALK_MAX_LOADED && !atomic_load(&w->stop)) {
+                pthread_cond_wait(&w->space_cv, &w->mu);
+            }
+            pthread_mutex_unlock(&w->mu);
+            continue;
+        }
+
+        WalkNode *n = find_work(w, me->id);
+        if (!n) {
+            pthread_mutex_lock(&w->mu);
+            while (atomic_load(&w->queued) == 0 && !atomic_load(&w->stop)) {
+                pthread_cond_wait(&w->work_cv, &w->mu);
+            }
+            pthread_mutex_unlock(&w->mu);
+            continue;
+        }
+
+        atomic_fetch_sub(&w->queued, 1);
+        if (claim(n)) process(w, n, &w->deques[me->id]);
+        node_unref(n);
+    }
+    dirscan_thread_cleanup();
+    statbatch_thread_cleanup();
+    return NULL;
+}
+
+Walker *walker_create(int nthreads, WalkLoadFn load, WalkDescendFn descend, void *ctx) {
+    if (nthreads < 0) nthreads = 0;
+    int ndeques = nthreads ? nthreads : 1;
+
+    Walker *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+
+    w->load = load;
+    w->descend = descend;
+    w->ctx = ctx;
+    w->nworkers = 0;
+    pthread_mutex_init(&w->mu, NULL);
+    pthread_cond_init(&w->work_cv, NULL);
+    pthread_cond_init(&w->done_cv, NULL);
+    pthread_cond_init(&w->space_cv, NULL);
+    atomic_init(&w->queued, 0);
+    atomic_init(&w->loaded, 0);
+    atomic_init(&w->stop, 0);
+
+    w->deques = calloc((size_t)ndeques, sizeof(*w->deques));
+    w->workers = calloc((size_t)ndeques, sizeof(*w->workers));
+    if (!w->deques || !w->workers) {
+        free(w->deques);
+        free(w->workers);
+        free(w);
+        return NULL;
+    }
+    w->ndeques = ndeques;
+    for (int i = 0; i < ndeques; i++) deque_init(&w->deques[i]);
+    deque_init(&w->inject);
+
+    // Fewer threads than asked for still works; the consumer helps out.
+    for (int i = 0; i < nthreads; i++) {
+        w->workers[i].w = w;
+        w->workers[i].id = i;
+        if (pthread_create(&w->workers[i].thread, NULL, worker_main, &w->workers[i]) != 0) break;
+        w->nworkers++;
+    }
+    return w;
+}
+
+static void drain(Deque *d) {
+    WalkNode *n;
+    while ((n = deque_pop_bottom(d)) != NULL) node_unref(n);
+}
+
+void walker_destroy(Walker *w) {
+    if (!w) return;
+
+    pthread_mutex_lock(&w->mu);
+    atomic_store(&w->stop, 1);
+    pthread_cond_broadcast(&w->work_cv);
+    pthread_cond_broadcast(&w->space_cv);
+    pthread_mutex_unlock(&w->mu);
+
+    for (int i = 0; i < w->nworkers; i++) pthread_join(w->workers[i].thread, NULL);
+
+    // Anything still queued was already loaded or abandoned by the consumer.
+    for (int i = 0; i < w->ndeques; i++) {
+        drain(&w->deques[i]);
+        deque_destroy(&w->deques[i]);
+    }
+    drain(&w->inject);
+    deque_destroy(&w->inject);
+
+    pthread_cond_destroy(&w->space_cv);
+    pthread_cond_destroy(&w->done_cv);
+    pthread_cond_destroy(&w->work_cv);
+    pthread_mutex_destroy(&w->mu);
+    free(w->deques);
+    free(w->workers);
+    free(w);
+}
+
+void walker_set_totals(Walker *w, WalkSumFn sum, int keep_level) {
+    w->sum = sum;
+    w->keep_level = keep_level;
+}
+
+WalkNode *walker_submit(Walker *w, const char *path, int level) {
+    WalkNode *n = node_new(path, level);
+    if (!n) return NULL;
+    if (w->sum) n->shown = level <= w->keep_level;
+    enqueue(w, &w->inject, n);
+    wake_workers(w);
+    return n;
+}
+
+int walker_wait(Walker *w, WalkNode *node) {
+    if (claim(node)) {
+        process(w, node, &w->inject);
+    } else if (atomic_load(&node->state) != NODE_DONE) {
+        pthread_mutex_lock(&w->mu);
+        while (atomic_load(&node->state) != NODE_DONE) pthread_cond_wait(&w->done_cv, &w->mu);
+        pthread_mutex_unlock(&w->mu);
+    }
+    return node->ok ? 0 : -1;
+}
+
+// Alone, the consumer loads what is left of the subtree itself, depth
+// first in listing order; nodes below the shown levels were counted as
+// their parents were loaded.
+static void finish_subtree(Walker *w, WalkNode *n) {
+    if (atomic_load(&n->subtree_done)) return;
+    walker_wait(w, n);
+    for (int i = 0; n->children && i < n->list.count; i++) {
+        WalkNode *c = n->children[i];
+        if (c && c->shown) finish_subtree(w, c);
+    }
+}
+
+void walker_wait_totals(Walker *w, WalkNode *node, WalkTotals *out) {
+    if (!w->nworkers) finish_subtree(w, node);
+    walker_wait(w, node);
+
+    // Help with the subtree instead of just sleeping on it: the workers
+    // may be parked on the loaded-entries cap.
+    while (!atomic_load(&node->subtree_done)) {
+        WalkNode *n = deque_steal_top(&w->inject);
+        for (int k = 0; !n && k < w->ndeques; k++) n = deque_steal_top(&w->deques[k]);
+        if (n) {
+            atomic_fetch_sub(&w->queued, 1);
+            if (claim(n)) process(w, n, &w->inject);
+            node_unref(n);
+            continue;
+        }
+
+        pthread_mutex_lock(&w->mu);
+        while (!atomic_load(&node->subtree_done) && atomic_load(&w->queued) == 0) {
+            pthread_cond_wait(&w->done_cv, &w->mu);
+        }
+        pthread_mutex_unlock(&w->mu);
+    }
+    *out = node->total;
+}
+
+int walk_node_shown(const WalkNode *node) {
+    return node->shown;
+}
+
+const FileList *walk_node_list(const WalkNode *node) {
+    return &node->list;
+}
+
+WalkNode *walk_node_child(const WalkNode *node, int i) {
+    return node->children ? node->children[i] : NULL;
+}
+
+// Return count entries to the loaded budget.
+static void unload(Walker *w, long count) {
+    // Workers may be parked on the cap; let them re-check.
+    if (atomic_fetch_sub(&w->loaded, count) > WALK_MAX_LOADED) {
+        pthread_mutex_lock(&w->mu);
+        pthread_cond_broadcast(&w->space_cv);
+        pthread_mutex_unlock(&w->mu);
+    }
+}
+
+void walker_release(Walker *w, WalkNode *node) {
+    long count = node->list.count;
+    filelist_free(&node->list);
+    free(node->children);
+    node->children = NULL;
+
+    unload(w, count);
+    node_unref(node);
+}
+
+int walk_node_ready(const WalkNode *node) {
+    return atomic_load(&node->state) == NODE_DONE;
+}
+
+int walker_take(Walker *w, WalkNode *node, FileList *out) {
+    int ok = node->ok;
+    long count = node->list.count;
+    *out = node->list;
+    filelist_init(&node->list);
+    free(node->children);
+    node->children = NULL;
+
+    unload(w, count);
+    node_unref(node);
+    return ok ? 0 : -1;
+}
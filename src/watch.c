@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/inotify.h>
+#endif
+
+#include "watch.h"
+
+#ifdef __linux__
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | \
+                    IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+typedef struct WatchDir {
+    char *path;
+    size_t path_len;
+    uint64_t hash;
+    int wd;
+    FileList list;
+    size_t garbage;             // name bytes of removed entries still in the arena
+    struct WatchDir *next_wd;   // another path reaching the same directory
+} WatchDir;
+
+struct Watch {
+    int fd;
+    WatchFillFn fill;
+    void *ctx;
+
+    WatchDir **slots;   // by path, open addressing; cap is a power of two
+    size_t cap;
+    size_t count;
+
+    WatchDir **by_wd;   // inotify hands out small increasing descriptors
+    int wd_cap;
+};
+
+static uint64_t hash_path(const char *s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull;   // FNV-1a
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+Watch *watch_new(WatchFillFn fill, void *ctx) {
+    Watch *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    w->fill = fill;
+    w->ctx = ctx;
+    return w;
+}
+
+static void dir_free(WatchDir *d) {
+    filelist_free(&d->list);
+    free(d->path);
+    free(d);
+}
+
+void watch_free(Watch *w) {
+    if (!w) return;
+    for (size_t i = 0; i < w->cap; i++) {
+        if (w->slots[i]) dir_free(w->slots[i]);
+    }
+    free(w->slots);
+    free(w->by_wd);
+    close(w->fd);
+    free(w);
+}
+
+static size_t find_slot(const Watch *w, const char *path, size_t len, uint64_t h) {
+    size_t mask = w->cap - 1;
+    size_t i = (size_t)h & mask;
+    while (w->slots[i]) {
+        const WatchDir *d = w->slots[i];
+        if (d->hash == h && d->path_len == len && memcmp(d->path, path, len) == 0) break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+const FileList *watch_find(const Watch *w, const char *path) {
+    if (!w->count) return NULL;
+    size_t len = strlen(path);
+    const WatchDir *d = w->slots[find_slot(w, path, len, hash_path(path, len))];
+    return d ? &d->list : NULL;
+}
+
+int watch_fd(const Watch *w) {
+    return w->fd;
+}
+
+static int table_grow(Watch *w) {
+    size_t ncap = w->cap ? w->cap * 2 : 64;
+    WatchDir **old = w->slots;
+    size_t ocap = w->cap;
+
+    w->slots = calloc(ncap, sizeof(*w->slots));
+    if (!w->slots) {
+        w->slots = old;
+        return -1;
+    }
+    w->cap = ncap;
+    for (size_t i = 0; i < ocap; i++) {
+        WatchDir *d = old[i];
+        if (d) w->slots[find_slot(w, d->path, d->path_len, d->hash)] = d;
+    }
+    free(old);
+    return 0;
+}
+
+// Linear-probing delete: pull later members of the cluster back so
+// lookups never stop at the hole.
+static void table_remove(Watch *w, size_t i) {
+    size_t mask = w->cap - 1;
+    w->slots[i] = NULL;
+    w->count--;
+    for (size_t j = (i + 1) & mask; w->slots[j]; j = (j + 1) & mask) {
+        size_t home = (size_t)w->slots[j]->hash & mask;
+        int stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays) continue;
+        w->slots[i] = w->slots[j];
+        w->slots[j] = NULL;
+        i = j;
+    }
+}
+
+int watch_start(Watch *w, const char *path) {
+    return inotify_add_watch(w->fd, path, WATCH_MASK);
+}
+
+int watch_keep(Watch *w, int wd, const char *path, const FileList *list) {
+    if ((w->count + 1) * 4 > w->cap * 3 && table_grow(w) != 0) return -1;
+
+    if (wd >= w->wd_cap) {
+        int ncap = w->wd_cap ? w->wd_cap : 64;
+        while (ncap <= wd) ncap *= 2;
+        WatchDir **p = realloc(w->by_wd, (size_t)ncap * sizeof(*p));
+        if (!p) return -1;
+        memset(p + w->wd_cap, 0, (size_t)(ncap - w->wd_cap) * sizeof(*p));
+        w->by_wd = p;
+        w->wd_cap = ncap;
+    }
+
+    WatchDir *d = calloc(1, sizeof(*d));
+    if (!d) return -1;
+    d->path_len = strlen(path);
+    d->path = malloc(d->path_len + 1);
+    filelist_init(&d->list);
+    if (!d->path || filelist_copy(&d->list, list) != 0) {
+        dir_free(d);
+        return -1;
+    }
+    memcpy(d->path, path, d->path_len + 1);
+    d->hash = hash_path(path, d->path_len);
+    d->wd = wd;
+
+    size_t i = find_slot(w, path, d->path_len, d->hash);
+    if (w->slots[i]) return (dir_free(d), 0);   // already watched under this path
+    w->slots[i] = d;
+    w->count++;
+    d->next_wd = w->by_wd[wd];
+    w->by_wd[wd] = d;
+    return 0;
+}
+
+// Forget one kept directory; it is read again the next time it is
+// listed. The kernel watch goes once no other path shares it.
+static void drop_dir(Watch *w, WatchDir *d, int rm_watch) {
+    WatchDir **pp = &w->by_wd[d->wd];
+    while (*pp && *pp != d) pp = &(*pp)->next_wd;
+    if (*pp) *pp = d->next_wd;
+    if (rm_watch && !w->by_wd[d->wd]) inotify_rm_watch(w->fd, d->wd);
+
+    table_remove(w, find_slot(w, d->path, d->path_len, d->hash));
+    dir_free(d);
+}
+
+// Drop path and every kept directory below it (a directory that was
+// removed or renamed: their paths no longer lead anywhere).
+static void drop_subtree(Watch *w, const char *path, size_t len) {
+    WatchDir **victims = NULL;
+    size_t n = 0, cap = 0;
+    for (size_t i = 0; i < w->cap; i++) {
+        WatchDir *d = w->slots[i];
+        if (!d || d->path_len < len || memcmp(d->path, path, len) != 0) continue;
+        if (d->path_len > len && d->path[len] != '/') continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            WatchDir **p = realloc(victims, cap * sizeof(*p));
+            if (!p) break;
+            victims = p;
+        }
+        victims[n++] = d;
+    }
+    for (size_t k = 0; k < n; k++) drop_dir(w, victims[k], 1);
+    free(victims);
+}
+
+static int find_name(const FileList *list, const char *name, size_t len) {
+    for (int i = 0; i < list->count; i++) {
+        if (list->name_len[i] == len && memcmp(filelist_name(list, i), name, len) == 0) return i;
+    }
+    return -1;
+}
+
+static int same_item(const FileList *list, int i, const FileItem *b) {
+    FileItem a;
+    filelist_get(list, i, &a);
+    return a.mode == b->mode && a.size == b->size && a.mtime == b->mtime &&
+           a.uid == b->uid && a.gid == b->gid && a.inode == b->inode &&
+           a.dev == b->dev && a.nlink == b->nlink && a.is_dir == b->is_dir;
+}
+
+static void maybe_compact(WatchDir *d) {
+    if (d->garbage < 4096 || d->garbage * 2 < d->list.names_len) return;
+    FileList packed;
+    filelist_init(&packed);
+    if (filelist_copy(&packed, &d->list) == 0) {
+        filelist_free(&d->list);
+        d->list = packed;
+        d->garbage = 0;
+    } else {
+        filelist_free(&packed);
+    }
+}
+
+// Re-examine one name in d after an event about it. Returns 1 if the
+// listing changed.
+static int refresh_entry(Watch *w, WatchDir *d, const char *name) {
+    size_t len = strlen(name);
+    int i = find_name(&d->list, name, len);
+
+    FileItem item;
+    int keep = w->fill(d->path, name, &item, w->ctx);
+    if (keep && i >= 0 && same_item(&d->list, i, &item)) return 0;
+
+    // A directory that went away or was replaced takes its kept subtree
+    // with it.
+    if (i >= 0 && (d->list.flags[i] & FI_DIR) &&
+        (!keep || !item.is_dir || item.inode != d->list.inode[i])) {
+        char *child = malloc(d->path_len + len + 2);
+        if (child) {
+            memcpy(child, d->path, d->path_len);
+            child[d->path_len] = '/';
+            memcpy(child + d->path_len + 1, name, len + 1);
+            drop_subtree(w, child, d->path_len + len + 1);
+            free(child);
+        }
+    }
+
+    if (!keep) {
+        if (i < 0) return 0;
+        d->garbage += (size_t)d->list.name_len[i] + 1;
+        filelist_remove(&d->list, i);
+        maybe_compact(d);
+        return 1;
+    }
+
+    if (i < 0) {
+        i = filelist_add(&d->list, name, len);
+        if (i < 0) return 0;
+    }
+    filelist_set(&d->list, i, &item);
+    return 1;
+}
+
+static void drop_all(Watch *w) {
+    for (size_t i = 0; i < w->cap; i++) {
+        if (w->slots[i]) {
+            inotify_rm_watch(w->fd, w->slots[i]->wd);
+            dir_free(w->slots[i]);
+            w->slots[i] = NULL;
+        }
+    }
+    if (w->by_wd) memset(w->by_wd, 0, (size_t)w->wd_cap * sizeof(*w->by_wd));
+    w->count = 0;
+}
+
+int watch_process(Watch *w, const char *root) {
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    int last_wd = -1;
+    char last_name[256] = "";
+
+    for (;;) {
+        ssize_t n = read(w->fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // Events were lost: read everything again.
+                drop_all(w);
+                changed++;
+                continue;
+            }
+            if (ev->wd < 0 || ev->wd >= w->wd_cap || !w->by_wd[ev->wd]) continue;
+
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED | IN_UNMOUNT)) {
+                for (WatchDir *d = w->by_wd[ev->wd]; d; d = w->by_wd[ev->wd]) {
+                    if (strcmp(d->path, root) == 0) return -1;
+                    drop_subtree(w, d->path, d->path_len);
+                    if (w->by_wd[ev->wd] == d) drop_dir(w, d, 0);
+                }
+                changed++;
+                continue;
+            }
+            if (!ev->len) continue;   // the directory's own attributes: its parent hears too
+
+            // Writes to one file arrive as a run of IN_MODIFY; one look is enough.
+            if (ev->wd == last_wd && strcmp(ev->name, last_name) == 0 && (ev->mask & IN_MODIFY)) continue;
+            last_wd = ev->wd;
+            snprintf(last_name, sizeof(last_name), "%s", ev->name);
+
+            for (WatchDir *d = w->by_wd[ev->wd]; d; d = d->next_wd) {
+                changed += refresh_entry(w, d, ev->name);
+            }
+        }
+    }
+    return changed;
+}
+
+#else
+
+Watch *watch_new(WatchFillFn fill, void *ctx) {
+    (void)fill;
+    (void)ctx;
+    errno = ENOSYS;
+    return NULL;
+}
+
+void watch_free(Watch *w) {
+    (void)w;
+}
+
+const FileList *watch_find(const Watch *w, const char *path) {
+    (void)w;
+    (void)path;
+    return NULL;
+}
+
+int watch_start(Watch *w, const char *path) {
+    (void)w;
+    (void)path;
+    return -1;
+}
+
+int watch_keep(Watch *w, int wd, const char *path, const FileList *list) {
+    (void)w;
+    (void)wd;
+    (void)path;
+    (void)list;
+    return -1;
+}
+
+int watch_fd(const Watch *w) {
+    (void)w;
+    return -1;
+}
+
+int watch_process(Watch *w, const char *root) {
+    (void)w;
+    (void)root;
+    return -1;
+}
+
+#endif